@@ -0,0 +1,117 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <sys/mman.h>
+#include <algorithm>
+#include <cassert>
+
+#include "Arena.h"
+
+namespace lessdb {
+
+constexpr size_t Arena::kDefaultBlockSize;
+constexpr size_t Arena::kMinBlockSize;
+constexpr size_t Arena::kAlignUnit;
+
+static inline size_t RoundUp(size_t n, size_t unit) {
+  return (n + unit - 1) / unit * unit;
+}
+
+Arena::Arena(size_t block_size, size_t huge_page_size)
+    : block_size_(huge_page_size > 0
+                      ? RoundUp(std::max(block_size, kMinBlockSize),
+                                huge_page_size)
+                      : RoundUp(std::max(block_size, kMinBlockSize),
+                                kAlignUnit)),
+      huge_page_size_(huge_page_size),
+      alloc_ptr_(nullptr),
+      alloc_bytes_remaining_(0),
+      blocks_memory_(0) {}
+
+Arena::~Arena() {
+  for (auto &block : mapped_blocks_) {
+    munmap(block.first, block.second);
+  }
+}
+
+void *Arena::allocate(size_t size) {
+  size = RoundUp(std::max<size_t>(size, 1), kAlignUnit);
+  if (size <= alloc_bytes_remaining_) {
+    char *result = alloc_ptr_;
+    alloc_ptr_ += size;
+    alloc_bytes_remaining_ -= size;
+    return result;
+  }
+  return allocateFallback(size);
+}
+
+void *Arena::allocateFallback(size_t size) {
+  if (size > block_size_ / 4) {
+    // Object is more than a quarter of our block size. Allocate it
+    // separately to avoid wasting too much space in leftover bytes.
+    return allocateNewBlock(size);
+  }
+
+  // We waste the remaining space in the current block.
+  alloc_ptr_ = allocateNewBlock(block_size_);
+  alloc_bytes_remaining_ = block_size_;
+
+  char *result = alloc_ptr_;
+  alloc_ptr_ += size;
+  alloc_bytes_remaining_ -= size;
+  return result;
+}
+
+char *Arena::allocateNewBlock(size_t block_bytes) {
+  if (huge_page_size_ > 0) {
+    size_t mapped_bytes = RoundUp(block_bytes, huge_page_size_);
+    void *addr = MAP_FAILED;
+#ifdef MAP_HUGETLB
+    addr = mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+#endif
+    if (addr == MAP_FAILED) {
+      // No huge pages reserved, ask for transparent huge pages instead,
+      // which is only a hint.
+      addr = mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE,
+                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+#ifdef MADV_HUGEPAGE
+      if (addr != MAP_FAILED) {
+        madvise(addr, mapped_bytes, MADV_HUGEPAGE);
+      }
+#endif
+    }
+    if (addr != MAP_FAILED) {
+      mapped_blocks_.emplace_back(addr, mapped_bytes);
+      blocks_memory_ += mapped_bytes;
+      return static_cast<char *>(addr);
+    }
+    // Fall back to the heap.
+  }
+
+  char *block = new char[block_bytes];
+  blocks_.emplace_back(block);
+  blocks_memory_ += block_bytes;
+  return block;
+}
+
+}  // namespace lessdb
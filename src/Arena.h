@@ -0,0 +1,97 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "Disallowcopying.h"
+
+namespace lessdb {
+
+// Arena allocates memory in blocks, and hands it out by bumping a pointer
+// within the current block. The memory is released only when the arena is
+// destroyed. Not thread-safe (@see ConcurrentArena).
+//
+// If huge_page_size is positive, the blocks are backed by huge pages of that
+// size: they are mapped from the reserved huge pages (MAP_HUGETLB) if
+// possible, or else advised to be backed by transparent huge pages
+// (MADV_HUGEPAGE). Huge pages cut the TLB misses in traversing large
+// memtables. Without them, the blocks are allocated from the heap.
+class Arena {
+  __DISALLOW_COPYING__(Arena);
+
+ public:
+  static constexpr size_t kDefaultBlockSize = 1 << 20;
+  static constexpr size_t kMinBlockSize = 4096;
+
+  // Every allocation is aligned to kAlignUnit.
+  static constexpr size_t kAlignUnit = sizeof(void *);
+
+  explicit Arena(size_t block_size = kDefaultBlockSize,
+                 size_t huge_page_size = 0);
+
+  ~Arena();
+
+  void *allocate(size_t size);
+
+  void deallocate(void *) {
+    // no-op
+  }
+
+  // Total size of the blocks allocated.
+  size_t bytesUsed() const {
+    return blocks_memory_;
+  }
+
+  // Bytes left in the current block.
+  size_t bytesRemaining() const {
+    return alloc_bytes_remaining_;
+  }
+
+  size_t BlockSize() const {
+    return block_size_;
+  }
+
+ private:
+  void *allocateFallback(size_t size);
+
+  char *allocateNewBlock(size_t block_bytes);
+
+ private:
+  const size_t block_size_;
+  const size_t huge_page_size_;
+
+  char *alloc_ptr_;
+  size_t alloc_bytes_remaining_;
+  size_t blocks_memory_;
+
+  std::vector<std::unique_ptr<char[]>> blocks_;
+
+  // Blocks mapped by mmap(2), along with their lengths.
+  std::vector<std::pair<void *, size_t>> mapped_blocks_;
+};
+
+}  // namespace lessdb
@@ -20,6 +20,8 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+
 #include "Block.h"
 #include "TableFormat.h"
 #include "Coding.h"
@@ -29,15 +31,45 @@
 namespace lessdb {
 
 Block::Block(const BlockContent &content, const Comparator *comp)
-    : data_(content.data.RawData()), size_(content.data.Len()), comp_(comp) {
+    : data_(content.data.RawData()),
+      comp_(comp),
+      size_(content.data.Len()),
+      buckets_(nullptr),
+      num_buckets_(0),
+      heap_allocated_(content.heap_allocated) {
   num_restart_ = ConstDataView(data_ + size_ - 4).ReadNum<uint32_t>();
-  assert(size_ >= 4 * (num_restart_ + 1));
-  data_end_ = data_ + size_ - 4 * (num_restart_ + 1);
+  size_t trailer = 4;
+  if (num_restart_ & kBlockHashIndexFlag) {
+    num_restart_ &= ~kBlockHashIndexFlag;
+    num_buckets_ = ConstDataView(data_ + size_ - 6).ReadNum<uint16_t>();
+    trailer += 2 + num_buckets_;
+    assert(size_ >= trailer);
+    buckets_ = reinterpret_cast<const uint8_t *>(data_ + size_ - trailer);
+  }
+  assert(size_ >= trailer + 4 * num_restart_);
+  data_end_ = data_ + size_ - trailer - 4 * num_restart_;
 }
 
 Block::ConstIterator Block::find(const Slice &target) const {
+  if (num_buckets_ > 0) {
+    uint8_t restart = hashBucket(target);
+    if (restart == kBlockHashNoEntry)
+      return end();
+
+    ConstIterator it = end();
+    if (restart != kBlockHashCollision && restart < num_restart_) {
+      // The user key of target is either absent or in the interval.
+      searchRestartInterval(restart, target, &it);
+      if (it == end() || comp_->Compare(it.Key(), target) != 0)
+        return end();
+      return it;
+    }
+  }
+
   auto it = lower_bound(target);
-  return comp_->Compare(it.Key(), target) != 0 ? end() : it;
+  if (it == end() || comp_->Compare(it.Key(), target) != 0)
+    return end();
+  return it;
 }
 
 Block::ConstIterator Block::begin() const {
@@ -51,12 +83,26 @@ Block::ConstIterator Block::end() const {
 
 uint32_t Block::restartPoint(int id) const {
   assert(id <= num_restart_);
-  uint32_t r = ConstDataView(data_)
-                   .ReadNum<uint32_t>(size_ - 4 * (num_restart_ - id + 1));
+  uint32_t r = ConstDataView(data_end_).ReadNum<uint32_t>(4 * id);
   assert(r <= data_end_ - data_);
   return r;
 }
 
+int Block::restartIntervalBefore(uint32_t offset) const {
+  assert(offset > 0);
+  // restartPoint(0) is 0, the answer is in range [0, num_restart)
+  int lb = 0, rb = num_restart_;
+  while (rb - lb > 1) {
+    int mid = (lb + rb) / 2;
+    if (restartPoint(mid) < offset) {
+      lb = mid;
+    } else {
+      rb = mid;
+    }
+  }
+  return lb;
+}
+
 Slice Block::keyAtRestartPoint(int id) const {
   uint32_t shared, unshared, value_len;
   uint32_t pos = restartPoint(id);
@@ -69,7 +115,39 @@ Slice Block::keyAtRestartPoint(int id) const {
   return Slice(buf.RawData(), unshared);
 }
 
+uint8_t Block::hashBucket(const Slice &key) const {
+  assert(num_buckets_ > 0);
+  Slice user_key = comp_->UserKey(key);
+  return buckets_[BlockHash(user_key) % num_buckets_];
+}
+
+bool Block::searchRestartInterval(int id, const Slice &target,
+                                  ConstIterator *it) const {
+  Slice user_key = comp_->UserKey(target);
+  bool found = false;
+
+  uint32_t pos = restartPoint(id);
+  *it = ConstIterator(data_ + pos, this, pos);
+  for (; *it != end(); ++*it) {
+    Slice key = it->Key();
+    if (!found)
+      found = comp_->UserKey(key).Compare(user_key) == 0;
+    if (comp_->Compare(key, target) >= 0)
+      break;
+  }
+  return found;
+}
+
 Block::ConstIterator Block::lower_bound(const Slice &target) const {
+  if (num_buckets_ > 0) {
+    uint8_t restart = hashBucket(target);
+    if (restart < num_restart_) {
+      ConstIterator it = end();
+      if (searchRestartInterval(restart, target, &it))
+        return it;
+    }
+  }
+
   // Binary search in restart array to find the lastest restart point
   // with a key < target
 
@@ -84,12 +162,8 @@ Block::ConstIterator Block::lower_bound(const Slice &target) const {
     }
   }
 
-  if (comp_->Compare(keyAtRestartPoint(lb), target) > 0) {
-    assert(lb == 0 && rb == lb + 1);
-    return end();
-  }
-
-  // Searches from the restart point.
+  // Searches from the restart point. If even the first key is >= target,
+  // lb is 0 and the search stops at begin().
 
   uint32_t pos = restartPoint(lb);
   auto it = ConstIterator(data_ + pos, this, pos);
@@ -143,11 +217,52 @@ void BlockConstIterator::increment() {
   key_.clear();
 }
 
+void BlockConstIterator::decrement() {
+  // must not be begin()
+  assert(entry_ > block_->data_);
+
+  std::shared_ptr<const RestartInterval> interval = interval_;
+  if (!interval || entry_ <= interval->entries.front() ||
+      entry_ > interval->end) {
+    uint32_t offset = static_cast<uint32_t>(entry_ - block_->data_);
+    interval = decodeInterval(block_->restartIntervalBefore(offset));
+  }
+
+  // The previous entry is the last one before entry_ in the interval.
+  auto &entries = interval->entries;
+  size_t i = std::lower_bound(entries.begin(), entries.end(), entry_) -
+             entries.begin() - 1;
+  BlockConstIterator prev(entries[i], block_,
+                          block_->restartPoint(interval->id));
+  if (i > 0)
+    prev.last_key_ = interval->deltas[i - 1];
+  prev.interval_ = std::move(interval);
+  *this = std::move(prev);
+}
+
+std::shared_ptr<const BlockConstIterator::RestartInterval>
+BlockConstIterator::decodeInterval(int id) const {
+  auto interval = std::make_shared<RestartInterval>();
+  interval->id = id;
+  interval->end = (id + 1 < block_->num_restart_)
+                      ? block_->data_ + block_->restartPoint(id + 1)
+                      : block_->data_end_;
+
+  uint32_t pos = block_->restartPoint(id);
+  for (BlockConstIterator it(block_->data_ + pos, block_, pos);
+       it.entry_ < interval->end; ++it) {
+    interval->entries.push_back(it.entry_);
+    interval->deltas.push_back(it.buf_);
+  }
+  return interval;
+}
+
 bool BlockConstIterator::equal(const Block::ConstIterator &other) const {
   return buf_ == other.buf_ && buf_len_ == other.buf_len_;
 }
 
 void BlockConstIterator::init(const char *p) {
+  entry_ = p;
   size_t len = (block_->data_end_ - p);
   assert(len >= 0);
   if (len > 0) {
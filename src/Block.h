@@ -23,6 +23,9 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
 #include <boost/smart_ptr/intrusive_ref_counter.hpp>
 
 #include "IteratorFacade.h"
@@ -37,7 +40,8 @@ class Block;
 
 class BlockConstIterator;
 using BlockConstIteratorFacade =
-    IteratorFacadeNoValueType<BlockConstIterator, ForwardIteratorTag, true>;
+    IteratorFacadeNoValueType<BlockConstIterator, BidirectionalIteratorTag,
+                              true>;
 
 class BlockConstIterator : public BlockConstIteratorFacade {
   friend class IteratorCoreAccess;
@@ -59,7 +63,11 @@ class BlockConstIterator : public BlockConstIteratorFacade {
  private:
   void increment();
 
-  // void decrement();
+  // Entries are delta encoded forwards, so a step backwards decodes the
+  // restart interval of the previous entry. The decoded interval is cached
+  // and shared between copies of the iterator, the following steps in the
+  // same interval are constant time.
+  void decrement();
 
   bool equal(const BlockConstIterator& other) const;
 
@@ -68,7 +76,19 @@ class BlockConstIterator : public BlockConstIteratorFacade {
 
   void init(const char* p);
 
+  // The entries of a restart interval.
+  struct RestartInterval {
+    int id;
+    const char* end;                   // the start of the next interval
+    std::vector<const char*> entries;  // the start of each entry
+    std::vector<const char*> deltas;   // the key_delta of each entry
+  };
+
+  // Decodes the restart interval id of block_.
+  std::shared_ptr<const RestartInterval> decodeInterval(int id) const;
+
  private:
+  const char* entry_;  // the start of the entry
   const char* buf_;
   size_t buf_len_;
   const char* last_key_;
@@ -80,13 +100,16 @@ class BlockConstIterator : public BlockConstIteratorFacade {
   Status stat_;  // TODO: Store errors into stat_.
 
   mutable std::string key_;
+
+  // The last interval decoded by decrement, if any.
+  std::shared_ptr<const RestartInterval> interval_;
 };
 
 // Use reference counting to share Blocks between block cache and SSTable.
 // @see TwoLevelIterator::~TwoLevelIterator
 // @see SSTable::ObtainBlockByIndexIterator
 using BlockRefCounterMixin =
-    boost::intrusive_ref_counter<Block, boost::thread_unsafe_counter>;
+    boost::intrusive_ref_counter<Block, boost::thread_safe_counter>;
 
 /// Block represents a block in SSTable, it provides read-only operation
 /// (declaring Block without const specifier is fine).
@@ -97,18 +120,28 @@ class Block : public BlockRefCounterMixin {
   Block(const BlockContent& content, const Comparator* comp);
 
   // empty block
-  Block() = default;
-
-  // Block data is allocated by new[].
+  Block()
+      : data_(nullptr),
+        data_end_(nullptr),
+        comp_(nullptr),
+        size_(0),
+        num_restart_(0),
+        buckets_(nullptr),
+        num_buckets_(0),
+        heap_allocated_(false) {}
+
+  // Block data read from files is allocated by new[].
   // @see ReadBlockFromFile in BlockUtils.h
   ~Block() {
-    if (!data_)
+    if (heap_allocated_)
       delete[] data_;
   }
 
   friend class BlockConstIterator;
   typedef BlockConstIterator ConstIterator;
 
+  // Uses the hash index to find the restart interval of key if the block
+  // has one, or to tell the key is absent without searching.
   ConstIterator find(const Slice& key) const;
 
   ConstIterator begin() const;
@@ -118,6 +151,8 @@ class Block : public BlockRefCounterMixin {
 
   // Returns an iterator pointing to the first element in the container which is
   // not considered to go before val.
+  // Point lookups of the keys in the block are sped up by the hash index,
+  // if the block has one.
   ConstIterator lower_bound(const Slice& key) const;
 
   const char* RawData() const {
@@ -127,14 +162,32 @@ class Block : public BlockRefCounterMixin {
  private:
   uint32_t restartPoint(int id) const;
 
+  // Returns the index of the last restart point before offset.
+  // REQUIRE: offset > 0
+  int restartIntervalBefore(uint32_t offset) const;
+
   Slice keyAtRestartPoint(int id) const;
 
+  // Returns the bucket of the user key of key in the hash index.
+  // REQUIRE: num_buckets_ > 0
+  uint8_t hashBucket(const Slice& key) const;
+
+  // Searches from restart point id for the first entry >= key, and returns
+  // true if that entry or the one before has the same user key as key, so
+  // that it's what lower_bound returns as long as the user key first
+  // appears in restart interval id.
+  bool searchRestartInterval(int id, const Slice& key,
+                             ConstIterator* it) const;
+
  private:
   const char* const data_;
   const char* data_end_;  // points at the first byte of the trailer
   const Comparator* comp_;
   size_t size_;
   uint32_t num_restart_;
+  const uint8_t* buckets_;  // the hash index, if num_buckets_ > 0
+  uint16_t num_buckets_;
+  bool heap_allocated_;
 };
 
 }  // namespace lessdb
\ No newline at end of file
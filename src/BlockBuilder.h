@@ -24,6 +24,8 @@
 
 #include <vector>
 #include <cassert>
+#include <cstdint>
+#include <algorithm>
 
 #include "Disallowcopying.h"
 #include "Slice.h"
@@ -31,6 +33,8 @@
 #include "Options.h"
 #include "DataView.h"
 #include "Coding.h"
+#include "Comparator.h"
+#include "TableFormat.h"
 
 namespace lessdb {
 
@@ -52,12 +56,26 @@ struct Options;
 //     num_restarts: uint32
 // restarts[i] contains the offset within the block of the ith restart point.
 //
+// Data blocks built with the hash index (@see
+// Options::data_block_hash_table_util_ratio) have the trailer:
+//     restarts: uint32[num_restarts]
+//     buckets: uint8[num_buckets]
+//     num_buckets: uint16
+//     num_restarts | kBlockHashIndexFlag: uint32
+// buckets[BlockHash(user_key) % num_buckets] contains the index of the restart
+// interval where the user key first appears (@see TableFormat.h).
+//
 class BlockBuilder {
   __DISALLOW_COPYING__(BlockBuilder);
 
  public:
-  BlockBuilder(const Options *option)
-      : finished_(false), option_(option), count_(0) {
+  // @param hash_index: builds the hash index if it's enabled by the option.
+  BlockBuilder(const Options *option, bool hash_index = false)
+      : finished_(false),
+        option_(option),
+        count_(0),
+        hash_index_(hash_index &&
+                    option->data_block_hash_table_util_ratio > 0) {
     restarts_.push_back(0);
   }
 
@@ -74,6 +92,16 @@ class BlockBuilder {
 
     size_t unshared = key.Len() - shared;
 
+    if (hash_index_) {
+      // Only the first entry of a user key is indexed, the others (of older
+      // sequence numbers) follow it.
+      Slice user_key = option_->comparator->UserKey(key);
+      if (hashes_.empty() || user_key.Compare(last_user_key_) != 0) {
+        hashes_.emplace_back(BlockHash(user_key), restarts_.size() - 1);
+        last_user_key_.assign(user_key.RawData(), user_key.Len());
+      }
+    }
+
     // append a new entry into buffer.
     coding::AppendVar32(&buf_, static_cast<uint32_t>(shared));
     coding::AppendVar32(&buf_, static_cast<uint32_t>(unshared));
@@ -102,8 +130,15 @@ class BlockBuilder {
       buf_.append(ibuf, sizeof(uint32_t));
     }
 
+    uint32_t num_restarts = static_cast<uint32_t>(restarts_.size());
+    if (hash_index_ && !hashes_.empty() &&
+        num_restarts <= kBlockHashMaxRestarts) {
+      appendHashIndex();
+      num_restarts |= kBlockHashIndexFlag;
+    }
+
     // append num_restarts
-    DataView(ibuf).WriteNum(static_cast<uint32_t>(restarts_.size()));
+    DataView(ibuf).WriteNum(num_restarts);
     buf_.append(ibuf, sizeof(uint32_t));
 
     finished_ = true;
@@ -112,7 +147,10 @@ class BlockBuilder {
 
   // Current size of the block including the size of trailer.
   size_t Size() const {
-    return buf_.size() + (restarts_.size() + 1) * 4;
+    size_t size = buf_.size() + (restarts_.size() + 1) * 4;
+    if (hash_index_ && !hashes_.empty())
+      size += numBuckets() + sizeof(uint16_t);
+    return size;
   }
 
   int Count() const {
@@ -127,6 +165,8 @@ class BlockBuilder {
     restarts_.clear();
     count_ = 0;
     restarts_.push_back(0);
+    hashes_.clear();
+    last_user_key_.clear();
   }
 
  private:
@@ -140,6 +180,31 @@ class BlockBuilder {
     return i;
   }
 
+  size_t numBuckets() const {
+    double n = hashes_.size() / option_->data_block_hash_table_util_ratio;
+    return std::min<size_t>(std::max<size_t>(static_cast<size_t>(n), 1),
+                            UINT16_MAX);
+  }
+
+  void appendHashIndex() {
+    std::string buckets(numBuckets(), static_cast<char>(kBlockHashNoEntry));
+    for (const auto &h : hashes_) {
+      char &bucket = buckets[h.first % buckets.size()];
+      uint8_t restart = static_cast<uint8_t>(bucket);
+      if (restart == kBlockHashNoEntry) {
+        bucket = static_cast<char>(h.second);
+      } else if (restart != h.second) {
+        // A lookup hashed to this bucket has to search the whole block.
+        bucket = static_cast<char>(kBlockHashCollision);
+      }
+    }
+    buf_.append(buckets);
+
+    char ibuf[sizeof(uint16_t)];
+    DataView(ibuf).WriteNum(static_cast<uint16_t>(buckets.size()));
+    buf_.append(ibuf, sizeof(uint16_t));
+  }
+
  private:
   // In use:
   // option->block_restart_interval
@@ -150,6 +215,14 @@ class BlockBuilder {
   bool finished_;                   // Has Finish() been called?
   std::vector<uint32_t> restarts_;  // Restart points.
   int count_;  // Number of entries emitted since last restart point.
+
+  // In use:
+  // option->data_block_hash_table_util_ratio
+  // option->comparator
+  const bool hash_index_;
+  std::string last_user_key_;  // The user key of the last indexed entry.
+  // The hash of each indexed user key and its restart interval.
+  std::vector<std::pair<uint32_t, uint32_t>> hashes_;
 };
 
 }  // namespace lessdb
\ No newline at end of file
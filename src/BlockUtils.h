@@ -34,20 +34,22 @@
 
 namespace lessdb {
 
-// Read the block identified by "handle" from "file".  On failure return non-OK.
-// On success read the data and return OK.
-// NOTE: The Block pointer returned should be deleted when it's not needed.
-inline Block *ReadBlockFromFile(RandomAccessFile *file,
-                                const ReadOptions &options,
-                                const Comparator *cmp,
-                                const BlockHandle &handle, Status &s) {
+// Read the contents of the block identified by "handle" from "file", without
+// the trailer. On failure return non-OK.
+// NOTE: content->data should be deleted by delete[] when it's not needed, iff
+// content->heap_allocated is true.
+inline Status ReadBlockContent(RandomAccessFile *file,
+                               const ReadOptions &options,
+                               const BlockHandle &handle,
+                               BlockContent *content) {
   assert(handle.size > kBlockTrailerSize);
 
   std::unique_ptr<char[]> p_block_buf(new char[handle.size]);
   char *block_buf = p_block_buf.get();
 
   Slice data;
-  s = file->Read(handle.size, handle.offset - handle.size, block_buf, &data);
+  Status s =
+      file->Read(handle.size, handle.offset - handle.size, block_buf, &data);
 
   if (s) {
     if (data.Len() < handle.size) {
@@ -56,31 +58,47 @@ inline Block *ReadBlockFromFile(RandomAccessFile *file,
   }
 
   if (!s) {
-    return nullptr;
+    return s;
   }
 
   uint64_t block_size = handle.size - kBlockTrailerSize;
 
+  // The file may return the data in place (e.g mmaped files) rather than
+  // reading it into block_buf.
+  const char *data_buf = data.RawData();
+
   if (options.verify_checksums) {
     boost::crc_32_type crc32;
 
-    crc32.process_bytes(block_buf, block_size);
+    crc32.process_bytes(data_buf, block_size);
     uint32_t actual_crc =
-        ConstDataView(block_buf + block_size + sizeof(uint8_t))
+        ConstDataView(data_buf + block_size + sizeof(uint8_t))
             .ReadNum<uint32_t>();
     if (crc32.checksum() != actual_crc) {
-      s = Status::Corruption("ReadBlockFromFile: Block checksum mismatch");
-      return nullptr;
+      return Status::Corruption("ReadBlockFromFile: Block checksum mismatch");
     }
   }
 
-  BlockContent blck_content;
-  blck_content.data = Slice(data.RawData(), data.Len() - kBlockTrailerSize);
-  Block *ret = new Block(blck_content, cmp);
+  content->data = Slice(data_buf, block_size);
+  content->heap_allocated = (data_buf == block_buf);
+  if (content->heap_allocated)
+    p_block_buf.release();
+  return Status::OK();
+}
 
-  p_block_buf.release();
-  s = Status::OK();
-  return ret;
+// Read the block identified by "handle" from "file".  On failure return non-OK.
+// On success read the data and return OK.
+// NOTE: The Block pointer returned should be deleted when it's not needed.
+inline Block *ReadBlockFromFile(RandomAccessFile *file,
+                                const ReadOptions &options,
+                                const Comparator *cmp,
+                                const BlockHandle &handle, Status &s) {
+  BlockContent blck_content;
+  s = ReadBlockContent(file, options, handle, &blck_content);
+  if (!s) {
+    return nullptr;
+  }
+  return new Block(blck_content, cmp);
 }
 
 }  // namespace lessdb
\ No newline at end of file
@@ -48,7 +48,7 @@ class LRUCacheStrategy final : public CacheStrategy {
   ~LRUCacheStrategy() override = default;
 
   LRUCacheStrategy(size_t capacity)
-      : CacheStrategy(capacity), capacity_(capacity) {}
+      : CacheStrategy(capacity), capacity_(capacity), unique_id_(0) {}
 
   HANDLE Insert(const Slice &key, const boost::any &value) override {
     std::lock_guard<std::mutex> guard(mu_);
@@ -89,10 +89,35 @@ class LRUCacheStrategy final : public CacheStrategy {
 
   HANDLE Lookup(const Slice &key) override {
     std::lock_guard<std::mutex> guard(mu_);
+    return reinterpret_cast<Handle *>(lookup(key));
+  }
+
+  bool Lookup(const Slice &key, boost::any *value) override {
+    std::lock_guard<std::mutex> guard(mu_);
 
+    LRUHandle *handle = lookup(key);
+    if (handle == nullptr)
+      return false;
+    *value = handle->value;
+    return true;
+  }
+
+  boost::any &Value(HANDLE handle) const override {
+    return reinterpret_cast<LRUHandle *>(handle)->value;
+  }
+
+  uint64_t NewId() override {
+    std::lock_guard<std::mutex> guard(mu_);
+    return unique_id_++;
+  }
+
+ private:
+  // Moves the entry of key to the front of cache_, if there's one.
+  // REQUIRES: mu_ is held.
+  LRUHandle *lookup(const Slice &key) {
     auto it = handleTable_.find(key.ToString());
     if (it == handleTable_.end())
-      return NULL;
+      return nullptr;
 
     // cache hit, remove from cache
     cache_.erase(it->second.where);
@@ -104,16 +129,7 @@ class LRUCacheStrategy final : public CacheStrategy {
              .first;
     cache_.push_front(it->first);
     it->second.where = cache_.begin();
-    return reinterpret_cast<Handle *>(&it->second);
-  }
-
-  boost::any &Value(HANDLE handle) const override {
-    return reinterpret_cast<LRUHandle *>(handle)->value;
-  }
-
-  uint64_t NewId() override {
-    std::lock_guard<std::mutex> guard(mu_);
-    return unique_id_++;
+    return &it->second;
   }
 
  private:
@@ -32,7 +32,6 @@ class any;
 
 namespace lessdb {
 
-// TODO: Concurrency in CacheStrategy.
 // A CacheStrategy is an interface that maps keys to values.  It has
 // internal synchronization and may be safely accessed concurrently from
 // multiple threads.  It may automatically evict entries to make room
@@ -63,7 +62,14 @@ class CacheStrategy {
   // calling of Lookup.
   virtual HANDLE Lookup(const Slice &key) = 0;
 
+  // If the cache has a mapping for "key", copies its value into *value and
+  // returns true. Unlike the handle returned by Lookup(key), the copy stays
+  // valid when the entry is evicted by other threads.
+  virtual bool Lookup(const Slice &key, boost::any *value) = 0;
+
   // Return the value encapsulated in a valid handle.
+  // NOTE: the handle is invalidated once the entry is erased or evicted,
+  // which may be done concurrently by other threads.
   virtual boost::any &Value(HANDLE handle) const = 0;
 
   // Return a new numeric id.  May be used by multiple clients who are
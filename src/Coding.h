@@ -22,6 +22,8 @@
 
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <silly/Coding.h>
 
 namespace lessdb {
@@ -39,6 +41,50 @@ using silly::coding::GetVar64;
 using silly::coding::GetVar32;
 using silly::coding::GetVarString;
 
+// Returns the length of the varint32 or varint64 encoding of v.
+inline size_t VarintLength(uint64_t v) {
+  size_t len = 1;
+  while (v >= 128) {
+    v >>= 7;
+    len++;
+  }
+  return len;
+}
+
+// Encode v as varint32 into dst, and returns a pointer just past the last
+// byte written.
+// REQUIRES: dst has enough space for VarintLength(v) bytes.
+inline char *EncodeVar32(char *dst, uint32_t v) {
+  uint8_t *p = reinterpret_cast<uint8_t *>(dst);
+  while (v >= 128) {
+    *(p++) = static_cast<uint8_t>(v | 128);
+    v >>= 7;
+  }
+  *(p++) = static_cast<uint8_t>(v);
+  return reinterpret_cast<char *>(p);
+}
+
+// Decode a varint32 from p, and returns a pointer just past the decoded
+// bytes. It's the caller's duty to ensure p points at a valid varint32, for
+// example, the ones encoded by lessdb itself in memory.
+inline const char *DecodeVar32(const char *p, uint32_t *v) {
+  const uint8_t *s = reinterpret_cast<const uint8_t *>(p);
+  if ((*s & 128) == 0) {  // fast path
+    *v = *s;
+    return p + 1;
+  }
+
+  uint32_t result = 0;
+  for (uint32_t shift = 0; shift <= 28; shift += 7) {
+    uint32_t byte = *(s++);
+    result |= ((byte & 127) << shift);
+    if ((byte & 128) == 0)
+      break;
+  }
+  *v = result;
+  return reinterpret_cast<const char *>(s);
+}
+
 }  // namespace coding
 
 }  // namespace lessdb
\ No newline at end of file
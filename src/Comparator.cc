@@ -20,14 +20,20 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
 #include <mutex>
-#include <numeric>
 
 #include "Comparator.h"
 #include "Slice.h"
 
 namespace lessdb {
 
+Slice Comparator::UserKey(const Slice &key) const {
+  return key;
+}
+
 class BytewiseComparator final : public Comparator {
  public:
   const char *Name() const override {
@@ -40,27 +46,37 @@ class BytewiseComparator final : public Comparator {
 
   void FindShortestSeparator(std::string *start,
                              const Slice &limit) const override {
-    // if start < limit, start and limit must share same prefix (the prefix can
-    // be null), assume i is the smallest index where start.length < i ||
-    // start[i] < limit[i]
-    // then start[i] = max(start[i]+1, 0xff);
-    size_t sep = start->length();
-    for (size_t i = 0; i < start->length(); i++) {
-      assert(i < limit.Len());
-      if ((*start)[i] == limit[i])
-        continue;
-      assert((*start)[i] < limit[i]);
-      if ((*start)[i] < std::numeric_limits<char>::max())
-        (*start)[i] = static_cast<char>((*start)[i] + 1);
-      sep = i;
-      break;
+    // Find the length of the common prefix of start and limit, the bytes are
+    // compared as unsigned, in the same way as Slice::Compare.
+    size_t min_len = std::min(start->length(), limit.Len());
+    size_t diff = 0;
+    while (diff < min_len && (*start)[diff] == limit[diff])
+      diff++;
+
+    if (diff >= min_len) {
+      // Do not shorten if one string is a prefix of the other.
+      return;
     }
 
-    if (sep == start->length()) {
-      assert(limit.Len() > sep);
-      assert(limit[sep] != 0);
-      start->push_back(static_cast<char>(limit[sep] - 1));
+    uint8_t byte = static_cast<uint8_t>((*start)[diff]);
+    if (byte < 0xff && byte + 1 < static_cast<uint8_t>(limit[diff])) {
+      (*start)[diff] = static_cast<char>(byte + 1);
+      start->resize(diff + 1);
+      assert(Compare(*start, limit) < 0);
+    }
+  }
+
+  void FindShortSuccessor(std::string *key) const override {
+    // Find the first byte that can be incremented, and cut the rest.
+    for (size_t i = 0; i < key->length(); i++) {
+      uint8_t byte = static_cast<uint8_t>((*key)[i]);
+      if (byte != 0xff) {
+        (*key)[i] = static_cast<char>(byte + 1);
+        key->resize(i + 1);
+        return;
+      }
     }
+    // *key is a run of 0xffs, leave it alone.
   }
 };
 
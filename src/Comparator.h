@@ -55,6 +55,18 @@ class Comparator {
   virtual void FindShortestSeparator(std::string *start,
                                      const Slice &limit) const = 0;
 
+  // Changes *key to a short string >= *key.
+  // Leaving *key unchanged is correct, which is what the default does.
+  // @see SSTableBuilder::Finish
+  virtual void FindShortSuccessor(std::string *key) const {}
+
+  // Returns the part of key that a point lookup matches exactly, which is
+  // hashed by the hash index of data blocks (@see BlockBuilder). Keys are
+  // their own user keys unless they carry extra information, like the
+  // sequence numbers of internal keys.
+  // REQUIRE: keys equal by Compare have the same bytes of user key.
+  virtual Slice UserKey(const Slice &key) const;
+
  protected:
   Comparator() = default;
 };
@@ -0,0 +1,96 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <sched.h>
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <thread>
+
+#include "ConcurrentArena.h"
+
+namespace lessdb {
+
+ConcurrentArena::ConcurrentArena(size_t block_size, size_t huge_page_size)
+    : arena_(block_size, huge_page_size),
+      arena_used_(0),
+      shard_block_size_(
+          std::min<size_t>(128 << 10, arena_.BlockSize() / 8)) {
+  // The number of shards is the number of cores rounded up to a power of 2.
+  size_t cores = std::max(std::thread::hardware_concurrency(), 1u);
+  size_t num_shards = 1;
+  while (num_shards < cores) {
+    num_shards <<= 1;
+  }
+  shard_mask_ = num_shards - 1;
+
+  shard_storage_.reset(new char[(num_shards + 1) * sizeof(Shard)]);
+  uintptr_t p = reinterpret_cast<uintptr_t>(shard_storage_.get());
+  p = (p + alignof(Shard) - 1) & ~(alignof(Shard) - 1);
+  shards_ = reinterpret_cast<Shard *>(p);
+  for (size_t i = 0; i < num_shards; i++) {
+    new (&shards_[i]) Shard();
+  }
+}
+
+ConcurrentArena::~ConcurrentArena() {
+  for (size_t i = 0; i <= shard_mask_; i++) {
+    shards_[i].~Shard();
+  }
+}
+
+size_t ConcurrentArena::currentShard() const {
+#ifdef __linux__
+  int cpu = sched_getcpu();
+  if (cpu >= 0) {
+    return static_cast<size_t>(cpu) & shard_mask_;
+  }
+#endif
+  // Without the core id, spread the threads over the shards.
+  static thread_local size_t id =
+      std::hash<std::thread::id>()(std::this_thread::get_id());
+  return id & shard_mask_;
+}
+
+void ConcurrentArena::refill(Shard *shard) {
+  std::lock_guard<std::mutex> guard(arena_mu_);
+  shard->free_begin = static_cast<char *>(arena_.allocate(shard_block_size_));
+  shard->free_bytes = shard_block_size_;
+  arena_used_.fetch_add(shard_block_size_, std::memory_order_relaxed);
+}
+
+void *ConcurrentArena::allocateFromArena(size_t size) {
+  std::lock_guard<std::mutex> guard(arena_mu_);
+  arena_used_.fetch_add(size, std::memory_order_relaxed);
+  return arena_.allocate(size);
+}
+
+size_t ConcurrentArena::bytesUsed() const {
+  size_t used = arena_used_.load(std::memory_order_relaxed);
+  for (size_t i = 0; i <= shard_mask_; i++) {
+    used -= std::min(used, shards_[i].unused.load(std::memory_order_relaxed));
+  }
+  return used;
+}
+
+}  // namespace lessdb
@@ -0,0 +1,119 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+
+#include "Arena.h"
+#include "Disallowcopying.h"
+
+namespace lessdb {
+
+/**
+ * ConcurrentArena is a thread-safe arena, which allows multiple writers
+ * to allocate memory from it simultaneously.
+ *
+ * The small allocations are served by per-core shards, each of which holds
+ * a chunk of the underlying Arena, so the writers running on different
+ * cores rarely contend. The shards refill from the Arena, which is also
+ * where the large allocations go directly, under a lock.
+ *
+ * Like Arena, the allocated memory is released only when the arena is
+ * destroyed.
+ */
+class ConcurrentArena {
+  __DISALLOW_COPYING__(ConcurrentArena);
+
+ public:
+  // @see Arena for block_size and huge_page_size.
+  explicit ConcurrentArena(size_t block_size = Arena::kDefaultBlockSize,
+                           size_t huge_page_size = 0);
+
+  ~ConcurrentArena();
+
+  void *allocate(size_t size) {
+    size = (std::max<size_t>(size, 1) + Arena::kAlignUnit - 1) &
+           ~(Arena::kAlignUnit - 1);
+    if (size > shard_block_size_ / 4) {
+      return allocateFromArena(size);
+    }
+
+    Shard &shard = shards_[currentShard()];
+    std::lock_guard<std::mutex> guard(shard.mu);
+    if (shard.free_bytes < size) {
+      refill(&shard);
+    }
+    char *mem = shard.free_begin;
+    shard.free_begin += size;
+    shard.free_bytes -= size;
+    shard.unused.store(shard.free_bytes, std::memory_order_relaxed);
+    return mem;
+  }
+
+  void deallocate(void *) {
+    // no-op
+  }
+
+  // Bytes allocated from the arena, excluding those held by the shards.
+  // It's safe to be called concurrently with allocate().
+  size_t bytesUsed() const;
+
+ private:
+  // Padded to a cache line, so that the shards don't share any.
+  struct alignas(64) Shard {
+    std::mutex mu;
+    char *free_begin;
+    size_t free_bytes;
+    std::atomic<size_t> unused;  // free_bytes, for bytesUsed()
+
+    Shard() : free_begin(nullptr), free_bytes(0), unused(0) {}
+  };
+
+  // Index of the shard of the core the caller is running on.
+  size_t currentShard() const;
+
+  // Replace the chunk of shard with a new one, the rest of the old chunk is
+  // wasted.
+  // REQUIRES: shard->mu is held.
+  void refill(Shard *shard);
+
+  void *allocateFromArena(size_t size);
+
+ private:
+  std::mutex arena_mu_;
+  Arena arena_;
+  std::atomic<size_t> arena_used_;  // bytes handed out by arena_
+
+  const size_t shard_block_size_;
+  size_t shard_mask_;
+
+  // new[] doesn't align Shards to cache lines before C++17, so they are
+  // constructed in place in shard_storage_.
+  std::unique_ptr<char[]> shard_storage_;
+  Shard *shards_;
+};
+
+}  // namespace lessdb
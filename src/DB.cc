@@ -3,3 +3,62 @@
 //
 
 #include "DB.h"
+#include "DBImpl.h"
+
+namespace lessdb {
+
+DB::DB(DBImpl *impl) : pImpl_(impl) {}
+
+DB::~DB() = default;
+
+Status DB::Open(const Options &options, const std::string &dbname,
+                DB **dbptr) {
+  *dbptr = nullptr;
+  std::unique_ptr<DBImpl> impl(new DBImpl(options, dbname));
+  Status s = impl->Open();
+  if (!s)
+    return s;
+  *dbptr = new DB(impl.release());
+  return s;
+}
+
+Status DB::Put(const WriteOptions &options, const Slice &key,
+               const Slice &value) {
+  WriteBatch batch;
+  batch.Put(key, value);
+  return pImpl_->Write(options, &batch);
+}
+
+Status DB::Delete(const WriteOptions &options, const Slice &key) {
+  WriteBatch batch;
+  batch.Delete(key);
+  return pImpl_->Write(options, &batch);
+}
+
+Status DB::Write(const WriteOptions &options, WriteBatch *updates) {
+  return pImpl_->Write(options, updates);
+}
+
+Status DB::Get(const ReadOptions &options, const Slice &key,
+               std::string *value) {
+  return pImpl_->Get(options, key, value);
+}
+
+void DB::MultiGet(const ReadOptions &options, size_t num_keys,
+                  const Slice *keys, std::string *values, Status *statuses) {
+  pImpl_->MultiGet(options, num_keys, keys, values, statuses);
+}
+
+DBIterator *DB::NewIterator(const ReadOptions &options) {
+  return pImpl_->NewIterator(options);
+}
+
+const Snapshot *DB::GetSnapshot() {
+  return pImpl_->GetSnapshot();
+}
+
+void DB::ReleaseSnapshot(const Snapshot *snapshot) {
+  pImpl_->ReleaseSnapshot(snapshot);
+}
+
+}  // namespace lessdb
@@ -4,17 +4,75 @@
 
 #pragma once
 
+#include <memory>
 #include <string>
 
 #include "Disallowcopying.h"
+#include "Slice.h"
+#include "Status.h"
+
+namespace lessdb {
 
-class Status;
 class DBImpl;
+class DBIterator;
+class Snapshot;
+class WriteBatch;
+struct Options;
+struct ReadOptions;
+struct WriteOptions;
 
+// A DB is a persistent ordered map from keys to values, safe for concurrent
+// access from multiple threads.
 class DB {
   __DISALLOW_COPYING__(DB);
 
  public:
+  // Open the database with the specified name, and store it in *dbptr.
+  // The caller should delete *dbptr when it's no longer needed.
+  static Status Open(const Options &options, const std::string &dbname,
+                     DB **dbptr);
+
+  ~DB();
+
+  Status Put(const WriteOptions &options, const Slice &key,
+             const Slice &value);
+
+  Status Delete(const WriteOptions &options, const Slice &key);
+
+  // Apply the updates of the batch atomically.
+  Status Write(const WriteOptions &options, WriteBatch *updates);
+
+  // Stores the value of key in *value if there's one, otherwise returns
+  // NotFound.
+  Status Get(const ReadOptions &options, const Slice &key,
+             std::string *value);
+
+  // Look up keys[0, num_keys) as a batch, storing the value of keys[i] in
+  // values[i], and the status of the lookup in statuses[i]. It's cheaper
+  // than calling Get for each key, as the keys in the same table or block
+  // share the reads.
+  void MultiGet(const ReadOptions &options, size_t num_keys, const Slice *keys,
+                std::string *values, Status *statuses);
+
+  // Returns an iterator over the contents of the database, as of the time
+  // it's created (@see DBIterator). The caller should delete the iterator
+  // before the DB.
+  DBIterator *NewIterator(const ReadOptions &options);
+
+  // Returns a handle to the current state of the database, which the reads
+  // with ReadOptions::snapshot set to it see, no matter what's written
+  // afterwards. The versions of keys the snapshot sees are kept until it's
+  // released. The caller should call ReleaseSnapshot when it's no longer
+  // needed, and before the DB is deleted.
+  const Snapshot *GetSnapshot();
+
+  void ReleaseSnapshot(const Snapshot *snapshot);
+
+ private:
+  explicit DB(DBImpl *impl);
+
  private:
   std::unique_ptr<DBImpl> pImpl_;
 };
+
+}  // namespace lessdb
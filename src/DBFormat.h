@@ -32,4 +32,9 @@ static constexpr SequenceNumber kMaxSequenceNumber = ((1ull << 56) - 1);
 
 enum ValueType { kTypeDeletion = 0x00, kTypeValue = 0x01 };
 
+// Entries of the same user key are sorted by decreasing sequence number and
+// then decreasing type, so a seek key packed with the highest type comes
+// before all the entries of the key at a given sequence number.
+static constexpr ValueType kValueTypeForSeek = kTypeValue;
+
 }  // namespace lessdb
\ No newline at end of file
@@ -20,16 +20,1269 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "Block.h"
 #include "DBImpl.h"
+#include "DBIterator.h"
+#include "FileName.h"
+#include "FileUtils.h"
+#include "LogReader.h"
+#include "LogWriter.h"
+#include "MemTable.h"
+#include "MergingIterator.h"
+#include "SSTable.h"
+#include "SSTableBuilder.h"
+#include "SSTableCache.h"
+#include "Snapshot.h"
+#include "WriteBatchImpl.h"
 
 namespace lessdb {
 
+static uint64_t NowMicros() {
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
 struct DBImpl::Writer {
+  WriteBatch *batch;
   std::condition_variable cv;
   Status status;
   bool sync;  // WriteOptions.sync
+  bool done;
+
+  // Set by the group leader when this writer is asked to insert its own
+  // batch into the memtable (@see Options::allow_concurrent_memtable_write).
+  Writer *leader;
+
+  // The following fields are only set on a group leader.
+  std::vector<Writer *> group;  // writers in the group, including the leader
+  SequenceNumber last_sequence;
+  size_t pending_inserts;  // number of writers that are inserting
+  Status insert_status;
+
+  Writer(WriteBatch *b, bool s)
+      : batch(b),
+        sync(s),
+        done(false),
+        leader(nullptr),
+        last_sequence(0),
+        pending_inserts(0) {}
 };
 
-Status DBImpl::Write(const WriteOptions &options, WriteBatch *batch) {}
+DBImpl::DBImpl(const Options &options, const std::string &dbname)
+    : options_(options),
+      dbname_(dbname),
+      internal_comparator_(options.comparator),
+      table_options_(options),
+      next_file_number_(1),
+      logfile_number_(0),
+      first_recyclable_log_(0),
+      level0_bytes_(0),
+      last_batch_group_size_(0),
+      num_write_groups_(0),
+      last_sequence_(0),
+      last_allocated_sequence_(0),
+      logged_sequence_(0),
+      synced_sequence_(0),
+      unsynced_bytes_(0),
+      syncing_(false),
+      sync_waiters_(0),
+      shutting_down_(false) {
+  // The filters are keyed by the user keys (@see
+  // InternalKeyComparator::UserKey).
+  table_options_.comparator = &internal_comparator_;
+  table_cache_.reset(new SSTableCache(dbname_, table_options_));
+}
+
+DBImpl::~DBImpl() {
+  {
+    std::lock_guard<std::mutex> guard(mu_);
+    shutting_down_ = true;
+  }
+  sync_cv_.notify_one();
+  flush_cv_.notify_all();
+
+  // The memtables not yet flushed are recovered from their logs by the next
+  // Open.
+  for (std::thread &thread : flush_threads_) {
+    thread.join();
+  }
+  if (sync_thread_.joinable()) {
+    sync_thread_.join();
+  }
+
+  if (logfile_) {
+    logfile_->Close();
+  }
+}
+
+Status DBImpl::Open() {
+  Status s;
+  FileFactory *factory = FileFactory::Default();
+
+  s = factory->CreateDirIfMissing(dbname_);
+  if (!s)
+    return s;
+
+  std::vector<std::string> filenames;
+  s = factory->GetChildren(dbname_, &filenames);
+  if (!s)
+    return s;
+
+  std::vector<uint64_t> logs;
+  std::vector<uint64_t> tables;
+  for (const std::string &filename : filenames) {
+    uint64_t number;
+    FileType type;
+    if (!ParseFileName(filename, &number, &type))
+      continue;
+
+    next_file_number_ = std::max(next_file_number_, number + 1);
+    switch (type) {
+      case kLogFile:
+        logs.push_back(number);
+        break;
+      case kTableFile:
+        tables.push_back(number);
+        break;
+      case kTempFile:
+        // Left by a flush interrupted by a crash, whose log is still there.
+        factory->DeleteFile(TempFileName(dbname_, number));
+        break;
+    }
+  }
+  std::sort(logs.begin(), logs.end());
+  std::sort(tables.begin(), tables.end());
+
+  // There's no manifest yet, the metadata of the level-0 tables is rebuilt by
+  // scanning them. Tables are numbered in the order of their memtables.
+  SequenceNumber max_sequence = 0;
+  for (uint64_t number : tables) {
+    FileMetaData meta;
+    s = loadLevel0Table(number, &meta);
+    if (!s)
+      return s;
+    max_sequence = std::max(max_sequence, meta.largest_sequence);
+    level0_bytes_ += meta.file_size;
+    level0_.push_back(std::move(meta));
+  }
+
+  mem_.reset(newMemTable());
+
+  // Replay the logs left by the last run in the order they were written.
+  // The records of the memtables that have been flushed are skipped, e.g.
+  // those left in the logs kept for recycling. Level-0 tables are installed
+  // in the order of their memtables, whose sequence numbers are ascending,
+  // so all the records up to the largest sequence number in level-0 have
+  // been flushed.
+  SequenceNumber flushed_sequence = max_sequence;
+  for (uint64_t number : logs) {
+    s = recoverLogFile(number, flushed_sequence, &max_sequence);
+    if (!s)
+      return s;
+  }
+
+  // Persist the recovered records, so that the old logs can be removed.
+  if (mem_->begin() != mem_->end()) {
+    s = flushRecoveredMemTable();
+    if (!s)
+      return s;
+  }
+  last_sequence_ = last_allocated_sequence_ = max_sequence;
+  logged_sequence_ = synced_sequence_ = max_sequence;
+
+  {
+    std::lock_guard<std::mutex> guard(mu_);
+    uint64_t number = next_file_number_++;
+    first_recyclable_log_ = number;
+    s = newLogFile(number);
+    if (!s)
+      return s;
+
+    // The old logs are replayed or flushed, the ones failed to be removed
+    // are skipped by the next Open.
+    for (uint64_t old_log : logs) {
+      removeObsoleteLog(old_log);
+    }
+  }
+
+  int flushes = std::max(options_.max_background_flushes, 1);
+  for (int i = 0; i < flushes; i++) {
+    flush_threads_.emplace_back(&DBImpl::backgroundFlush, this);
+  }
+
+  if (options_.wal_sync_interval_ms > 0 || options_.wal_sync_bytes > 0) {
+    sync_thread_ = std::thread(&DBImpl::backgroundSync, this);
+  }
+  return s;
+}
+
+MemTable *DBImpl::newMemTable() const {
+  size_t block_size = options_.arena_block_size;
+  if (block_size == 0) {
+    block_size = options_.write_buffer_size / 8;
+  }
+  return new MemTable(internal_comparator_, options_.memtable_factory,
+                      block_size, options_.memtable_huge_page_size);
+}
+
+Status DBImpl::newLogFile(uint64_t number) {
+  Status s;
+  FileFactory *factory = FileFactory::Default();
+  std::string fname = LogFileName(dbname_, number);
+
+  WritableFile *file;
+  if (!recyclable_logs_.empty()) {
+    uint64_t old_number = recyclable_logs_.front();
+    recyclable_logs_.pop_front();
+    file = factory->ReuseLogFile(fname, LogFileName(dbname_, old_number),
+                                 options_.log_preallocate_size, &s);
+  } else {
+    file = factory->NewLogFile(fname, options_.log_preallocate_size, &s);
+  }
+  if (!s)
+    return s;
+
+  if (logfile_) {
+    logfile_->Close();
+  }
+  logfile_.reset(file);
+  logfile_number_ = number;
+  log_.reset(new log::Writer(logfile_.get(), number,
+                             options_.recycle_log_file_num > 0));
+  return s;
+}
+
+Status DBImpl::removeObsoleteLog(uint64_t number) {
+  // Logs of the previous runs may not be in the recyclable format.
+  if (number >= first_recyclable_log_ &&
+      recyclable_logs_.size() < options_.recycle_log_file_num) {
+    recyclable_logs_.push_back(number);
+    return Status::OK();
+  }
+  return FileFactory::Default()->DeleteFile(LogFileName(dbname_, number));
+}
+
+Status DBImpl::recoverLogFile(uint64_t number,
+                              SequenceNumber flushed_sequence,
+                              SequenceNumber *max_sequence) {
+  struct LogReporter : public log::Reader::Reporter {
+    std::string fname;
+    Status *status;  // nullptr if corruptions are ignored
+
+    void Corruption(size_t bytes, const Status &s) override {
+      if (status != nullptr && status->IsOK()) {
+        *status = Status::Corruption(fname) << ": " << s.ToString();
+      }
+    }
+  };
+
+  Status s;
+  std::string fname = LogFileName(dbname_, number);
+  std::unique_ptr<SequentialFile> file(
+      FileFactory::Default()->NewSequentialFile(fname, &s));
+  if (!s)
+    return s;
+
+  LogReporter reporter;
+  reporter.fname = fname;
+  reporter.status = options_.paranoid_checks ? &s : nullptr;
+
+  // Records are split and checksummed by the reader's worker threads ahead of
+  // us, while they are inserted into the memtable one by one here, in the
+  // order of their sequence numbers.
+  log::Reader reader(file.get(), &reporter, true, options_.recovery_threads,
+                     number);
+  std::string scratch;
+  Slice record;
+  WriteBatch batch;
+
+  while (reader.ReadRecord(&record, &scratch) && s) {
+    Status bs = batch.pImpl_->SetContents(record);
+    if (bs && batch.pImpl_->Sequence() <= flushed_sequence) {
+      continue;
+    }
+    if (bs) {
+      bs = batch.InsertInto(mem_.get());
+    }
+    if (!bs) {
+      reporter.Corruption(record.Len(), bs);
+      continue;
+    }
+
+    SequenceNumber last_seq =
+        batch.pImpl_->Sequence() + batch.pImpl_->Count() - 1;
+    if (last_seq > *max_sequence) {
+      *max_sequence = last_seq;
+    }
+
+    if (mem_->BytesUsed() >= options_.write_buffer_size) {
+      s = flushRecoveredMemTable();
+    }
+  }
+  return s;
+}
+
+Status DBImpl::flushRecoveredMemTable() {
+  FileMetaData meta;
+  // There's no snapshot during recovery.
+  Status s = writeLevel0Table(mem_.get(), next_file_number_++, {}, &meta);
+  if (s)
+    s = installLevel0Table(&meta);
+  if (!s)
+    return s;
+  mem_.reset(newMemTable());
+  return s;
+}
+
+Status DBImpl::writeLevel0Table(MemTable *mem, uint64_t number,
+                                const std::vector<SequenceNumber> &snapshots,
+                                FileMetaData *meta) {
+  Status s;
+  FileFactory *factory = FileFactory::Default();
+  std::string tmp_fname = TempFileName(dbname_, number);
+  std::unique_ptr<WritableFile> file(factory->NewWritableFile(tmp_fname, &s));
+  if (!s)
+    return s;
+
+  SSTableBuilder builder(&table_options_, file.get());
+  meta->number = number;
+
+  // The versions of a user key come from the newest to the oldest. A reader
+  // at sequence number s sees the newest version up to s, so among the
+  // versions between two adjacent snapshots, only the newest one is seen by
+  // anyone. The readers without a snapshot either hold mem themselves, or
+  // read at a sequence number past all of its entries (@see Get), so the
+  // versions newer than all the snapshots need only the newest one.
+  const Comparator *ucmp = internal_comparator_.user_comparator();
+  Slice last_user_key;
+  size_t last_stripe = 0;
+  bool has_last = false;
+
+  // The keys are slices of the memtable's arena, which stay valid.
+  Slice largest;
+  for (auto it = mem->begin(); it != mem->end() && s; ++it) {
+    Slice key = it->first;
+    InternalKey ikey(key);
+    size_t stripe = std::lower_bound(snapshots.begin(), snapshots.end(),
+                                     ikey.sequence) -
+                    snapshots.begin();
+    if (has_last && stripe == last_stripe &&
+        ucmp->Compare(ikey.user_key, last_user_key) == 0) {
+      // hidden by a newer version in the same stripe
+      continue;
+    }
+    has_last = true;
+    last_user_key = ikey.user_key;
+    last_stripe = stripe;
+
+    if (builder.NumEntries() == 0) {
+      meta->smallest = key.ToString();
+    }
+    largest = key;
+    meta->largest_sequence = std::max(meta->largest_sequence, ikey.sequence);
+    s = builder.Add(key, it->second);
+  }
+  meta->largest = largest.ToString();
+
+  if (s)
+    s = builder.Finish();
+  if (s)
+    s = file->Sync();
+  if (s)
+    s = file->Close();
+
+  if (!s) {
+    file.reset();
+    factory->DeleteFile(tmp_fname);
+    return s;
+  }
+  meta->file_size = builder.FileSize();
+  return s;
+}
+
+Status DBImpl::installLevel0Table(FileMetaData *meta) {
+  Status s = FileFactory::Default()->RenameFile(
+      TempFileName(dbname_, meta->number), TableFileName(dbname_, meta->number));
+  if (s) {
+    level0_bytes_ += meta->file_size;
+    level0_.push_back(std::move(*meta));
+  }
+  return s;
+}
+
+Status DBImpl::loadLevel0Table(uint64_t number, FileMetaData *meta) {
+  Status s;
+  FileFactory *factory = FileFactory::Default();
+  std::string fname = TableFileName(dbname_, number);
+
+  uint64_t file_size;
+  s = factory->GetFileSize(fname, &file_size);
+  if (!s)
+    return s;
+
+  std::unique_ptr<RandomAccessFile> file(
+      factory->NewRandomAccessFile(fname, &s));
+  if (!s)
+    return s;
+
+  std::unique_ptr<SSTable> table(
+      SSTable::Open(table_options_, file.get(), file_size, s));
+  if (!s)
+    return s;
+
+  meta->number = number;
+  meta->file_size = file_size;
+  auto it = table->begin();
+  for (; it != table->end(); ++it) {
+    Slice key = it.Key();
+    if (key.Len() < 8) {
+      return Status::Corruption(fname) << ": bad internal key";
+    }
+    if (meta->smallest.empty()) {
+      meta->smallest = key.ToString();
+    }
+    meta->largest.assign(key.RawData(), key.Len());
+    meta->largest_sequence =
+        std::max(meta->largest_sequence, InternalKey(key).sequence);
+  }
+  return it.Stat();
+}
+
+Status DBImpl::Write(const WriteOptions &options, WriteBatch *my_batch) {
+  Status s = options_.enable_pipelined_write ? pipelinedWrite(options, my_batch)
+                                             : groupWrite(options, my_batch);
+  if (s && options.wait_for_sync && !options.sync) {
+    // The sequence numbers of the batch has been assigned by the leader.
+    const WriteBatchImpl *batch = my_batch->pImpl_.get();
+    s = WaitForSync(batch->Sequence() + batch->Count() - 1);
+  }
+  return s;
+}
+
+Status DBImpl::WaitForSync(SequenceNumber sequence) {
+  std::unique_lock<std::mutex> lock(mu_);
+  while (synced_sequence_ < sequence) {
+    if (!sync_status_)
+      return sync_status_;
+
+    if (!sync_thread_.joinable() && sequence <= logged_sequence_) {
+      // There's no background sync, do it ourselves.
+      syncLog(lock);
+      continue;
+    }
+
+    sync_waiters_++;
+    if (options_.wal_sync_interval_ms == 0) {
+      sync_cv_.notify_one();
+    }
+    synced_cv_.wait(lock);
+    sync_waiters_--;
+  }
+  return Status::OK();
+}
+
+Status DBImpl::Get(const ReadOptions &options, const Slice &key,
+                   std::string *value) {
+  std::shared_ptr<MemTable> mem;
+  SequenceNumber sequence;
+  {
+    std::lock_guard<std::mutex> guard(mu_);
+    mem = mem_;
+    sequence = readSequence(options);
+  }
+
+  LookupKey lkey(key, sequence);
+  Status s;
+  if (mem->Get(lkey, value, &s))
+    return s;
+
+  // The older memtables and tables are collected after mem is searched, so
+  // that a memtable hit doesn't pay for it. Anything visible at sequence
+  // that's not in mem has been in imm_ or level-0 since then. Newer
+  // memtables may show up as well, whose entries are all invisible.
+  std::vector<std::shared_ptr<MemTable>> imms;
+  std::vector<std::pair<uint64_t, uint64_t>> tables;
+  {
+    std::lock_guard<std::mutex> guard(mu_);
+    imms.reserve(imm_.size());
+    for (auto it = imm_.rbegin(); it != imm_.rend(); ++it) {
+      imms.push_back(it->mem);
+    }
+
+    // Tables whose key range excludes the key are skipped without being
+    // read.
+    const Comparator *ucmp = internal_comparator_.user_comparator();
+    for (auto it = level0_.rbegin(); it != level0_.rend(); ++it) {
+      if (ucmp->Compare(key, InternalKey(it->smallest).user_key) < 0 ||
+          ucmp->Compare(key, InternalKey(it->largest).user_key) > 0) {
+        continue;
+      }
+      tables.emplace_back(it->number, it->file_size);
+    }
+  }
+
+  for (const auto &imm : imms) {
+    if (imm->Get(lkey, value, &s))
+      return s;
+  }
+  for (const auto &table : tables) {
+    if (getFromTable(table.first, table.second, lkey, value, &s))
+      return s;
+  }
+  return Status::NotFound();
+}
+
+DBIterator *DBImpl::NewIterator(const ReadOptions &options) {
+  std::vector<std::unique_ptr<MergingIterator::Child>> children;
+  std::vector<std::pair<uint64_t, uint64_t>> tables;
+  SequenceNumber sequence;
+  {
+    std::lock_guard<std::mutex> guard(mu_);
+    sequence = readSequence(options);
+    children.emplace_back(NewMemTableChild(mem_));
+    for (auto it = imm_.rbegin(); it != imm_.rend(); ++it) {
+      children.emplace_back(NewMemTableChild(it->mem));
+    }
+    for (auto it = level0_.rbegin(); it != level0_.rend(); ++it) {
+      tables.emplace_back(it->number, it->file_size);
+    }
+  }
+
+  Status s;
+  for (const auto &t : tables) {
+    const SSTable *table;
+    s = table_cache_->FindTable(t.first, t.second, &table);
+    if (!s)
+      break;
+    children.emplace_back(NewTableChild(table));
+  }
+
+  auto iter = new MergingIterator(&internal_comparator_, std::move(children));
+  const PrefixExtractor *prefix_extractor =
+      options.prefix_same_as_start ? options_.prefix_extractor : nullptr;
+  return new DBIterator(internal_comparator_.user_comparator(),
+                        prefix_extractor, sequence, iter, s);
+}
+
+const Snapshot *DBImpl::GetSnapshot() {
+  std::lock_guard<std::mutex> guard(mu_);
+  return new Snapshot(last_sequence_, snapshots_.insert(last_sequence_));
+}
+
+void DBImpl::ReleaseSnapshot(const Snapshot *snapshot) {
+  {
+    std::lock_guard<std::mutex> guard(mu_);
+    snapshots_.erase(snapshot->position_);
+  }
+  delete snapshot;
+}
+
+SequenceNumber DBImpl::readSequence(const ReadOptions &options) const {
+  return options.snapshot ? options.snapshot->Sequence() : last_sequence_;
+}
+
+// Take the record it is positioned at by SSTable::Seek(key) as the result
+// of the lookup, the same way as MemTable::Get does.
+static bool SaveTableRecord(const Comparator *ucmp, const SSTable &table,
+                            const SSTable::ConstIterator &it,
+                            const LookupKey &key, std::string *value,
+                            Status *s) {
+  if (it == table.end())
+    return false;
+
+  InternalKey ikey(it.Key());
+  if (ucmp->Compare(ikey.user_key, key.UserKey()) != 0)
+    return false;
+  if (ikey.type == kTypeDeletion) {
+    *s = Status::NotFound();
+  } else {
+    Slice v = it.Value();
+    value->assign(v.RawData(), v.Len());
+  }
+  return true;
+}
+
+bool DBImpl::getFromTable(uint64_t number, uint64_t file_size,
+                          const LookupKey &key, std::string *value,
+                          Status *s) {
+  const SSTable *table;
+  *s = table_cache_->FindTable(number, file_size, &table);
+  if (!*s)
+    return true;
+  if (!table->KeyMayMatch(key.Key()))
+    return false;
+
+  SSTable::ConstIterator it = table->end();
+  *s = table->Seek(key.Key(), &it);
+  if (!*s)
+    return true;
+  return SaveTableRecord(internal_comparator_.user_comparator(), *table, it,
+                         key, value, s);
+}
+
+void DBImpl::MultiGet(const ReadOptions &options, size_t num_keys,
+                      const Slice *keys, std::string *values,
+                      Status *statuses) {
+  // Unlike Get, everything is collected at once, as the batch pays for the
+  // allocations anyway.
+  std::shared_ptr<MemTable> mem;
+  std::vector<std::shared_ptr<MemTable>> imms;
+  std::vector<FileMetaData> tables;
+  SequenceNumber sequence;
+  {
+    std::lock_guard<std::mutex> guard(mu_);
+    mem = mem_;
+    for (auto it = imm_.rbegin(); it != imm_.rend(); ++it) {
+      imms.push_back(it->mem);
+    }
+    tables.assign(level0_.rbegin(), level0_.rend());
+    sequence = readSequence(options);
+  }
+
+  // The keys are looked up in the order of user keys, so that the keys
+  // falling into a table form a contiguous range, and the lookups into
+  // the table go through its blocks in order.
+  const Comparator *ucmp = internal_comparator_.user_comparator();
+  std::vector<size_t> pending(num_keys);
+  for (size_t i = 0; i < num_keys; i++) {
+    pending[i] = i;
+  }
+  auto by_user_key = [&](size_t a, size_t b) {
+    return ucmp->Compare(keys[a], keys[b]) < 0;
+  };
+  std::sort(pending.begin(), pending.end(), by_user_key);
+
+  std::deque<LookupKey> lkeys;
+  for (size_t i = 0; i < num_keys; i++) {
+    lkeys.emplace_back(keys[i], sequence);
+    statuses[i] = Status::OK();
+  }
+
+  // Memtables first, the keys found are dropped from pending.
+  size_t kept = 0;
+  for (size_t i : pending) {
+    bool found = mem->Get(lkeys[i], &values[i], &statuses[i]);
+    for (auto it = imms.begin(); !found && it != imms.end(); ++it) {
+      found = (*it)->Get(lkeys[i], &values[i], &statuses[i]);
+    }
+    if (!found)
+      pending[kept++] = i;
+  }
+  pending.resize(kept);
+
+  std::vector<Slice> table_keys;
+  std::vector<SSTable::ConstIterator> iters;
+  for (const FileMetaData &meta : tables) {
+    if (pending.empty())
+      break;
+
+    // The keys within the key range of the table.
+    Slice smallest = InternalKey(meta.smallest).user_key;
+    Slice largest = InternalKey(meta.largest).user_key;
+    auto first = std::lower_bound(
+        pending.begin(), pending.end(), smallest,
+        [&](size_t i, const Slice &k) { return ucmp->Compare(keys[i], k) < 0; });
+    auto last = std::upper_bound(
+        first, pending.end(), largest,
+        [&](const Slice &k, size_t i) { return ucmp->Compare(k, keys[i]) < 0; });
+    if (first == last)
+      continue;
+
+    const SSTable *table;
+    Status s = table_cache_->FindTable(meta.number, meta.file_size, &table);
+
+    // Only the keys passing the filter are sought, the others are kept
+    // pending right away.
+    auto probed = last;
+    if (s) {
+      probed = std::stable_partition(first, last, [&](size_t i) {
+        return table->KeyMayMatch(lkeys[i].Key());
+      });
+      table_keys.clear();
+      for (auto it = first; it != probed; ++it) {
+        table_keys.push_back(lkeys[*it].Key());
+      }
+      iters.assign(table_keys.size(), table->end());
+      s = table->MultiSeek(table_keys.size(), table_keys.data(), iters.data());
+    }
+
+    // Failures to read the table fail all the keys in it.
+    auto out = first;
+    size_t n = 0;
+    for (auto it = first; it != probed; ++it, ++n) {
+      size_t i = *it;
+      if (!s) {
+        statuses[i] = s;
+      } else if (!SaveTableRecord(ucmp, *table, iters[n], lkeys[i], &values[i],
+                                  &statuses[i])) {
+        *out++ = i;
+      }
+    }
+    // Keep pending sorted for the next tables.
+    auto mid = out;
+    out = std::copy(probed, last, out);
+    std::inplace_merge(first, mid, out, by_user_key);
+    pending.erase(out, last);
+  }
+
+  for (size_t i : pending) {
+    statuses[i] = Status::NotFound();
+  }
+}
+
+Status DBImpl::groupWrite(const WriteOptions &options, WriteBatch *my_batch) {
+  Writer w(my_batch, options.sync);
+
+  std::unique_lock<std::mutex> lock(mu_);
+  writers_.push_back(&w);
+  if (!awaitLeadership(&w, lock)) {
+    // Our batch has been committed by a leader.
+    return w.status;
+  }
+
+  Status s = makeRoomForWrite(&w, lock);
+  if (!s) {
+    writers_.pop_front();
+    if (!writers_.empty()) {
+      writers_.front()->cv.notify_one();
+    }
+    return s;
+  }
+
+  Writer *last_writer = buildBatchGroup();
+  assignSequence(&w, last_writer);
+
+  {
+    // Writers arriving during the I/O only append themselves to writers_,
+    // and wait until they become the leader or their batches are committed.
+    // So it's safe to release the lock here, since we are the only one
+    // touching log_.
+    lock.unlock();
+    s = writeGroupToLog(&w);
+    lock.lock();
+  }
+  if (s) {
+    groupLogged(&w);
+  } else {
+    logFailed(s);
+  }
+
+  if (s) {
+    s = insertGroup(&w, lock);
+  }
+  if (s) {
+    last_sequence_ = w.last_sequence;
+  }
+
+  // Wake up the followers whose batches have been committed.
+  while (true) {
+    Writer *ready = writers_.front();
+    writers_.pop_front();
+    if (ready != &w) {
+      ready->status = s;
+      ready->done = true;
+      ready->cv.notify_one();
+    }
+    if (ready == last_writer)
+      break;
+  }
+
+  // Notify the new leader.
+  if (!writers_.empty()) {
+    writers_.front()->cv.notify_one();
+  }
+  return s;
+}
+
+Status DBImpl::pipelinedWrite(const WriteOptions &options,
+                              WriteBatch *my_batch) {
+  Writer w(my_batch, options.sync);
+
+  std::unique_lock<std::mutex> lock(mu_);
+  writers_.push_back(&w);
+  if (!awaitLeadership(&w, lock)) {
+    return w.status;
+  }
+
+  /// Log stage
+
+  Status s = makeRoomForWrite(&w, lock);
+  if (!s) {
+    writers_.pop_front();
+    if (!writers_.empty()) {
+      writers_.front()->cv.notify_one();
+    }
+    return s;
+  }
+
+  Writer *last_writer = buildBatchGroup();
+  assignSequence(&w, last_writer);
+
+  {
+    // Only the leader of writers_ touches log_.
+    lock.unlock();
+    s = writeGroupToLog(&w);
+    lock.lock();
+  }
+  if (s) {
+    groupLogged(&w);
+  } else {
+    logFailed(s);
+  }
+
+  // Leave writers_ and let the next group go on writing the log.
+  writers_.erase(writers_.begin(), writers_.begin() + w.group.size());
+  mem_writers_.push_back(&w);
+  if (!writers_.empty()) {
+    writers_.front()->cv.notify_one();
+  }
+
+  /// Memtable stage
+
+  // Groups are inserted into the memtable in the same order as they are
+  // written into the log, so that the sequence numbers are published in
+  // order.
+  while (&w != mem_writers_.front()) {
+    w.cv.wait(lock);
+  }
+
+  if (s) {
+    s = insertGroup(&w, lock);
+  }
+  if (s) {
+    last_sequence_ = w.last_sequence;
+  }
+
+  mem_writers_.pop_front();
+  for (Writer *writer : w.group) {
+    if (writer != &w) {
+      writer->status = s;
+      writer->done = true;
+      writer->cv.notify_one();
+    }
+  }
+
+  if (!mem_writers_.empty()) {
+    mem_writers_.front()->cv.notify_one();
+  } else if (!writers_.empty()) {
+    // The leader of writers_ may be waiting to switch the memtable.
+    writers_.front()->cv.notify_one();
+  }
+  return s;
+}
+
+bool DBImpl::awaitLeadership(Writer *w,
+                             std::unique_lock<std::mutex> &lock) {
+  while (true) {
+    if (w->done) {
+      return false;
+    }
+
+    if (w->leader != nullptr) {
+      // Insert our own batch on behalf of the leader.
+      Writer *leader = w->leader;
+      w->leader = nullptr;
+
+      MemTable *mem = mem_.get();
+      lock.unlock();
+      Status s = w->batch->InsertInto(mem, true);
+      lock.lock();
+
+      if (!s) {
+        leader->insert_status = s;
+      }
+      if (--leader->pending_inserts == 0) {
+        leader->cv.notify_one();
+      }
+      continue;
+    }
+
+    // In pipelined mode, a follower is no longer in writers_ after the log
+    // stage of its group.
+    if (!writers_.empty() && w == writers_.front()) {
+      return true;
+    }
+    w->cv.wait(lock);
+  }
+}
+
+void DBImpl::assignSequence(Writer *leader, Writer *last_writer) {
+  SequenceNumber seq = last_allocated_sequence_ + 1;
+
+  for (Writer *writer : writers_) {
+    leader->group.push_back(writer);
+    writer->batch->pImpl_->SetSequence(seq);
+    seq += writer->batch->pImpl_->Count();
+    if (writer == last_writer)
+      break;
+  }
+
+  leader->last_sequence = last_allocated_sequence_ = seq - 1;
+  num_write_groups_++;
+}
+
+Status DBImpl::insertGroup(Writer *leader,
+                           std::unique_lock<std::mutex> &lock) {
+  // mem_ is not switched until the group is inserted.
+  MemTable *mem = mem_.get();
+  Status s;
+  if (!options_.allow_concurrent_memtable_write || leader->group.size() == 1) {
+    lock.unlock();
+    for (Writer *writer : leader->group) {
+      s = writer->batch->InsertInto(mem);
+      if (!s)
+        break;
+    }
+    lock.lock();
+    return s;
+  }
+
+  leader->pending_inserts = leader->group.size();
+  for (Writer *writer : leader->group) {
+    if (writer != leader) {
+      writer->leader = leader;
+      writer->cv.notify_one();
+    }
+  }
+
+  lock.unlock();
+  s = leader->batch->InsertInto(mem, true);
+  lock.lock();
+
+  if (!s) {
+    leader->insert_status = s;
+  }
+  leader->pending_inserts--;
+  while (leader->pending_inserts > 0) {
+    leader->cv.wait(lock);
+  }
+  return leader->insert_status;
+}
+
+Status DBImpl::makeRoomForWrite(Writer *w,
+                                std::unique_lock<std::mutex> &lock) {
+  size_t max_imm =
+      static_cast<size_t>(std::max(options_.max_write_buffer_number, 2) - 1);
+  bool delayed = false;
+  bool stopped = false;
+
+  // Wait for a flush to complete, in a stop of the writes. Only full
+  // memtables stop the writes, as a flush can make room for them. Nothing
+  // reduces the level-0 tables until they can be compacted, so they only
+  // slow the writes down.
+  auto stop = [&]() {
+    if (!stopped) {
+      stopped = true;
+      stall_stats_.stopped_writes++;
+    }
+    uint64_t start = NowMicros();
+    flush_done_cv_.wait(lock);
+    stall_stats_.stop_micros += NowMicros() - start;
+  };
+
+  while (true) {
+    if (!bg_error_) {
+      return bg_error_;
+    }
+
+    if (!delayed) {
+      // Each write is delayed at most once. The size of this group is not
+      // known until it's built, the last one is a close estimate.
+      delayed = true;
+      write_controller_.SetDelayedWriteRate(delayedWriteRate());
+      uint64_t delay =
+          write_controller_.GetDelay(NowMicros(), last_batch_group_size_);
+      if (delay > 0) {
+        lock.unlock();
+        std::this_thread::sleep_for(std::chrono::microseconds(delay));
+        lock.lock();
+        stall_stats_.delayed_writes++;
+        stall_stats_.delay_micros += delay;
+        continue;
+      }
+    }
+
+    if (mem_->BytesUsed() < options_.write_buffer_size) {
+      // There's room in the current memtable.
+      return Status::OK();
+    } else if (imm_.size() >= max_imm) {
+      // All the memtables are full.
+      stop();
+    } else if (!mem_writers_.empty()) {
+      // In pipelined mode, the previous groups may still be inserting into
+      // mem_. We'll be notified by the last of them.
+      w->cv.wait(lock);
+    } else {
+      return switchMemTable(lock);
+    }
+  }
+}
+
+// How far value has gone from the soft limit towards the hard limit, in
+// [0, 1), or -1 if it's below the soft limit, which is disabled by 0.
+static double StallPressure(uint64_t value, uint64_t soft, uint64_t hard) {
+  if (soft == 0 || value < soft)
+    return -1;
+  if (hard <= soft)
+    return 0;
+  return std::min(static_cast<double>(value - soft) / (hard - soft), 0.99);
+}
+
+uint64_t DBImpl::delayedWriteRate() const {
+  double pressure = StallPressure(
+      level0_.size(), options_.level0_slowdown_writes_trigger,
+      options_.level0_stop_writes_trigger);
+  pressure = std::max(
+      pressure, StallPressure(level0_bytes_,
+                              options_.soft_pending_compaction_bytes_limit,
+                              options_.hard_pending_compaction_bytes_limit));
+
+  // With more than 3 memtables, writes are slowed down when all but one of
+  // them are full, before they are stopped.
+  size_t max_imm =
+      static_cast<size_t>(std::max(options_.max_write_buffer_number, 2) - 1);
+  if (max_imm >= 3) {
+    pressure =
+        std::max(pressure, StallPressure(imm_.size(), max_imm - 1, max_imm));
+  }
+
+  if (pressure < 0) {
+    return 0;
+  }
+  // The rate goes down linearly to a sixteenth as the pressure goes up.
+  uint64_t rate = static_cast<uint64_t>(options_.delayed_write_rate *
+                                        (1 - pressure * 15 / 16));
+  return std::max<uint64_t>(rate, 1);
+}
+
+WriteStallStats DBImpl::GetWriteStallStats() {
+  std::lock_guard<std::mutex> guard(mu_);
+  return stall_stats_;
+}
+
+Status DBImpl::switchMemTable(std::unique_lock<std::mutex> &lock) {
+  // Sync the records left in the current log, or they would be regarded as
+  // synced by the first sync of the new log.
+  Status s = syncLog(lock);
+  if (!s)
+    return s;
+
+  // syncLog has waited out the ongoing sync, and no more sync starts while
+  // we hold mu_, so it's safe to close the current log.
+  uint64_t log_number = logfile_number_;
+  s = newLogFile(next_file_number_++);
+  if (!s)
+    return s;
+
+  mem_->MarkReadOnly();
+  imm_.emplace_back(std::move(mem_), log_number);
+  mem_.reset(newMemTable());
+  flush_cv_.notify_one();
+  return s;
+}
+
+void DBImpl::backgroundFlush() {
+  std::unique_lock<std::mutex> lock(mu_);
+  while (true) {
+    // Pick the oldest memtable that's not being flushed.
+    ImmutableMemTable *job = nullptr;
+    flush_cv_.wait(lock, [this, &job]() {
+      if (shutting_down_)
+        return true;
+      if (!bg_error_)
+        return false;
+      for (ImmutableMemTable &imm : imm_) {
+        if (!imm.flushing) {
+          job = &imm;
+          return true;
+        }
+      }
+      return false;
+    });
+    if (shutting_down_)
+      break;
+
+    // The other flush threads may pick the following memtables meanwhile.
+    // Pushing to the back of imm_ doesn't invalidate job, and job is not
+    // popped until it's flushed.
+    job->flushing = true;
+    uint64_t number = next_file_number_++;
+    // The snapshots taken later see all the entries of job->mem, as the
+    // newest versions do.
+    std::vector<SequenceNumber> snapshots(snapshots_.begin(),
+                                          snapshots_.end());
+    lock.unlock();
+    FileMetaData meta;
+    Status s = writeLevel0Table(job->mem.get(), number, snapshots, &meta);
+    lock.lock();
+
+    if (s) {
+      job->flushed = true;
+      job->meta = std::move(meta);
+      installFlushResults();
+    } else if (bg_error_) {
+      bg_error_ = s;
+    }
+    flush_done_cv_.notify_all();
+  }
+}
+
+void DBImpl::installFlushResults() {
+  while (!imm_.empty() && imm_.front().flushed) {
+    ImmutableMemTable &imm = imm_.front();
+    Status s = installLevel0Table(&imm.meta);
+    if (!s) {
+      if (bg_error_)
+        bg_error_ = s;
+      return;
+    }
+
+    // A log failed to be removed is left to the next Open, which skips its
+    // records.
+    removeObsoleteLog(imm.log_number);
+    imm_.pop_front();
+  }
+}
+
+DBImpl::Writer *DBImpl::buildBatchGroup() {
+  assert(!writers_.empty());
+
+  Writer *first = writers_.front();
+  size_t size = first->batch->pImpl_->ByteSize();
+
+  // Allow the group to grow up to a maximum size, but if the
+  // original write is small, limit the growth so we do not slow
+  // down the small write too much.
+  size_t max_size = 1 << 20;
+  if (size <= (128 << 10)) {
+    max_size = size + (128 << 10);
+  }
+
+  Writer *last_writer = first;
+  size_t group_size = size;
+  auto iter = writers_.begin();
+  ++iter;  // Advance past "first"
+  for (; iter != writers_.end(); ++iter) {
+    Writer *w = *iter;
+    if (w->sync && !first->sync) {
+      // Do not include a sync write into a batch handled by a non-sync write.
+      break;
+    }
+
+    size += w->batch->pImpl_->ByteSize();
+    if (size > max_size) {
+      // Do not make batch too big
+      break;
+    }
+    last_writer = w;
+    group_size = size;
+  }
+  last_batch_group_size_ = group_size;
+  return last_writer;
+}
+
+void DBImpl::groupLogged(Writer *leader) {
+  logged_sequence_ = leader->last_sequence;
+
+  if (leader->sync) {
+    // Everything before the group has been logged, so it's synced as well.
+    synced_sequence_ = std::max(synced_sequence_, logged_sequence_);
+    unsynced_bytes_ = 0;
+  } else {
+    for (Writer *writer : leader->group) {
+      unsynced_bytes_ += writer->batch->pImpl_->ByteSize();
+    }
+    if (options_.wal_sync_bytes > 0 &&
+        unsynced_bytes_ >= options_.wal_sync_bytes) {
+      sync_cv_.notify_one();
+    }
+  }
+
+  if (sync_waiters_ > 0) {
+    synced_cv_.notify_all();
+  }
+}
+
+Status DBImpl::syncLog(std::unique_lock<std::mutex> &lock) {
+  while (syncing_) {
+    synced_cv_.wait(lock);
+  }
+
+  SequenceNumber target = logged_sequence_;
+  if (target <= synced_sequence_ || !sync_status_) {
+    return sync_status_;
+  }
+
+  // Writes going on during the sync are counted for the next one.
+  size_t bytes = unsynced_bytes_;
+  syncing_ = true;
+  lock.unlock();
+  Status s = logfile_->Sync();
+  lock.lock();
+  syncing_ = false;
+
+  if (s) {
+    synced_sequence_ = std::max(synced_sequence_, target);
+    unsynced_bytes_ -= std::min(bytes, unsynced_bytes_);
+  } else {
+    sync_status_ = s;
+  }
+  synced_cv_.notify_all();
+  return s;
+}
+
+void DBImpl::backgroundSync() {
+  std::unique_lock<std::mutex> lock(mu_);
+  auto wakeup = [this]() {
+    if (shutting_down_)
+      return true;
+    if (options_.wal_sync_bytes > 0 &&
+        unsynced_bytes_ >= options_.wal_sync_bytes)
+      return true;
+    // Without the interval, the waiters would be stuck until enough bytes
+    // are written by others.
+    return options_.wal_sync_interval_ms == 0 && sync_waiters_ > 0 &&
+           synced_sequence_ < logged_sequence_;
+  };
+
+  while (true) {
+    if (options_.wal_sync_interval_ms > 0) {
+      sync_cv_.wait_for(
+          lock, std::chrono::milliseconds(options_.wal_sync_interval_ms),
+          wakeup);
+    } else {
+      sync_cv_.wait(lock, wakeup);
+    }
+
+    // The last sync before shutting down leaves nothing unsynced.
+    syncLog(lock);
+    if (shutting_down_)
+      break;
+  }
+}
+
+void DBImpl::logFailed(const Status &s) {
+  // The log may be left with part of the group, which is framed against
+  // block boundaries the later records can't follow, or with records that
+  // would be replayed though the writers are told they failed. So no more
+  // writes go to it.
+  if (bg_error_)
+    bg_error_ = s;
+}
+
+Status DBImpl::writeGroupToLog(Writer *leader) {
+  // Each batch is a log record of its own, carrying its own sequence
+  // number. They are assembled in the buffer of log_ and reach the log file
+  // with a single write.
+  for (Writer *writer : leader->group) {
+    log_->AddRecord(writer->batch->pImpl_->Contents());
+  }
+  return log_->Commit(leader->sync);
+}
 
 }  // namespace lessdb
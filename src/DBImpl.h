@@ -24,21 +24,339 @@
 
 #include <condition_variable>
 #include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
 
+#include "DBFormat.h"
+#include "Disallowcopying.h"
+#include "FileMetaData.h"
+#include "InternalKey.h"
+#include "Options.h"
 #include "Status.h"
+#include "WriteBatch.h"
+#include "WriteController.h"
 
 namespace lessdb {
 
-class WriteOptions;
-class WriteBatch;
+class DBIterator;
+class MemTable;
+class Snapshot;
+class SSTableCache;
+class WritableFile;
+
+namespace log {
+class Writer;
+}  // namespace log
 
 class DBImpl {
+  __DISALLOW_COPYING__(DBImpl);
+
  public:
+  DBImpl(const Options &options, const std::string &dbname);
+
+  ~DBImpl();
+
+  // Create the database directory if missing, load the level-0 tables,
+  // replay the log files left by the last run and flush their records into
+  // level-0 as well, and open a new log file for the incoming writes.
+  Status Open();
+
+  // Concurrent writers are queued up, the writer at the front of the queue
+  // (the leader) writes the batches of the writers behind it into the log
+  // with a single write, and commits them as a group with at most one
+  // Sync().
   Status Write(const WriteOptions &options, WriteBatch *batch);
 
+  // Look up the value of key, searching the memtable, the immutable
+  // memtables and the level-0 tables from the newest to the oldest, and
+  // stopping at the first entry of key. Returns NotFound if there's no such
+  // entry, or it's a deletion.
+  // A hit in the memtable takes no allocation, besides growing *value.
+  Status Get(const ReadOptions &options, const Slice &key, std::string *value);
+
+  // Look up the values of keys[0, num_keys) the same way as Get, storing
+  // the results in values[i] and statuses[i]. The batch reads from the same
+  // point in time. The keys are sorted, so that those falling into the same
+  // table are looked up together, with the keys in the same data block
+  // sharing a single read of the block.
+  void MultiGet(const ReadOptions &options, size_t num_keys, const Slice *keys,
+                std::string *values, Status *statuses);
+
+  // Returns an iterator over the entries visible at this point, merging the
+  // memtables and the level-0 tables.
+  DBIterator *NewIterator(const ReadOptions &options);
+
+  const Snapshot *GetSnapshot();
+  void ReleaseSnapshot(const Snapshot *snapshot);
+
+  // Wait until the log has been synced up to the specified sequence number,
+  // by the background sync (@see Options::wal_sync_interval_ms), or by the
+  // caller itself if there's no background sync.
+  Status WaitForSync(SequenceNumber sequence);
+
+  // The time writes have spent in stalls (@see makeRoomForWrite).
+  WriteStallStats GetWriteStallStats();
+
+ public:
+  // Defined by the tests.
+  uint64_t TEST_NumWriteGroups();
+  size_t TEST_NumImmutableMemTables();
+  size_t TEST_NumLevel0Files();
+  SequenceNumber TEST_LastSequence();
+  SequenceNumber TEST_SyncedSequence();
+  void TEST_WrapLogFile(
+      const std::function<WritableFile *(WritableFile *)> &wrap);
+
+ private:
   // Information kept for every writer.
   struct Writer;
+
+  // A memtable that's full and waiting to be flushed.
+  struct ImmutableMemTable {
+    std::shared_ptr<MemTable> mem;
+
+    // The log holding the records of mem, which is obsolete once mem is
+    // flushed.
+    uint64_t log_number;
+
+    bool flushing;
+    bool flushed;
+    FileMetaData meta;  // the level-0 table, valid once flushed
+
+    ImmutableMemTable(std::shared_ptr<MemTable> m, uint64_t log)
+        : mem(std::move(m)), log_number(log), flushing(false), flushed(false) {}
+  };
+
+  // The sequence number options reads at, either that of its snapshot, or
+  // the last one if there's none.
+  // REQUIRES: mu_ is held.
+  SequenceNumber readSequence(const ReadOptions &options) const;
+
+  // Look up key in the level-0 table of number, the same way as
+  // MemTable::Get does. Failures to read the table are returned in *s, and
+  // stop the lookup as well.
+  bool getFromTable(uint64_t number, uint64_t file_size, const LookupKey &key,
+                    std::string *value, Status *s);
+
+  // Create an empty memtable as configured by options_.
+  MemTable *newMemTable() const;
+
+  // Switch to a new log file with the specified number, which overwrites an
+  // obsolete log if there's any kept for recycling.
+  // REQUIRES: mu_ is held, and the caller is the only one touching log_.
+  Status newLogFile(uint64_t number);
+
+  // The log file of number is no longer needed by recovery, either recycle
+  // or delete it (@see Options::recycle_log_file_num).
+  Status removeObsoleteLog(uint64_t number);
+
+  // Insert the records of the specified log file into mem_, except those up
+  // to flushed_sequence, and raise *max_sequence to the last sequence number
+  // found in the file. mem_ is flushed into level-0 whenever it's full.
+  Status recoverLogFile(uint64_t number, SequenceNumber flushed_sequence,
+                        SequenceNumber *max_sequence);
+
+  // Flush mem_ into level-0 during recovery, and start a new memtable.
+  Status flushRecoveredMemTable();
+
+  // Build the level-0 table of number from the entries of mem, and fill in
+  // *meta. The table is written and synced to its temporary file, which is
+  // not a part of the database until it's installed, so that a crash never
+  // leaves a partial table behind.
+  // The versions of a key hidden by a newer one are dropped, unless they are
+  // seen by one of snapshots, in ascending order.
+  Status writeLevel0Table(MemTable *mem, uint64_t number,
+                          const std::vector<SequenceNumber> &snapshots,
+                          FileMetaData *meta);
+
+  // Rename the table written by writeLevel0Table to its final name, and
+  // append it to level0_.
+  // REQUIRES: mu_ is held, or it's called by Open.
+  Status installLevel0Table(FileMetaData *meta);
+
+  // Fill in *meta by scanning the level-0 table of number.
+  Status loadLevel0Table(uint64_t number, FileMetaData *meta);
+
+  // Make room in mem_ for the writes of the leader w, by switching to a new
+  // memtable if mem_ is full. Waits for the flushes if all the memtables
+  // allowed are full (@see Options::max_write_buffer_number), and delays
+  // the write by the write controller when the level-0 tables or the
+  // memtables are approaching their limits.
+  // REQUIRES: mu_ is held by lock, and w is the leader of writers_.
+  Status makeRoomForWrite(Writer *w, std::unique_lock<std::mutex> &lock);
+
+  // The rate writes are delayed to under the current pressure of level-0
+  // and the immutable memtables, or 0 if they are not delayed.
+  // REQUIRES: mu_ is held.
+  uint64_t delayedWriteRate() const;
+
+  // Turn mem_ into an immutable memtable, and give the writes a new
+  // memtable and a new log file.
+  // REQUIRES: mu_ is held by lock, and the caller is the only one touching
+  // log_ and mem_.
+  Status switchMemTable(std::unique_lock<std::mutex> &lock);
+
+  // The loop of flush_threads_.
+  void backgroundFlush();
+
+  // Install the tables of the flushed memtables at the front of imm_ into
+  // level-0, and remove their logs. Tables are installed in the order of
+  // the memtables, even if they are flushed out of order (@see Open).
+  // REQUIRES: mu_ is held.
+  void installFlushResults();
+
+  // Write with Options::enable_pipelined_write off.
+  Status groupWrite(const WriteOptions &options, WriteBatch *batch);
+
+  // Write with Options::enable_pipelined_write on.
+  // The group leader leaves writers_ right after its log write, so that the
+  // next group can start writing the log, and then waits in mem_writers_
+  // for its turn to insert the group into the memtable.
+  Status pipelinedWrite(const WriteOptions &options, WriteBatch *batch);
+
+  // Wait until w becomes the leader of writers_, or its batch has been
+  // committed by another leader. Returns true iff w is the leader.
+  // While waiting, w may be asked to insert its batch into the memtable.
+  // REQUIRES: mu_ is held by lock.
+  bool awaitLeadership(Writer *w, std::unique_lock<std::mutex> &lock);
+
+  // Pick the writers at the front of writers_ to be committed as a group.
+  // Returns the last writer of the group.
+  // REQUIRES: mu_ is held, and writers_ is not empty.
+  Writer *buildBatchGroup();
+
+  // Allocate sequence numbers for the group [leader, last_writer], and
+  // collect the writers into leader->group. Each batch in the group carries
+  // its own sequence number.
+  // REQUIRES: mu_ is held.
+  void assignSequence(Writer *leader, Writer *last_writer);
+
+  // Write the batches of leader->group into the log as one commit, synced
+  // if the leader asks for it.
+  // REQUIRES: mu_ is not held, and the caller is the only one touching log_.
+  Status writeGroupToLog(Writer *leader);
+
+  // Fail all the later writes with s, the error of writing the log.
+  // REQUIRES: mu_ is held.
+  void logFailed(const Status &s);
+
+  // Account the group that has just been written into the log by leader.
+  // REQUIRES: mu_ is held.
+  void groupLogged(Writer *leader);
+
+  // Sync the log up to logged_sequence_, or wait for the ongoing sync.
+  // REQUIRES: mu_ is held by lock.
+  Status syncLog(std::unique_lock<std::mutex> &lock);
+
+  // The loop of sync_thread_.
+  void backgroundSync();
+
+  // Insert the batches of the group into the memtable, either by the leader
+  // alone, or by every writer of the group in parallel if
+  // Options::allow_concurrent_memtable_write is set.
+  // REQUIRES: mu_ is held by lock.
+  Status insertGroup(Writer *leader, std::unique_lock<std::mutex> &lock);
+
+ private:
+  const Options options_;
+  const std::string dbname_;
+  const InternalKeyComparator internal_comparator_;
+
+  // Guards writers_, mem_writers_ and the sequence numbers.
+  std::mutex mu_;
+
+  // Queue of writers, the front of which is the leader.
   std::deque<Writer *> writers_;
+
+  // Queue of the leaders of the groups that have been written into the log,
+  // but not yet inserted into the memtable. Used only in pipelined mode.
+  std::deque<Writer *> mem_writers_;
+
+  // Options of the tables, which are keyed by internal keys.
+  Options table_options_;
+  std::unique_ptr<SSTableCache> table_cache_;
+
+  // The next number for a log or table file, guarded by mu_.
+  uint64_t next_file_number_;
+
+  // The log and memtable are only modified by the leader, which is the one
+  // and only thread at a time that's doing the write.
+  uint64_t logfile_number_;
+
+  // Obsolete logs kept for recycling, oldest first. Only the logs created
+  // by this instance, numbered from first_recyclable_log_, are recycled, as
+  // they are known to be in the recyclable format.
+  std::deque<uint64_t> recyclable_logs_;
+  uint64_t first_recyclable_log_;
+  std::unique_ptr<WritableFile> logfile_;
+  std::unique_ptr<log::Writer> log_;
+  std::shared_ptr<MemTable> mem_;
+
+  /// Flushing, guarded by mu_.
+
+  // Immutable memtables, oldest first.
+  std::deque<ImmutableMemTable> imm_;
+
+  // Level-0 tables, oldest first.
+  std::vector<FileMetaData> level0_;
+  uint64_t level0_bytes_;
+
+  // Paces the writes under pressure, and the size of the last write group
+  // which the next delay is computed from.
+  WriteController write_controller_;
+  size_t last_batch_group_size_;
+
+  // The number of write groups committed so far.
+  uint64_t num_write_groups_;
+  WriteStallStats stall_stats_;
+
+  // The error of a failed flush or log write, after which all writes fail.
+  Status bg_error_;
+
+  // flush_cv_ wakes flush_threads_ up, while flush_done_cv_ is signaled when
+  // a flush completes.
+  std::condition_variable flush_cv_;
+  std::condition_variable flush_done_cv_;
+  std::vector<std::thread> flush_threads_;
+
+  // The sequence number of the last record that's visible to readers.
+  SequenceNumber last_sequence_;
+
+  // The sequence numbers of the live snapshots.
+  std::multiset<SequenceNumber> snapshots_;
+
+  // The sequence number of the last record that's written into the log. It
+  // may run ahead of last_sequence_ in pipelined mode.
+  SequenceNumber last_allocated_sequence_;
+
+  /// Log syncing, guarded by mu_.
+
+  // The sequence number of the last record whose log write has completed,
+  // and the last one that's been synced.
+  SequenceNumber logged_sequence_;
+  SequenceNumber synced_sequence_;
+
+  // Bytes of the batches logged since the last sync.
+  size_t unsynced_bytes_;
+
+  bool syncing_;
+  int sync_waiters_;
+
+  // The error of the last failed sync, after which synced_sequence_ no
+  // longer advances.
+  Status sync_status_;
+
+  // sync_cv_ wakes sync_thread_ up, while synced_cv_ is signaled when a sync
+  // completes, or more writes are logged.
+  std::condition_variable sync_cv_;
+  std::condition_variable synced_cv_;
+  bool shutting_down_;
+  std::thread sync_thread_;
 };
 
-}  // namespace lessdb
\ No newline at end of file
+}  // namespace lessdb
@@ -0,0 +1,116 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "DBIterator.h"
+#include "Comparator.h"
+#include "InternalKey.h"
+#include "MergingIterator.h"
+#include "PrefixExtractor.h"
+
+namespace lessdb {
+
+DBIterator::DBIterator(const Comparator *user_comparator,
+                       const PrefixExtractor *prefix_extractor,
+                       SequenceNumber sequence, MergingIterator *iter,
+                       const Status &s)
+    : user_comparator_(user_comparator),
+      prefix_extractor_(prefix_extractor),
+      sequence_(sequence),
+      iter_(iter),
+      stat_(s),
+      valid_(false),
+      prefix_bounded_(false) {}
+
+DBIterator::~DBIterator() = default;
+
+void DBIterator::SeekToFirst() {
+  prefix_bounded_ = false;
+  iter_->SeekToFirst();
+  findNextUserEntry(false);
+}
+
+void DBIterator::Seek(const Slice &key) {
+  // The newest entry of key visible at sequence_ sorts first.
+  LookupKey lkey(key, sequence_);
+  prefix_bounded_ = prefix_extractor_ && prefix_extractor_->InDomain(key);
+  if (prefix_bounded_) {
+    Slice prefix = prefix_extractor_->Transform(key);
+    prefix_.assign(prefix.RawData(), prefix.Len());
+    iter_->SeekPrefix(lkey.Key(), prefix_);
+  } else {
+    iter_->Seek(lkey.Key());
+  }
+  findNextUserEntry(false);
+}
+
+void DBIterator::Next() {
+  assert(valid_);
+  iter_->Next();
+  findNextUserEntry(true);
+}
+
+Slice DBIterator::Value() const {
+  assert(valid_);
+  return iter_->Value();
+}
+
+Status DBIterator::Stat() const {
+  if (!stat_)
+    return stat_;
+  return iter_->Stat();
+}
+
+void DBIterator::findNextUserEntry(bool skipping) {
+  // The entries of a user key are ordered from the newest to the oldest.
+  for (; iter_->Valid(); iter_->Next()) {
+    InternalKey ikey(iter_->Key());
+    if (ikey.sequence > sequence_) {
+      // written after the iterator is created
+      continue;
+    }
+    if (skipping &&
+        user_comparator_->Compare(ikey.user_key, saved_key_) <= 0) {
+      // hidden by a newer entry
+      continue;
+    }
+    if (prefix_bounded_ && !inPrefix(ikey.user_key)) {
+      // The keys of the prefix are contiguous.
+      break;
+    }
+
+    saved_key_.assign(ikey.user_key.RawData(), ikey.user_key.Len());
+    if (ikey.type == kTypeDeletion) {
+      skipping = true;
+      continue;
+    }
+    valid_ = true;
+    return;
+  }
+  valid_ = false;
+}
+
+bool DBIterator::inPrefix(const Slice &user_key) const {
+  return prefix_extractor_->InDomain(user_key) &&
+         prefix_extractor_->Transform(user_key).Compare(prefix_) == 0;
+}
+
+}  // namespace lessdb
@@ -0,0 +1,106 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include "DBFormat.h"
+#include "Disallowcopying.h"
+#include "Slice.h"
+#include "Status.h"
+
+namespace lessdb {
+
+class Comparator;
+class MergingIterator;
+class PrefixExtractor;
+
+// DBIterator scans the entries of a DB in the order of keys, as of the time
+// it's created (@see DB::NewIterator). The older versions of each key, and
+// the keys deleted, are skipped.
+class DBIterator {
+  __DISALLOW_COPYING__(DBIterator);
+
+ public:
+  ~DBIterator();
+
+  // An iterator is either positioned at an entry, or not valid.
+  bool Valid() const {
+    return valid_;
+  }
+
+  void SeekToFirst();
+
+  // Position at the first key not less than key. In the prefix mode (@see
+  // ReadOptions::prefix_same_as_start), the iterator becomes invalid past
+  // the last key of the prefix of key.
+  void Seek(const Slice &key);
+
+  // REQUIRES: Valid()
+  void Next();
+
+  // REQUIRES: Valid()
+  Slice Key() const {
+    return saved_key_;
+  }
+
+  // REQUIRES: Valid()
+  Slice Value() const;
+
+  // Errors of reading the tables.
+  Status Stat() const;
+
+ private:
+  friend class DBImpl;
+
+  // Takes the ownership of iter, which merges the internal keys of all the
+  // memtables and tables. The seeks are bounded by the prefixes extracted by
+  // prefix_extractor, if it's not nullptr.
+  DBIterator(const Comparator *user_comparator,
+             const PrefixExtractor *prefix_extractor, SequenceNumber sequence,
+             MergingIterator *iter, const Status &s);
+
+  // Advance iter_ to the newest entry visible at sequence_ of the next user
+  // key, skipping the keys deleted. With skipping set, the entries of
+  // saved_key_ and the keys before it are skipped as well.
+  void findNextUserEntry(bool skipping);
+
+  bool inPrefix(const Slice &user_key) const;
+
+ private:
+  const Comparator *user_comparator_;
+  const PrefixExtractor *prefix_extractor_;
+  const SequenceNumber sequence_;
+  std::unique_ptr<MergingIterator> iter_;
+  Status stat_;
+
+  bool valid_;
+  std::string saved_key_;  // the user key iter_ is positioned at
+
+  // The prefix of the last seek, if the scan is bounded by it.
+  bool prefix_bounded_;
+  std::string prefix_;
+};
+
+}  // namespace lessdb
@@ -0,0 +1,95 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+namespace lessdb {
+
+// Files of a database are all placed under the directory named dbname, and
+// numbered by a monotonically increasing file number.
+//
+// dbname/[0-9]+.log   : write-ahead log
+// dbname/[0-9]+.sst   : table
+// dbname/[0-9]+.dbtmp : table being written, renamed to .sst when it's done
+
+enum FileType { kLogFile, kTableFile, kTempFile };
+
+static inline std::string MakeFileName(const std::string &dbname,
+                                       uint64_t number, const char *suffix) {
+  char buf[100];
+  snprintf(buf, sizeof(buf), "/%06" PRIu64 ".%s", number, suffix);
+  return dbname + buf;
+}
+
+// Return the name of the log file with the specified number.
+inline std::string LogFileName(const std::string &dbname, uint64_t number) {
+  return MakeFileName(dbname, number, "log");
+}
+
+// Return the name of the table file with the specified number.
+inline std::string TableFileName(const std::string &dbname, uint64_t number) {
+  return MakeFileName(dbname, number, "sst");
+}
+
+// Return the name of the temporary file the table of number is written to.
+inline std::string TempFileName(const std::string &dbname, uint64_t number) {
+  return MakeFileName(dbname, number, "dbtmp");
+}
+
+// If fname, relative to the database directory, is the name of a file of
+// the database, store its number in *number, its type in *type and return
+// true.
+inline bool ParseFileName(const std::string &fname, uint64_t *number,
+                          FileType *type) {
+  size_t dot = fname.find('.');
+  if (dot == 0 || dot == std::string::npos) {
+    return false;
+  }
+
+  uint64_t n = 0;
+  for (size_t i = 0; i < dot; i++) {
+    char c = fname[i];
+    if (c < '0' || c > '9')
+      return false;
+    n = n * 10 + (c - '0');
+  }
+
+  const char *suffix = fname.c_str() + dot + 1;
+  if (strcmp(suffix, "log") == 0) {
+    *type = kLogFile;
+  } else if (strcmp(suffix, "sst") == 0) {
+    *type = kTableFile;
+  } else if (strcmp(suffix, "dbtmp") == 0) {
+    *type = kTempFile;
+  } else {
+    return false;
+  }
+  *number = n;
+  return true;
+}
+
+}  // namespace lessdb
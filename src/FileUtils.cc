@@ -20,10 +20,15 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
+#include <atomic>
+#include <mutex>
 #include <string>
 #include <system_error>
 #include <sys/mman.h>
 #include <fcntl.h>  // open
+#include <sys/stat.h>
+#include <unistd.h>
 #include <folly/Likely.h>
 #include <boost/filesystem.hpp>
 
@@ -40,6 +45,10 @@ static inline Status FileError(const std::string &fname, int error_number) {
   return Status::IOError(ErrnoToString(error_number) + ": " + fname);
 }
 
+Status RandomAccessFile::Prefetch(uint64_t offset, size_t n) {
+  return Status::OK();
+}
+
 class PosixRandomAccessFile : public RandomAccessFile {
  public:
   // PosixRandomAccessFile doesn't create the connection to file in its
@@ -60,13 +69,23 @@ class PosixRandomAccessFile : public RandomAccessFile {
   virtual Status Read(size_t n, uint64_t offset, char *dst,
                       Slice *result) override {
     ssize_t r = pread(fd_, dst, n, static_cast<off_t>(offset));
-    *result = Slice(dst, static_cast<size_t>(r < 0 ? 0 : n));
+    *result = Slice(dst, static_cast<size_t>(r < 0 ? 0 : r));
     if (UNLIKELY(r < 0)) {
       return FileError(filename_, errno);
     }
     return Status::OK();
   }
 
+  // The kernel reads the range into the page cache asynchronously.
+  Status Prefetch(uint64_t offset, size_t n) override {
+    int r = posix_fadvise(fd_, static_cast<off_t>(offset),
+                          static_cast<off_t>(n), POSIX_FADV_WILLNEED);
+    if (UNLIKELY(r != 0)) {
+      return FileError(filename_, r);
+    }
+    return Status::OK();
+  }
+
  private:
   int fd_;                // the file descriptor
   std::string filename_;  // name of the file, used for error message(Status).
@@ -125,16 +144,33 @@ class PosixMmapReadableFile : public RandomAccessFile {
         limiter_(limiter) {}
 
   ~PosixMmapReadableFile() {
+    munmap(mmaped_region_, len_);
     limiter_->Release();
   }
 
   Status Read(size_t n, uint64_t offset, char *dst, Slice *result) override {
     // invalid argument
-    assert(offset + n < len_);
+    assert(offset + n <= len_);
 
     char *s = reinterpret_cast<char *>(mmaped_region_);
     memcpy(dst, s + offset, n);
-    (*result) = Slice(dst);
+    (*result) = Slice(dst, n);
+    return Status::OK();
+  }
+
+  Status Prefetch(uint64_t offset, size_t n) override {
+    if (offset >= len_)
+      return Status::OK();
+    n = std::min<size_t>(n, len_ - offset);
+
+    // madvise requires a page aligned address.
+    static const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+    uintptr_t begin = reinterpret_cast<uintptr_t>(mmaped_region_) + offset;
+    uintptr_t aligned = begin & ~(page_size - 1);
+    if (madvise(reinterpret_cast<void *>(aligned), n + (begin - aligned),
+                MADV_WILLNEED) != 0) {
+      return FileError(filename_, errno);
+    }
     return Status::OK();
   }
 
@@ -158,8 +194,10 @@ class PosixSequentialFile : public SequentialFile {
   }
 
   Status Read(size_t n, char *dst, Slice *result) override {
-    size_t r;
-    if ((r = fread(dst, n, 1, file_)) == 0) {
+    // Fewer than n bytes are read at the end of file, which is not an
+    // error.
+    size_t r = fread(dst, 1, n, file_);
+    if (r < n && ferror(file_)) {
       return FileError(filename_, errno);
     }
     (*result) = Slice(dst, r);
@@ -185,7 +223,7 @@ class PosixWritableFile : public WritableFile {
       : filename_(fname), file_(f) {}
 
   virtual ~PosixWritableFile() override {
-    if (!file_) {
+    if (file_) {
       fclose(file_);
       file_ = nullptr;
     }
@@ -231,8 +269,109 @@ class PosixWritableFile : public WritableFile {
   std::string filename_;
 };
 
+// PosixLogFile writes directly to the file descriptor without any user-space
+// buffering, each Append is a single write(2) unless it's interrupted or
+// partially done.
+//
+// The space of the file is allocated ahead in chunks by fallocate(2), so
+// that most of the appends don't allocate blocks of the file system. The
+// file size is kept, otherwise a crash would leave the last records
+// followed by zeros up to the preallocated end, and the reader couldn't tell
+// a record torn by the crash from a corrupted one.
+class PosixLogFile : public WritableFile {
+ public:
+  // See FileFactory::NewLogFile and FileFactory::ReuseLogFile.
+  // The writes begin at offset 0 of the file, whose size is file_size.
+  PosixLogFile(const std::string &fname, int fd, size_t preallocate_size,
+               uint64_t file_size)
+      : filename_(fname),
+        fd_(fd),
+        preallocate_size_(preallocate_size),
+        offset_(0),
+        allocated_(file_size) {}
+
+  ~PosixLogFile() override {
+    if (fd_ >= 0) {
+      close(fd_);
+    }
+  }
+
+  Status Append(const Slice &data) override {
+    preallocate(offset_ + data.Len());
+
+    const char *p = data.RawData();
+    size_t left = data.Len();
+    while (left > 0) {
+      ssize_t r = write(fd_, p, left);
+      if (UNLIKELY(r < 0)) {
+        if (errno == EINTR)
+          continue;
+        return FileError(filename_, errno);
+      }
+      p += r;
+      left -= r;
+    }
+    offset_ += data.Len();
+    return Status::OK();
+  }
+
+  // Nothing is buffered.
+  Status Flush() override {
+    return Status::OK();
+  }
+
+  Status Sync() override {
+    if (fdatasync(fd_) != 0) {
+      return FileError(filename_, errno);
+    }
+    return Status::OK();
+  }
+
+  Status Close() override {
+    if (fd_ >= 0 && close(fd_) != 0) {
+      fd_ = -1;
+      return FileError(filename_, errno);
+    }
+    fd_ = -1;
+    return Status::OK();
+  }
+
+ private:
+  // Make sure the file has been allocated up to end.
+  void preallocate(uint64_t end) {
+    if (preallocate_size_ == 0 || end <= allocated_) {
+      return;
+    }
+
+    uint64_t len = (end - allocated_ + preallocate_size_ - 1) /
+                   preallocate_size_ * preallocate_size_;
+#ifdef __linux__
+    if (fallocate(fd_, FALLOC_FL_KEEP_SIZE, static_cast<off_t>(allocated_),
+                  static_cast<off_t>(len)) == 0) {
+      allocated_ += len;
+      return;
+    }
+#endif
+    // Not supported by the file system, falls back to plain appends.
+    preallocate_size_ = 0;
+  }
+
+ private:
+  std::string filename_;
+  int fd_;
+  size_t preallocate_size_;
+
+  // The offset of the next write.
+  uint64_t offset_;
+
+  // The end of the space allocated, which may run past the file size.
+  uint64_t allocated_;
+};
+
 class PosixFileFactory : public FileFactory {
  public:
+  PosixFileFactory() : pLimiter_(new MmapLimiter()) {}
+
   virtual RandomAccessFile *NewRandomAccessFile(const std::string &fname,
                                                 Status *s) override {
     int fd = open(fname.c_str(), O_RDONLY);
@@ -281,7 +420,7 @@ class PosixFileFactory : public FileFactory {
   }
 
   WritableFile *NewWritableFile(const std::string &fname, Status *s) override {
-    FILE *f = fopen(fname.c_str(), "r");
+    FILE *f = fopen(fname.c_str(), "w");
     if (UNLIKELY(f == nullptr)) {
       *s = FileError(fname, errno);
       return nullptr;
@@ -290,6 +429,91 @@ class PosixFileFactory : public FileFactory {
     return new PosixWritableFile(fname, f);
   }
 
+  WritableFile *NewLogFile(const std::string &fname, size_t preallocate_size,
+                          Status *s) override {
+    int fd =
+        open(fname.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (UNLIKELY(fd < 0)) {
+      *s = FileError(fname, errno);
+      return nullptr;
+    }
+    *s = Status::OK();
+    return new PosixLogFile(fname, fd, preallocate_size, 0);
+  }
+
+  WritableFile *ReuseLogFile(const std::string &fname,
+                             const std::string &old_fname,
+                             size_t preallocate_size, Status *s) override {
+    if (rename(old_fname.c_str(), fname.c_str()) != 0) {
+      *s = FileError(old_fname, errno);
+      return nullptr;
+    }
+
+    int fd = open(fname.c_str(), O_WRONLY | O_CLOEXEC);
+    if (UNLIKELY(fd < 0)) {
+      *s = FileError(fname, errno);
+      return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      *s = FileError(fname, errno);
+      close(fd);
+      return nullptr;
+    }
+    *s = Status::OK();
+    return new PosixLogFile(fname, fd, preallocate_size,
+                            static_cast<uint64_t>(st.st_size));
+  }
+
+  Status DeleteFile(const std::string &fname) override {
+    if (unlink(fname.c_str()) != 0) {
+      return FileError(fname, errno);
+    }
+    return Status::OK();
+  }
+
+  Status RenameFile(const std::string &src,
+                    const std::string &target) override {
+    if (rename(src.c_str(), target.c_str()) != 0) {
+      return FileError(src, errno);
+    }
+    return Status::OK();
+  }
+
+  Status GetFileSize(const std::string &fname, uint64_t *size) override {
+    struct stat st;
+    if (stat(fname.c_str(), &st) != 0) {
+      *size = 0;
+      return FileError(fname, errno);
+    }
+    *size = static_cast<uint64_t>(st.st_size);
+    return Status::OK();
+  }
+
+  Status GetChildren(const std::string &dirname,
+                     std::vector<std::string> *result) override {
+    result->clear();
+    boost::system::error_code ec;
+    boost::filesystem::directory_iterator it(dirname, ec), end;
+    for (; !ec && it != end; it.increment(ec)) {
+      result->push_back(it->path().filename().string());
+    }
+    if (ec) {
+      return Status::IOError(dirname + ": " + ec.message());
+    }
+    return Status::OK();
+  }
+
+  Status CreateDirIfMissing(const std::string &dirname) override {
+    boost::system::error_code ec;
+    boost::filesystem::create_directories(dirname, ec);
+    if (ec) {
+      return Status::IOError(dirname + ": " + ec.message());
+    }
+    return Status::OK();
+  }
+
  private:
   // Used to limit mmap file usage.
   std::unique_ptr<MmapLimiter> pLimiter_;
@@ -22,6 +22,9 @@
 
 #pragma once
 
+#include <string>
+#include <vector>
+
 #include "Disallowcopying.h"
 #include "SliceFwd.h"
 
@@ -51,6 +54,13 @@ class RandomAccessFile {
   //
   // Safe for concurrent use by multiple threads.
   virtual Status Read(size_t n, uint64_t offset, char *dst, Slice *result) = 0;
+
+  // Hints that "n" bytes starting at "offset" are about to be read, so that
+  // the file may start loading them in the background. Returns without
+  // waiting for the data. The default does nothing.
+  //
+  // Safe for concurrent use by multiple threads.
+  virtual Status Prefetch(uint64_t offset, size_t n);
 };
 
 // A file abstraction for reading sequentially through a file.
@@ -137,6 +147,42 @@ class FileFactory {
   virtual WritableFile *NewWritableFile(const std::string &fname,
                                         Status *s) = 0;
 
+  // Like NewWritableFile, but the returned file doesn't buffer the appended
+  // data: each Append reaches the operating system with a single write,
+  // and Flush() is a no-op. It's meant for the writers doing their own
+  // buffering, e.g. log::Writer.
+  //
+  // If preallocate_size is positive, the space of the file is allocated
+  // ahead in chunks of preallocate_size bytes. The file size still only
+  // covers the data appended.
+  virtual WritableFile *NewLogFile(const std::string &fname,
+                                   size_t preallocate_size, Status *s) = 0;
+
+  // Rename the existing file old_fname to fname, and open it like
+  // NewLogFile. The file is not truncated, the appended data overwrites its
+  // contents from the beginning.
+  virtual WritableFile *ReuseLogFile(const std::string &fname,
+                                     const std::string &old_fname,
+                                     size_t preallocate_size, Status *s) = 0;
+
+  // Delete the named file.
+  virtual Status DeleteFile(const std::string &fname) = 0;
+
+  // Rename file src to target, replacing target if it exists.
+  virtual Status RenameFile(const std::string &src,
+                            const std::string &target) = 0;
+
+  // Store the size of the named file in *size.
+  virtual Status GetFileSize(const std::string &fname, uint64_t *size) = 0;
+
+  // Store in *result the names of the children of the specified directory.
+  // The names are relative to "dir".
+  virtual Status GetChildren(const std::string &dirname,
+                             std::vector<std::string> *result) = 0;
+
+  // Create the specified directory if it does not exist yet.
+  virtual Status CreateDirIfMissing(const std::string &dirname) = 0;
+
   static FileFactory *Default();
 };
 
@@ -20,13 +20,18 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
 #include <string>
-#include <boost/functional/hash.hpp>
 #include "FilterStrategy.h"
+#include "Hash.h"
 #include "Slice.h"
 
 namespace lessdb {
 
+// The most probes a bloom filter is built with, the larger numbers stored in
+// a filter are reserved.
+static constexpr size_t kMaxBloomProbes = 30;
+
 class BloomFilterStrategy : public FilterStrategy {
   //
   // m: the total number of bits our bloom filter has.
@@ -39,34 +44,68 @@ class BloomFilterStrategy : public FilterStrategy {
   // See analysis in [Kirsch,Mitzenmacher 2006].
   // The double-hashing functions is of the form gi(x) = h1(x) + i*h2(x).
   //
+  // k depends on the bits per key, so it's stored in the last byte of the
+  // filter, and a filter is probed with the k it's built with.
+  //
 
-  const size_t kMinBloomFilterLength = 64;
+  const size_t kMinBloomFilterLength = 64;  // in bits
 
  public:
   BloomFilterStrategy(size_t bits_per_key) : bits_per_byte_(bits_per_key) {
     k_ = static_cast<size_t>(bits_per_key * 0.69);  // ln2 ~= 0.69
+    k_ = std::min<size_t>(std::max<size_t>(k_, 1), kMaxBloomProbes);
+  }
+
+  // The filters without k stored are not compatible.
+  const char *Name() const override {
+    return "lessdb.BuiltinBloomFilter2";
+  }
+
+  size_t FilterSize(size_t num_keys) const override {
+    size_t bits = std::max(num_keys * bits_per_byte_, kMinBloomFilterLength);
+    return (bits + 7) / 8 + 1;
   }
 
-  inline void Put(const Slice &key, Slice &bits) override {
-    size_t h1 = boost::hash_range(key.RawData(), key.RawData() + key.Len());
-    size_t h2 = (h1 >> 17) | (h1 << 15);  // Rotate right 17 bits
+  inline void Put(const Slice &key, Slice &bits) const override {
+    uint32_t h1 = BloomHash(key);
+    uint32_t h2 = (h1 >> 17) | (h1 << 15);  // Rotate right 17 bits
+    size_t m = (bits.Len() - 1) * 8;
+    bits[bits.Len() - 1] = static_cast<char>(k_);
     for (size_t i = 0; i < k_; ++i) {
-      size_t g = (h1 + i * h2) % bits.Len();
+      size_t g = (h1 + static_cast<uint32_t>(i) * h2) % m;
       bits[g / 8] |= (1 << (g % 8));
     }
   }
 
   inline bool MightContain(const Slice &key, const Slice &bits) const override {
-    size_t h1 = boost::hash_range(key.RawData(), key.RawData() + key.Len());
-    size_t h2 = (h1 >> 17) | (h1 << 15);  // Rotate right 17 bits
-    for (size_t i = 0; i < k_; ++i) {
-      size_t g = (h1 + i * h2) % bits.Len();
+    if (bits.Len() < 2)
+      return true;
+    size_t m = (bits.Len() - 1) * 8;
+
+    // k is 0 if no key has been put. Larger k than we ever build with are
+    // reserved for other encodings, which match any key.
+    size_t k = static_cast<unsigned char>(bits[bits.Len() - 1]);
+    if (k == 0)
+      return false;
+    if (k > kMaxBloomProbes)
+      return true;
+
+    uint32_t h1 = BloomHash(key);
+    uint32_t h2 = (h1 >> 17) | (h1 << 15);  // Rotate right 17 bits
+    for (size_t i = 0; i < k; ++i) {
+      size_t g = (h1 + static_cast<uint32_t>(i) * h2) % m;
       if (!(bits[g / 8] & (1 << (g % 8))))
         return false;
     }
     return true;
   }
 
+ private:
+  // The filters are persisted, so the hash must be the same everywhere.
+  static uint32_t BloomHash(const Slice &key) {
+    return Hash(key.RawData(), key.Len(), 0xbc9f1d34);
+  }
+
  private:
   size_t bits_per_byte_;
   size_t k_;
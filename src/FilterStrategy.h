@@ -23,6 +23,8 @@
 #pragma once
 
 #include "Disallowcopying.h"
+#include <cstddef>
+
 #include "SliceFwd.h"
 
 namespace lessdb {
@@ -33,8 +35,15 @@ class FilterStrategy {
  public:
   virtual ~FilterStrategy() = default;
 
+  // The name of the filter, which is stored along with the filters built by
+  // it, so that a filter is never probed by an incompatible strategy.
+  virtual const char* Name() const = 0;
+
+  // Bytes of the bits array that holds num_keys keys.
+  virtual size_t FilterSize(size_t num_keys) const = 0;
+
   // Put a key into this filter.
-  virtual void Put(const Slice& key, Slice& bits) = 0;
+  virtual void Put(const Slice& key, Slice& bits) const = 0;
 
   // Queries the given bits array if the key is set.
   virtual bool MightContain(const Slice& key, const Slice& bits) const = 0;
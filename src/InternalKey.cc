@@ -20,6 +20,7 @@
  * SOFTWARE.
  */
 
+#include <cstring>
 #include <mutex>
 
 #include "Coding.h"
@@ -31,14 +32,29 @@ namespace lessdb {
 
 /// InternalKeyBuf
 
-static inline uint64_t packSequenceAndType(SequenceNumber sequence,
-                                           ValueType type) {
-  return static_cast<uint64_t>((sequence << 8) | static_cast<uint8_t>(type));
-}
-
 InternalKeyBuf::InternalKeyBuf(Slice key, SequenceNumber seq, ValueType type) {
   bytes_.append(key.RawData(), key.Len());
-  coding::AppendFixed64(&bytes_, packSequenceAndType(seq, type));
+  coding::AppendFixed64(&bytes_, PackSequenceAndType(seq, type));
+}
+
+/// LookupKey
+
+LookupKey::LookupKey(const Slice &user_key, SequenceNumber sequence) {
+  size_t key_size = user_key.Len() + 8;
+  size_t needed = key_size + 5;  // a varint32 takes at most 5 bytes
+  char *dst = (needed <= sizeof(space_)) ? space_ : new char[needed];
+  start_ = dst;
+  dst = coding::EncodeVar32(dst, static_cast<uint32_t>(key_size));
+  kstart_ = dst;
+  memcpy(dst, user_key.RawData(), user_key.Len());
+  dst += user_key.Len();
+  DataView(dst).WriteNum(PackSequenceAndType(sequence, kValueTypeForSeek));
+  end_ = dst + 8;
+}
+
+LookupKey::~LookupKey() {
+  if (start_ != space_)
+    delete[] start_;
 }
 
 /// InternalKeyComparator
@@ -47,8 +63,28 @@ int InternalKeyComparator::Compare(const InternalKey &lhs,
                                    const InternalKey &rhs) const {
   int r = comparator_->Compare(lhs.user_key, rhs.user_key);
   if (r == 0) {
-    uint64_t l_num = packSequenceAndType(lhs.sequence, lhs.type);
-    uint64_t r_num = packSequenceAndType(rhs.sequence, rhs.type);
+    uint64_t l_num = PackSequenceAndType(lhs.sequence, lhs.type);
+    uint64_t r_num = PackSequenceAndType(rhs.sequence, rhs.type);
+    if (l_num < r_num)
+      r = +1;
+    else if (l_num > r_num)
+      r = -1;
+  }
+  return r;
+}
+
+int InternalKeyComparator::Compare(const Slice &lhs, const Slice &rhs) const {
+  // Decode the internal keys in place, without constructing InternalKeys.
+  assert(lhs.Len() >= 8 && rhs.Len() >= 8);
+  Slice l_user_key(lhs.RawData(), lhs.Len() - 8);
+  Slice r_user_key(rhs.RawData(), rhs.Len() - 8);
+
+  int r = comparator_->Compare(l_user_key, r_user_key);
+  if (r == 0) {
+    uint64_t l_num = ConstDataView(l_user_key.RawData() + l_user_key.Len())
+                         .ReadNum<uint64_t>();
+    uint64_t r_num = ConstDataView(r_user_key.RawData() + r_user_key.Len())
+                         .ReadNum<uint64_t>();
     if (l_num < r_num)
       r = +1;
     else if (l_num > r_num)
@@ -57,6 +93,45 @@ int InternalKeyComparator::Compare(const InternalKey &lhs,
   return r;
 }
 
+void InternalKeyComparator::FindShortestSeparator(std::string *start,
+                                                  const Slice &limit) const {
+  Slice user_start(start->data(), start->length() - 8);
+  Slice user_limit(limit.RawData(), limit.Len() - 8);
+  std::string tmp(user_start.RawData(), user_start.Len());
+  comparator_->FindShortestSeparator(&tmp, user_limit);
+
+  if (tmp.length() < user_start.Len() &&
+      comparator_->Compare(user_start, tmp) < 0) {
+    // The user key has become physically shorter but logically larger,
+    // tack on the earliest possible sequence number, which sorts first
+    // among the entries of the new user key.
+    coding::AppendFixed64(
+        &tmp, PackSequenceAndType(kMaxSequenceNumber, kValueTypeForSeek));
+    assert(Compare(*start, tmp) < 0);
+    assert(Compare(tmp, limit) < 0);
+    start->swap(tmp);
+  }
+}
+
+void InternalKeyComparator::FindShortSuccessor(std::string *key) const {
+  Slice user_key(key->data(), key->length() - 8);
+  std::string tmp(user_key.RawData(), user_key.Len());
+  comparator_->FindShortSuccessor(&tmp);
+
+  if (tmp.length() < user_key.Len() &&
+      comparator_->Compare(user_key, tmp) < 0) {
+    coding::AppendFixed64(
+        &tmp, PackSequenceAndType(kMaxSequenceNumber, kValueTypeForSeek));
+    assert(Compare(*key, tmp) < 0);
+    key->swap(tmp);
+  }
+}
+
+Slice InternalKeyComparator::UserKey(const Slice &key) const {
+  assert(key.Len() >= 8);
+  return comparator_->UserKey(Slice(key.RawData(), key.Len() - 8));
+}
+
 /// InternalKey
 
 InternalKey::InternalKey(const Slice &key) {
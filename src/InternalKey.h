@@ -29,6 +29,12 @@
 
 namespace lessdb {
 
+// The sequence number and value type are packed into the trailing 8 bytes of
+// an internal key.
+inline uint64_t PackSequenceAndType(SequenceNumber sequence, ValueType type) {
+  return static_cast<uint64_t>((sequence << 8) | static_cast<uint8_t>(type));
+}
+
 class InternalKeyBuf {
  public:
   InternalKeyBuf(Slice user_key, SequenceNumber sequence, ValueType type);
@@ -56,7 +62,45 @@ struct InternalKey {
   ValueType type;
 };
 
-class InternalKeyComparator {
+// The key of a point lookup, which encodes the user key as an internal key
+// at the specified sequence number, so that the lookup stops at the newest
+// entry visible at the sequence number.
+// Short keys are encoded on the stack, so that a lookup doesn't allocate.
+class LookupKey {
+  __DISALLOW_COPYING__(LookupKey);
+
+ public:
+  LookupKey(const Slice &user_key, SequenceNumber sequence);
+
+  ~LookupKey();
+
+  // The key in the format of the memtable entries, i.e a varstring of the
+  // internal key (@see MemTable::encodeEntry).
+  const char *MemTableKey() const {
+    return start_;
+  }
+
+  Slice Key() const {
+    return Slice(kstart_, end_ - kstart_);
+  }
+
+  Slice UserKey() const {
+    return Slice(kstart_, end_ - kstart_ - 8);
+  }
+
+ private:
+  // start_  := varint32 of the length of the internal key
+  // kstart_ := InternalKeyBuf
+  const char *start_;
+  const char *kstart_;
+  const char *end_;
+  char space_[200];
+};
+
+// InternalKeyComparator is also a Comparator itself, so that the tables
+// keyed by internal keys are built and searched in the same way as the
+// others (@see SSTableBuilder).
+class InternalKeyComparator final : public Comparator {
  public:
   //
   // InternalKeyComparator uses user_comparator to compares the
@@ -69,12 +113,28 @@ class InternalKeyComparator {
 
   int Compare(const InternalKey &lhs, const InternalKey &rhs) const;
 
-  int Compare(const Slice &lhs, const Slice &rhs) const {
-    return Compare(InternalKey(lhs), InternalKey(rhs));
+  const char *Name() const override {
+    return "lessdb.InternalKeyComparator";
+  }
+
+  // Compares two encoded internal keys.
+  int Compare(const Slice &lhs, const Slice &rhs) const override;
+
+  // The user key part is shortened by the user comparator.
+  void FindShortestSeparator(std::string *start,
+                             const Slice &limit) const override;
+
+  void FindShortSuccessor(std::string *key) const override;
+
+  // Strips the 8-byte trailer of sequence number and value type.
+  Slice UserKey(const Slice &key) const override;
+
+  const Comparator *user_comparator() const {
+    return comparator_;
   }
 
  private:
   const Comparator *comparator_;
 };
 
-}  // namespace lessdb
\ No newline at end of file
+}  // namespace lessdb
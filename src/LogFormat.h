@@ -23,6 +23,8 @@
 
 #pragma once
 
+#include <cstdint>
+
 namespace lessdb {
 namespace log {
 
@@ -31,31 +33,55 @@ namespace log {
 // Each block consists of a sequence of records:
 // block := record* trailer?
 // record :=
-//    checksum: uint32	    // crc32c of type and data[] ; little-endian
-//    length:   uint16		// little-endian
+//    checksum: uint32	    // crc32 of type, log number and data[]
+//    length:   uint16
 //    type:     uint8		// One of FULL, FIRST, MIDDLE, LAST
+//    number:   uint32       // Recyclable records only, the log number
 //    data:     uint8[length]
+//
+// A log file may be recycled, i.e. overwritten by a later log instead of
+// being deleted, in which case the records are written in the recyclable
+// format. The records left by the previous use of the file carry a
+// different log number, which tells the reader where the new log ends.
 
 static constexpr int kBlockSize = 32768;
 
 // Header is checksum (4 bytes), length (2 bytes), type (1 byte).
 static constexpr int kHeaderSize = 4 + 2 + 1;
 
+// Recyclable header has the lower 32 bits of the log number (4 bytes) in
+// addition.
+static constexpr int kRecyclableHeaderSize = kHeaderSize + 4;
+
 // FIRST, MIDDLE, LAST are types used for user records that have been split into
 // multiple fragments (typically because of block boundaries).
 enum class RecordType : uint8_t {
 
+  // Zero is reserved for the areas of a file that have never been written,
+  // e.g. the zeros a file system may leave past the last write after a
+  // crash. The types used to be numbered from zero, so log files written
+  // before the recyclable format was added can't be read.
+  kZeroType = 0,
+
   // The FULL record contains the contents of an entire user record.
-  kFull,
+  kFull = 1,
 
   // FIRST is the type of the first fragment of a user record
-  kFirst,
+  kFirst = 2,
 
   // MID is the type of all interior fragments of a user record.
-  kMiddle,
+  kMiddle = 3,
 
   // LAST is the type of the last fragment of a user record
-  kLast
+  kLast = 4,
+
+  // The recyclable counterparts of the above.
+  kRecyclableFull = 5,
+  kRecyclableFirst = 6,
+  kRecyclableMiddle = 7,
+  kRecyclableLast = 8,
+
+  kMaxRecordType = kRecyclableLast
 };
 
 }  // namespace log
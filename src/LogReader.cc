@@ -0,0 +1,371 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <boost/crc.hpp>
+#include <cstring>
+
+#include "DataView.h"
+#include "FileUtils.h"
+#include "LogReader.h"
+
+namespace lessdb {
+namespace log {
+
+// Chunks are read and parsed as a whole. Chunk size must be a multiple of
+// kBlockSize, so that every chunk begins at a block boundary.
+static constexpr size_t kChunkSize = 32 * kBlockSize;
+
+// Whether a corrupted fragment, whose payload is [begin, end), may have been
+// torn by a crash: the payload ends with zeros, and so does the rest of the
+// block up to block_end.
+static bool EndsWithZeros(const char *begin, const char *end,
+                          const char *block_end) {
+  end = std::min(end, block_end);
+  if (begin == end || end[-1] != '\0')
+    return false;
+  return std::all_of(end, block_end, [](char c) { return c == '\0'; });
+}
+
+Reader::Reader(SequentialFile *file, Reporter *reporter, bool checksum,
+               int worker_threads, uint64_t log_number)
+    : file_(file),
+      reporter_(reporter),
+      checksum_(checksum),
+      log_number_(log_number),
+      eof_(false),
+      end_(false),
+      recycled_(false),
+      shutdown_(false) {
+  for (int i = 0; i < worker_threads; i++) {
+    workers_.emplace_back(&Reader::workerLoop, this);
+  }
+}
+
+Reader::~Reader() {
+  {
+    std::lock_guard<std::mutex> guard(mu_);
+    shutdown_ = true;
+  }
+  work_cv_.notify_all();
+  for (std::thread &worker : workers_) {
+    worker.join();
+  }
+}
+
+bool Reader::ReadRecord(Slice *record, std::string *scratch) {
+  scratch->clear();
+  bool in_fragmented_record = false;
+
+  // The fragment following a corrupted one, looked ahead to see whether the
+  // log ends there.
+  const Fragment *next = nullptr;
+
+  while (true) {
+    const Fragment *fragment = next;
+    if (fragment == nullptr && !end_) {
+      fragment = nextFragment();
+    }
+    next = nullptr;
+    if (fragment != nullptr && fragment->end) {
+      end_ = true;
+      fragment = nullptr;
+    }
+    if (fragment == nullptr) {
+      // The writer may have died in the middle of a record, which is
+      // silently dropped.
+      scratch->clear();
+      return false;
+    }
+
+    if (fragment->dropped > 0 && recycled_) {
+      // The tail of a recycled log is followed by the leftover of the
+      // previous log, where the first header is at an arbitrary offset. We
+      // can't tell it from corruption, so the log ends here, without
+      // replaying anything beyond a hole.
+      end_ = true;
+      scratch->clear();
+      return false;
+    }
+
+    if (fragment->dropped > 0 && fragment->zero_tail) {
+      // The unwritten part of a record torn by a crash may read as zeros,
+      // which fails the checks. The log ends here if nothing but zeros
+      // follows, otherwise it's a corruption.
+      size_t dropped = fragment->dropped;
+      const char *reason = fragment->reason;
+      next = nextFragment();
+      if (next == nullptr) {
+        end_ = true;
+        scratch->clear();
+        return false;
+      }
+      reportDrop(dropped, reason);
+      if (in_fragmented_record) {
+        reportDrop(scratch->size(), "error in middle of record");
+        in_fragmented_record = false;
+        scratch->clear();
+      }
+      continue;
+    }
+
+    if (fragment->dropped > 0) {
+      reportDrop(fragment->dropped, fragment->reason);
+      if (in_fragmented_record) {
+        reportDrop(scratch->size(), "error in middle of record");
+        in_fragmented_record = false;
+        scratch->clear();
+      }
+      continue;
+    }
+
+    if (fragment->type >= RecordType::kRecyclableFull) {
+      recycled_ = true;
+    }
+
+    const Slice &data = fragment->data;
+    switch (fragment->type) {
+      case RecordType::kFull:
+      case RecordType::kRecyclableFull:
+        if (in_fragmented_record) {
+          reportDrop(scratch->size(), "partial record without end(1)");
+        }
+        scratch->clear();
+        *record = data;
+        return true;
+
+      case RecordType::kFirst:
+      case RecordType::kRecyclableFirst:
+        if (in_fragmented_record) {
+          reportDrop(scratch->size(), "partial record without end(2)");
+        }
+        scratch->assign(data.RawData(), data.Len());
+        in_fragmented_record = true;
+        break;
+
+      case RecordType::kMiddle:
+      case RecordType::kRecyclableMiddle:
+        if (!in_fragmented_record) {
+          reportDrop(data.Len(), "missing start of fragmented record(1)");
+        } else {
+          scratch->append(data.RawData(), data.Len());
+        }
+        break;
+
+      case RecordType::kLast:
+      case RecordType::kRecyclableLast:
+        if (!in_fragmented_record) {
+          reportDrop(data.Len(), "missing start of fragmented record(2)");
+        } else {
+          scratch->append(data.RawData(), data.Len());
+          *record = Slice(*scratch);
+          return true;
+        }
+        break;
+
+      default:
+        // Never returned by nextFragment.
+        assert(false);
+    }
+  }
+}
+
+const Reader::Fragment *Reader::nextFragment() {
+  while (true) {
+    readAhead();
+    if (chunks_.empty()) {
+      return nullptr;
+    }
+
+    Chunk *chunk = chunks_.front().get();
+    if (workers_.empty()) {
+      if (!chunk->parsed) {
+        parseChunk(chunk);
+        chunk->parsed = true;
+      }
+    } else {
+      std::unique_lock<std::mutex> lock(mu_);
+      parsed_cv_.wait(lock, [chunk]() { return chunk->parsed; });
+    }
+
+    if (chunk->next < chunk->fragments.size()) {
+      return &chunk->fragments[chunk->next++];
+    }
+
+    // All the fragments of chunk have been consumed, it's safe to release it
+    // now, as the fragment returned last time is no longer valid.
+    chunks_.pop_front();
+  }
+}
+
+void Reader::readAhead() {
+  // Keep every worker busy with a chunk, plus one being consumed.
+  size_t window = workers_.size() + 1;
+
+  while (!eof_ && chunks_.size() < window) {
+    std::unique_ptr<Chunk> chunk(new Chunk);
+    chunk->data.resize(kChunkSize);
+
+    Slice result;
+    Status s = file_->Read(kChunkSize, &chunk->data[0], &result);
+    if (!s) {
+      if (reporter_ != nullptr) {
+        reporter_->Corruption(kChunkSize, s);
+      }
+      result = Slice();
+    }
+    if (result.RawData() != chunk->data.data()) {
+      memmove(&chunk->data[0], result.RawData(), result.Len());
+    }
+    chunk->data.resize(result.Len());
+
+    if (result.Len() < kChunkSize) {
+      chunk->last = true;
+      eof_ = true;
+    }
+
+    if (!workers_.empty()) {
+      std::lock_guard<std::mutex> guard(mu_);
+      pending_.push_back(chunk.get());
+      work_cv_.notify_one();
+    }
+    chunks_.push_back(std::move(chunk));
+  }
+}
+
+void Reader::parseChunk(Chunk *chunk) const {
+  const char *p = chunk->data.data();
+  size_t left = chunk->data.size();
+  while (left > 0) {
+    size_t n = std::min<size_t>(left, kBlockSize);
+    parseBlock(p, n, chunk->last && n == left, &chunk->fragments);
+    p += n;
+    left -= n;
+  }
+}
+
+void Reader::parseBlock(const char *block, size_t n, bool last,
+                        std::vector<Fragment> *fragments) const {
+  size_t pos = 0;
+
+  // A tail shorter than kHeaderSize is the trailer.
+  while (n - pos >= static_cast<size_t>(kHeaderSize)) {
+    const char *header = block + pos;
+    uint32_t crc = ConstDataView(header).ReadNum<uint32_t>();
+    uint16_t length = ConstDataView(header + 4).ReadNum<uint16_t>();
+    uint8_t type = ConstDataView(header + 6).ReadNum<uint8_t>();
+
+    Fragment fragment;
+    fragment.type = static_cast<RecordType>(type);
+    fragment.end = false;
+    fragment.dropped = 0;
+    fragment.reason = nullptr;
+    fragment.zero_tail = false;
+
+    if (fragment.type == RecordType::kZeroType && length == 0) {
+      // The rest of the block is either a trailer, or preallocated but not
+      // yet written.
+      return;
+    }
+
+    if (type > static_cast<uint8_t>(RecordType::kMaxRecordType)) {
+      // The length may be corrupted as well.
+      fragment.dropped = n - pos;
+      fragment.reason = "unknown record type";
+      fragments->push_back(fragment);
+      return;
+    }
+
+    bool recyclable = type >= static_cast<uint8_t>(RecordType::kRecyclableFull);
+    size_t header_size = recyclable ? kRecyclableHeaderSize : kHeaderSize;
+    if (header_size + length > n - pos) {
+      if (!last) {
+        // The length is corrupted, the rest of the block can't be trusted.
+        fragment.dropped = n - pos;
+        fragment.reason = "bad record length";
+        fragment.zero_tail = EndsWithZeros(
+            header + header_size, header + header_size + length, block + n);
+        fragments->push_back(fragment);
+      }
+      // Otherwise the writer died in the middle of writing the record,
+      // which is not an error.
+      return;
+    }
+
+    const char *data = header + header_size;
+    if (checksum_) {
+      boost::crc_32_type actual;
+      actual.process_bytes(header + 6, header_size - 6);
+      actual.process_bytes(data, length);
+      if (static_cast<uint32_t>(actual.checksum()) != crc) {
+        // Drop the rest of the block, since the length itself may have been
+        // corrupted, and we can't tell where the next record begins.
+        fragment.dropped = n - pos;
+        fragment.reason = "checksum mismatch";
+        fragment.zero_tail = EndsWithZeros(data, data + length, block + n);
+        fragments->push_back(fragment);
+        return;
+      }
+    }
+
+    if (recyclable && ConstDataView(header + kHeaderSize).ReadNum<uint32_t>() !=
+                          static_cast<uint32_t>(log_number_)) {
+      // Left by the previous use of the file.
+      fragment.end = true;
+      fragments->push_back(fragment);
+      return;
+    }
+
+    fragment.data = Slice(data, length);
+    fragments->push_back(fragment);
+    pos += header_size + length;
+  }
+}
+
+void Reader::workerLoop() {
+  std::unique_lock<std::mutex> lock(mu_);
+  while (true) {
+    work_cv_.wait(lock, [this]() { return shutdown_ || !pending_.empty(); });
+    if (shutdown_) {
+      return;
+    }
+
+    Chunk *chunk = pending_.front();
+    pending_.pop_front();
+
+    lock.unlock();
+    parseChunk(chunk);
+    lock.lock();
+
+    chunk->parsed = true;
+    parsed_cv_.notify_all();
+  }
+}
+
+void Reader::reportDrop(size_t bytes, const char *reason) {
+  if (reporter_ != nullptr && bytes > 0) {
+    reporter_->Corruption(bytes, Status::Corruption(reason));
+  }
+}
+
+}  // namespace log
+}  // namespace lessdb
@@ -0,0 +1,169 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Disallowcopying.h"
+#include "LogFormat.h"
+#include "Slice.h"
+#include "Status.h"
+
+namespace lessdb {
+
+class SequentialFile;
+
+namespace log {
+
+class Reader {
+  __DISALLOW_COPYING__(Reader);
+
+ public:
+  // Interface for reporting errors.
+  class Reporter {
+   public:
+    virtual ~Reporter() = default;
+
+    // Some corruption was detected. "bytes" is the approximate number
+    // of bytes dropped due to the corruption.
+    virtual void Corruption(size_t bytes, const Status &status) = 0;
+  };
+
+  // Create a reader that will return log records from "*file".
+  // "*file" must remain live while this Reader is in use.
+  //
+  // If "reporter" is non-null, it is notified whenever some data is
+  // dropped due to a detected corruption. "*reporter" must remain
+  // live while this Reader is in use.
+  //
+  // If "checksum" is true, verify checksums if available.
+  //
+  // If "worker_threads" is positive, the file is read ahead in chunks, which
+  // are split into fragments and checksummed by the worker threads, while
+  // the records are still returned by ReadRecord in the order of the log.
+  //
+  // "log_number" is the number the log is written with. Reading stops at the
+  // first recyclable record of another number, which is left by a previous
+  // use of the file.
+  Reader(SequentialFile *file, Reporter *reporter, bool checksum,
+         int worker_threads = 0, uint64_t log_number = 0);
+
+  ~Reader();
+
+  // Read the next record into *record. Returns true if read
+  // successfully, false if we hit end of the input. May use
+  // "*scratch" as temporary storage. The contents filled in *record
+  // will only be valid until the next mutating operation on this
+  // reader or the next mutation to *scratch.
+  bool ReadRecord(Slice *record, std::string *scratch);
+
+ private:
+  // The physical record parsed from a chunk.
+  struct Fragment {
+    // One of kFull, kFirst, kMiddle and kLast, recyclable or not.
+    RecordType type;
+    Slice data;
+
+    // True if the log ends here, though the file doesn't.
+    bool end;
+
+    // Non-zero if the fragment is corrupted, in which case the bytes are
+    // dropped and reported with reason.
+    size_t dropped;
+    const char *reason;
+
+    // True if the corrupted fragment ends with zeros up to the end of its
+    // block, as a record torn by a crash does.
+    bool zero_tail;
+  };
+
+  // A run of consecutive blocks of the log file.
+  struct Chunk {
+    std::string data;
+    std::vector<Fragment> fragments;
+
+    // True if the file ends within this chunk.
+    bool last = false;
+
+    // Set once fragments are ready.
+    bool parsed = false;
+
+    // Index of the next fragment to be returned.
+    size_t next = 0;
+  };
+
+  // Returns the next fragment in the order of the log, or nullptr at the end
+  // of file. The fragment is valid until the next call.
+  const Fragment *nextFragment();
+
+  // Read chunks ahead from the file until the window is full.
+  void readAhead();
+
+  // Split chunk->data into fragments, checking the checksums if required.
+  void parseChunk(Chunk *chunk) const;
+
+  void parseBlock(const char *block, size_t n, bool last,
+                  std::vector<Fragment> *fragments) const;
+
+  void workerLoop();
+
+  void reportDrop(size_t bytes, const char *reason);
+
+ private:
+  SequentialFile *const file_;
+  Reporter *const reporter_;
+  const bool checksum_;
+  const uint64_t log_number_;
+
+  // True if there's nothing more to read from the file.
+  bool eof_;
+
+  // True if the end of the log has been reached.
+  bool end_;
+
+  // True if the log is written in the recyclable format.
+  bool recycled_;
+
+  // Chunks that have been read from the file, in the order of the log.
+  // Only touched by the caller of ReadRecord.
+  std::deque<std::unique_ptr<Chunk>> chunks_;
+
+  // Guards pending_, the parsed flags of chunks and shutdown_.
+  std::mutex mu_;
+  std::condition_variable work_cv_;
+  std::condition_variable parsed_cv_;
+
+  // Chunks waiting to be parsed by workers_.
+  std::deque<Chunk *> pending_;
+  bool shutdown_;
+  std::vector<std::thread> workers_;
+};
+
+}  // namespace log
+}  // namespace lessdb
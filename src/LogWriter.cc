@@ -23,15 +23,19 @@
 #include <boost/crc.hpp>
 
 #include "LogWriter.h"
-#include "Files.h"
+#include "FileUtils.h"
 #include "DataView.h"
+#include "Status.h"
 
 namespace lessdb {
 namespace log {
 
-// WriteRecord splits a user record into multiple fragments.
-Status Writer::WriteRecord(const Slice &record) {
-  Status s;
+// Commits larger than this don't keep their buffer, so that a single huge
+// record doesn't pin the memory for the lifetime of the log.
+static constexpr size_t kMaxRetainedBuffer = 1 << 20;
+
+// AddRecord splits a user record into multiple fragments.
+void Writer::AddRecord(const Slice &record) {
   size_t left = record.Len();
   const char *p = record.RawData();
   bool begin = true;
@@ -41,16 +45,14 @@ Status Writer::WriteRecord(const Slice &record) {
     assert(block_offset_ <= kBlockSize);
 
     size_t avail = kBlockSize - block_offset_;
-    if (avail < kHeaderSize) {
+    if (avail < header_size_) {
       // trailer, consists entirely zero bytes.
-      s = file_->Append(Slice("\0\0\0\0\0\0", avail));
-      if (!s)
-        return s;
+      buf_.append(avail, '\0');
       block_offset_ = 0;
     }
 
-    assert(kBlockSize - block_offset_ >= kHeaderSize);
-    avail = kBlockSize - block_offset_ - kHeaderSize;
+    assert(kBlockSize - block_offset_ >= header_size_);
+    avail = kBlockSize - block_offset_ - header_size_;
 
     RecordType type;
 
@@ -65,48 +67,61 @@ Status Writer::WriteRecord(const Slice &record) {
     }
 
     size_t fragment_length = (left < avail) ? left : avail;
-    s = writeFragment(p, fragment_length, type);
-    if (!s)
-      return s;
+    appendFragment(p, fragment_length, type);
 
     left -= fragment_length;
     p += fragment_length;
-    block_offset_ += fragment_length;
+    block_offset_ += header_size_ + fragment_length;
 
     begin = false;
   } while (left > 0);
+}
 
-  assert(s);
+Status Writer::Commit(bool sync) {
+  Status s;
+  if (!buf_.empty()) {
+    s = file_->Append(buf_);
+    if (s)
+      s = file_->Flush();
+  }
+  if (s && sync)
+    s = file_->Sync();
+
+  if (buf_.capacity() > kMaxRetainedBuffer) {
+    std::string().swap(buf_);
+  } else {
+    buf_.clear();
+  }
   return s;
 }
 
-//
-// record :=
-//    checksum: uint32	    // crc32c of type and data[] ; little-endian
-//    length:   uint16		// little-endian
-//    type:     uint8		// One of FULL, FIRST, MIDDLE, LAST
-//    data:     uint8[length]
-//
-Status Writer::writeFragment(const char *fragment, size_t l, RecordType type) {
-  Status s;
-  char buf[7];
-  boost::crc_32_type crc;
+Status Writer::WriteRecord(const Slice &record, bool sync) {
+  AddRecord(record);
+  return Commit(sync);
+}
 
-  crc.process_bytes(fragment, l);
-  DataView(buf).WriteNum(static_cast<uint32_t>(crc.checksum()));
+// @see LogFormat.h for the format of a record.
+void Writer::appendFragment(const char *fragment, size_t l, RecordType type) {
+  char buf[kRecyclableHeaderSize];
+
+  uint8_t t = static_cast<uint8_t>(type);
+  if (recyclable_) {
+    t += static_cast<uint8_t>(RecordType::kRecyclableFull) -
+         static_cast<uint8_t>(RecordType::kFull);
+    DataView(buf + kHeaderSize)
+        .WriteNum(static_cast<uint32_t>(log_number_));
+  }
   DataView(buf + 4).WriteNum(static_cast<uint16_t>(l));
-  DataView(buf + 6).WriteNum(static_cast<uint8_t>(type));
+  DataView(buf + 6).WriteNum(t);
 
-  s = file_->Append(Slice(buf, kHeaderSize));
-  if (!s)
-    return s;
-
-  s = file_->Append(Slice(fragment, l));
-  if (!s)
-    return s;
+  // The checksum covers the type, the log number and the data.
+  boost::crc_32_type crc;
+  crc.process_bytes(buf + 6, header_size_ - 6);
+  crc.process_bytes(fragment, l);
+  DataView(buf).WriteNum(static_cast<uint32_t>(crc.checksum()));
 
-  s = file_->Flush();
-  return s;
+  buf_.append(buf, header_size_);
+  buf_.append(fragment, l);
 }
 
 }  // namespace log
@@ -22,8 +22,12 @@
 
 #pragma once
 
+#include <cstdint>
+#include <string>
+
 #include "Disallowcopying.h"
 #include "LogFormat.h"
+#include "SliceFwd.h"
 
 namespace lessdb {
 
@@ -36,17 +40,45 @@ class Writer {
   __DISALLOW_COPYING__(Writer);
 
  public:
-  Writer(WritableFile *file) : file_(file), block_offset_(0) {}
+  explicit Writer(WritableFile *file) : Writer(file, 0, false) {}
+
+  // If recyclable is true, the records are written in the recyclable format
+  // with log_number, so that file may be a recycled log file.
+  Writer(WritableFile *file, uint64_t log_number, bool recyclable)
+      : file_(file),
+        block_offset_(0),
+        log_number_(log_number),
+        recyclable_(recyclable),
+        header_size_(recyclable ? kRecyclableHeaderSize : kHeaderSize) {}
+
+  // Append record to the pending commit. Nothing reaches the file until
+  // Commit().
+  void AddRecord(const Slice &record);
 
-  Status WriteRecord(const Slice &record);
+  // Write all the records added since the last commit to the file with a
+  // single Append, and make them durable with Sync() if sync is true.
+  // On failure, the file may hold any part of the records, and nothing may
+  // be written to the log any more.
+  Status Commit(bool sync);
+
+  // Write record as a commit of its own.
+  Status WriteRecord(const Slice &record, bool sync = false);
 
  private:
-  // Write a single fragment to the WritableFile.
-  Status writeFragment(const char *fragment, size_t n, RecordType type);
+  // Append a single fragment to buf_.
+  void appendFragment(const char *fragment, size_t n, RecordType type);
 
  private:
   WritableFile *file_;
   size_t block_offset_;
+
+  const uint64_t log_number_;
+  const bool recyclable_;
+  const size_t header_size_;
+
+  // The encoded records of the pending commit. It's reused across commits
+  // to avoid allocations.
+  std::string buf_;
 };
 
 }  // namespace log
@@ -23,46 +23,106 @@
 #include "MemTable.h"
 #include "Coding.h"
 #include "Comparator.h"
+#include "DataView.h"
 #include "InternalKey.h"
 
 namespace lessdb {
 
-// TODO: do optimization.
-void MemTable::Add(SequenceNumber sequence, ValueType type, const Slice &key,
-                   const Slice &value) {
+const char *MemTable::encodeEntry(SequenceNumber sequence, ValueType type,
+                                  const Slice &key, const Slice &value) {
   // Format of an entry in MemTable
   // entry := key value
   // key   := varstring of InternalKeyBuf
   // value := varstring of value
+  //
+  // The entry is encoded in place, within a single allocation from arena_.
+
+  size_t key_size = key.Len();
+  size_t val_size = value.Len();
+  size_t internal_key_size = key_size + 8;
+  size_t encoded_len = coding::VarintLength(internal_key_size) +
+                       internal_key_size + coding::VarintLength(val_size) +
+                       val_size;
 
-  std::string buf;
-  coding::AppendVarString(&buf, InternalKeyBuf(key, sequence, type).Data());
-  coding::AppendVarString(&buf, value);
+  char *entry = static_cast<char *>(arena_.allocate(encoded_len));
+  char *p =
+      coding::EncodeVar32(entry, static_cast<uint32_t>(internal_key_size));
+  memcpy(p, key.RawData(), key_size);
+  p += key_size;
+  DataView(p).WriteNum(PackSequenceAndType(sequence, type));
+  p += 8;
+  p = coding::EncodeVar32(p, static_cast<uint32_t>(val_size));
+  memcpy(p, value.RawData(), val_size);
+  assert(p + val_size == entry + encoded_len);
+  return entry;
+}
+
+void MemTable::Add(SequenceNumber sequence, ValueType type, const Slice &key,
+                   const Slice &value, bool concurrently) {
+  const char *entry = encodeEntry(sequence, type, key, value);
+  if (concurrently) {
+    rep_->InsertConcurrently(entry);
+  } else {
+    rep_->Insert(entry);
+  }
+}
 
-  char *entry = (char *)arena_.allocate(buf.length());
-  memcpy(entry, buf.data(), buf.length());
-  table_.Insert(entry);
+void MemTable::Add(SequenceNumber sequence, ValueType type, const Slice &key,
+                   const Slice &value, InsertHint *hint) {
+  rep_->InsertWithHint(encodeEntry(sequence, type, key, value), hint);
 }
 
 static inline Slice GetVarString(const char *s) {
-  Slice tmp(s, 5);
   uint32_t len;
-  coding::GetVar32(&tmp, &len);
-  return Slice(tmp.RawData(), len);
+  const char *p = coding::DecodeVar32(s, &len);
+  return Slice(p, len);
 }
 
-MemTable::MemTable(const InternalKeyComparator &comparator)
+bool MemTable::Get(const LookupKey &key, std::string *value,
+                   Status *s) const {
+  // The first entry not less than key is the newest visible one of the user
+  // key, if its user key matches.
+  const char *entry = rep_->LowerBound(key.MemTableKey());
+  if (entry == nullptr)
+    return false;
+
+  Slice internal_key = GetVarString(entry);
+  Slice user_key(internal_key.RawData(), internal_key.Len() - 8);
+  if (UserComparator()->Compare(user_key, key.UserKey()) != 0)
+    return false;
+
+  uint64_t tag =
+      ConstDataView(user_key.RawData() + user_key.Len()).ReadNum<uint64_t>();
+  switch (static_cast<ValueType>(tag & 0xff)) {
+    case kTypeValue: {
+      Slice v = GetVarString(internal_key.RawData() + internal_key.Len());
+      value->assign(v.RawData(), v.Len());
+      return true;
+    }
+    case kTypeDeletion:
+      *s = Status::NotFound();
+      return true;
+  }
+  return false;
+}
+
+MemTable::MemTable(const InternalKeyComparator &comparator,
+                   const MemTableRepFactory *factory, size_t arena_block_size,
+                   size_t huge_page_size)
     : comparator_(comparator),
-      table_(&arena_, [this](const char *a_buf, const char *b_buf) -> int {
-        // InternalKeys are encoded as varstrings.
-        Slice a = GetVarString(a_buf);
-        Slice b = GetVarString(b_buf);
-        return this->comparator_.Compare(a, b);
-      }) {}
+      key_comparator_(comparator),
+      arena_(arena_block_size, huge_page_size) {
+  if (factory == nullptr)
+    factory = NewSkipListRepFactory();
+  rep_.reset(factory->CreateMemTableRep(key_comparator_, &arena_));
+}
+
+MemTable::~MemTable() = default;
 
 void MemTable::ConstIterator::update() const {
-  if (iter_.Valid()) {
-    e_.first = GetVarString(*iter_);
+  const char *buf = entry();
+  if (buf != nullptr) {
+    e_.first = GetVarString(buf);
 
     const char *value_buf = e_.first.RawData() + e_.first.Len();
     e_.second = GetVarString(value_buf);
@@ -72,7 +132,19 @@ void MemTable::ConstIterator::update() const {
 MemTable::ConstIterator MemTable::find(const Slice &key) {
   std::string s;
   coding::AppendVarString(&s, key);
-  return MemTable::ConstIterator(table_.Find(s.data()));
+  ConstIterator iter(rep_->NewLookupIterator(s.data()));
+  const char *entry = iter.entry();
+  if (entry == nullptr || key_comparator_(entry, s.data()) != 0)
+    return end();
+  return iter;
+}
+
+MemTable::ConstIterator MemTable::lower_bound(const Slice &key) const {
+  std::string s;
+  coding::AppendVarString(&s, key);
+  ConstIterator iter(rep_->NewIterator());
+  iter.iter_->Seek(s.data());
+  return iter;
 }
 
 }  // namespace lessdb
\ No newline at end of file
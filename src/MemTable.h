@@ -22,27 +22,35 @@
 
 #pragma once
 
-#include <mutex>
+#include <memory>
 
+#include "Coding.h"
+#include "Comparator.h"
+#include "ConcurrentArena.h"
 #include "DBFormat.h"
+#include "DataView.h"
 #include "Disallowcopying.h"
 #include "InternalKey.h"
-#include "SkipList.h"
+#include "IteratorFacade.h"
+#include "MemTableRep.h"
 #include "Slice.h"
+#include "Status.h"
 
 namespace lessdb {
 
-class InternalKeyComparator;
-
 class MemTable {
   __DISALLOW_COPYING__(MemTable);
 
- private:
-  typedef std::function<int(const char *, const char *)> Compare;
-  typedef SkipList<const char *, Compare> Table;
-
  public:
-  explicit MemTable(const InternalKeyComparator &comparator);
+  // The entries are indexed by the rep created by factory, or by a SkipList
+  // if factory is nullptr. The memory is allocated from a ConcurrentArena
+  // of arena_block_size and huge_page_size.
+  explicit MemTable(const InternalKeyComparator &comparator,
+                    const MemTableRepFactory *factory = nullptr,
+                    size_t arena_block_size = Arena::kDefaultBlockSize,
+                    size_t huge_page_size = 0);
+
+  ~MemTable();
 
   // Add an entry into memtable that maps key to value at the
   // specified sequence number and with the specified type.
@@ -50,11 +58,43 @@ class MemTable {
   //
   // @see DBFormat.h for the definition of ValueType.
   //
+  // If concurrently is true, Add is safe to be called by multiple writers
+  // at the same time, all of which must pass concurrently=true.
+  //
   void Add(SequenceNumber sequence, ValueType type, const Slice &key,
-           const Slice &value);
+           const Slice &value, bool concurrently = false);
+
+  // Remembers the position of the last Add with it, must be initialized to
+  // nullptr. It's opaque to the caller and released along with the memtable.
+  // @see MemTableRep::InsertWithHint
+  typedef void *InsertHint;
+
+  // Like Add, but locates the position of the entry with hint. With the
+  // default SkipList rep, it's O(1) if the entry goes right after the
+  // previous one added with the same hint. Not safe with concurrent writers.
+  void Add(SequenceNumber sequence, ValueType type, const Slice &key,
+           const Slice &value, InsertHint *hint);
+
+  // Look up the newest entry of key.UserKey() that's visible at the sequence
+  // number of key. Returns true if there's one, in which case the value is
+  // stored in *value, or *s is set NotFound if the entry is a deletion.
+  // Returns false if the memtable has no such entry.
+  // No allocation is made, except for growing *value.
+  bool Get(const LookupKey &key, std::string *value, Status *s) const;
+
+  // The comparator of user keys.
+  const Comparator *UserComparator() const {
+    return comparator_.user_comparator();
+  }
 
   size_t BytesUsed() const {
-    return arena_.bytesUsed();
+    return arena_.bytesUsed() + rep_->ApproximateMemoryUsage();
+  }
+
+  // No more entries will be added after MarkReadOnly, which allows the rep
+  // to reorganize itself for reads, e.g. sorting.
+  void MarkReadOnly() {
+    rep_->MarkReadOnly();
   }
 
  public:
@@ -68,15 +108,24 @@ class MemTable {
 
   ConstIterator find(const Slice &key);
 
+  // Returns an iterator at the first entry whose internal key is not less
+  // than key.
+  ConstIterator lower_bound(const Slice &key) const;
+
   ConstIterator begin() const;
 
   ConstIterator end() const;
 
  private:
-  SysArena arena_;
-  Table table_;
-  std::mutex mtx_;
+  // Encode an entry into a single allocation from arena_.
+  const char *encodeEntry(SequenceNumber sequence, ValueType type,
+                          const Slice &key, const Slice &value);
+
+ private:
   InternalKeyComparator comparator_;
+  MemTableKeyComparator key_comparator_;
+  ConcurrentArena arena_;
+  std::unique_ptr<MemTableRep> rep_;
 };
 
 class MemTable::ConstIterator
@@ -87,8 +136,25 @@ class MemTable::ConstIterator
 
  private:
   // Constructor of ConstIterator must be hidden from user.
-  explicit ConstIterator(Table::ConstIterator iter) : iter_(iter) {
-    update();
+  // Takes the ownership of iter, nullptr means the end of memtable.
+  explicit ConstIterator(MemTableRep::Iterator *iter) : iter_(iter) {}
+
+ public:
+  ConstIterator(const ConstIterator &other)
+      : iter_(other.iter_ ? other.iter_->Clone() : nullptr) {}
+
+  ConstIterator &operator=(const ConstIterator &other) {
+    if (this != &other)
+      iter_.reset(other.iter_ ? other.iter_->Clone() : nullptr);
+    return *this;
+  }
+
+  ConstIterator(ConstIterator &&) = default;
+  ConstIterator &operator=(ConstIterator &&) = default;
+
+ private:
+  const char *entry() const {
+    return iter_ ? iter_->Entry() : nullptr;
   }
 
   // Updates the value of e_ each time iter_ changes.
@@ -104,24 +170,24 @@ class MemTable::ConstIterator
   }
 
   void increment() {
-    iter_++;
+    iter_->Next();
   }
 
   bool equal(const ConstIterator &other) const {
-    return iter_ == other.iter_;
+    return entry() == other.entry();
   }
 
  private:
-  Table::ConstIterator iter_;
+  std::unique_ptr<MemTableRep::Iterator> iter_;
   mutable Entry e_;
 };
 
 inline MemTable::ConstIterator MemTable::begin() const {
-  return MemTable::ConstIterator(table_.Begin());
+  return MemTable::ConstIterator(rep_->NewIterator());
 }
 
 inline MemTable::ConstIterator MemTable::end() const {
-  return MemTable::ConstIterator(table_.End());
+  return MemTable::ConstIterator(nullptr);
 }
 
 }  // namespace lessdb
\ No newline at end of file
@@ -0,0 +1,448 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+#include <boost/functional/hash.hpp>
+
+#include "ConcurrentArena.h"
+#include "MemTableRep.h"
+#include "SkipList.h"
+
+namespace lessdb {
+
+namespace {
+
+typedef SkipList<const char *, MemTableKeyComparator, ConcurrentArena>
+    EntryList;
+
+// Iterates over an EntryList.
+class EntryListIterator : public MemTableRep::Iterator {
+ public:
+  explicit EntryListIterator(const EntryList *list)
+      : list_(list), iter_(list->Begin()) {}
+
+  EntryListIterator(const EntryList *list, EntryList::ConstIterator iter)
+      : list_(list), iter_(iter) {}
+
+  const char *Entry() const override {
+    return iter_.Valid() ? *iter_ : nullptr;
+  }
+
+  void Next() override {
+    assert(iter_.Valid());
+    iter_++;
+  }
+
+  void Seek(const char *target) override {
+    iter_ = list_->LowerBound(target);
+  }
+
+  void SeekToFirst() override {
+    iter_ = list_->Begin();
+  }
+
+  MemTableRep::Iterator *Clone() const override {
+    return new EntryListIterator(list_, iter_);
+  }
+
+ private:
+  const EntryList *list_;
+  EntryList::ConstIterator iter_;
+};
+
+// Iterates over a sorted vector of entries, which is shared by all the
+// clones.
+class SortedVectorIterator : public MemTableRep::Iterator {
+ public:
+  typedef std::vector<const char *> Entries;
+
+  SortedVectorIterator(std::shared_ptr<const Entries> entries,
+                       const MemTableKeyComparator &cmp, size_t pos = 0)
+      : entries_(std::move(entries)), cmp_(cmp), pos_(pos) {}
+
+  const char *Entry() const override {
+    return pos_ < entries_->size() ? (*entries_)[pos_] : nullptr;
+  }
+
+  void Next() override {
+    assert(pos_ < entries_->size());
+    pos_++;
+  }
+
+  void Seek(const char *target) override {
+    pos_ = LowerBoundOf(*entries_, target, cmp_) - entries_->begin();
+  }
+
+  static Entries::const_iterator LowerBoundOf(
+      const Entries &entries, const char *target,
+      const MemTableKeyComparator &cmp) {
+    return std::lower_bound(
+        entries.begin(), entries.end(), target,
+        [&cmp](const char *a, const char *b) { return cmp(a, b) < 0; });
+  }
+
+  void SeekToFirst() override {
+    pos_ = 0;
+  }
+
+  MemTableRep::Iterator *Clone() const override {
+    return new SortedVectorIterator(entries_, cmp_, pos_);
+  }
+
+ private:
+  std::shared_ptr<const Entries> entries_;
+  const MemTableKeyComparator &cmp_;
+  size_t pos_;
+};
+
+void SortEntries(std::vector<const char *> *entries,
+                 const MemTableKeyComparator &cmp) {
+  std::sort(entries->begin(), entries->end(),
+            [&cmp](const char *a, const char *b) { return cmp(a, b) < 0; });
+}
+
+/// SkipListRep
+
+class SkipListRep : public MemTableRep {
+ public:
+  SkipListRep(const MemTableKeyComparator &cmp, ConcurrentArena *arena)
+      : list_(arena, cmp) {}
+
+  void Insert(const char *entry) override {
+    list_.Insert(entry);
+  }
+
+  void InsertConcurrently(const char *entry) override {
+    list_.InsertConcurrently(entry);
+  }
+
+  void InsertWithHint(const char *entry, void **hint) override {
+    // Writers with hints are serialized, so they take turns with the hint of
+    // the rep rather than allocating one per batch.
+    if (*hint == nullptr) {
+      hint_ = EntryList::InsertHint();
+      *hint = &hint_;
+    }
+    list_.Insert(entry, static_cast<EntryList::InsertHint *>(*hint));
+  }
+
+  const char *Find(const char *key) const override {
+    auto it = list_.Find(key);
+    return it.Valid() ? *it : nullptr;
+  }
+
+  Iterator *NewIterator() const override {
+    return new EntryListIterator(&list_);
+  }
+
+  Iterator *NewLookupIterator(const char *key) const override {
+    return new EntryListIterator(&list_, list_.LowerBound(key));
+  }
+
+  const char *LowerBound(const char *key) const override {
+    auto it = list_.LowerBound(key);
+    return it.Valid() ? *it : nullptr;
+  }
+
+ private:
+  EntryList list_;
+
+  // @see InsertWithHint
+  EntryList::InsertHint hint_;
+};
+
+class SkipListRepFactory : public MemTableRepFactory {
+ public:
+  MemTableRep *CreateMemTableRep(const MemTableKeyComparator &cmp,
+                                 ConcurrentArena *arena) const override {
+    return new SkipListRep(cmp, arena);
+  }
+
+  const char *Name() const override {
+    return "lessdb.SkipListRepFactory";
+  }
+};
+
+/// HashPrefixRep
+
+class HashPrefixRep : public MemTableRep {
+ public:
+  HashPrefixRep(const MemTableKeyComparator &cmp, ConcurrentArena *arena,
+                size_t prefix_length, size_t bucket_count)
+      : cmp_(cmp),
+        arena_(arena),
+        prefix_length_(prefix_length),
+        bucket_count_(bucket_count),
+        buckets_(new std::atomic<EntryList *>[bucket_count]),
+        num_lists_(0) {
+    assert(bucket_count_ > 0);
+    for (size_t i = 0; i < bucket_count_; i++)
+      buckets_[i].store(nullptr, std::memory_order_relaxed);
+  }
+
+  ~HashPrefixRep() override {
+    for (size_t i = 0; i < bucket_count_; i++)
+      delete buckets_[i].load(std::memory_order_relaxed);
+  }
+
+  void Insert(const char *entry) override {
+    std::atomic<EntryList *> &bucket = bucketOf(entry);
+    EntryList *list = bucket.load(std::memory_order_relaxed);
+    if (list == nullptr) {
+      list = new EntryList(arena_, cmp_);
+      bucket.store(list, std::memory_order_release);
+      num_lists_.fetch_add(1, std::memory_order_relaxed);
+    }
+    list->Insert(entry);
+  }
+
+  void InsertConcurrently(const char *entry) override {
+    std::atomic<EntryList *> &bucket = bucketOf(entry);
+    EntryList *list = bucket.load(std::memory_order_acquire);
+    if (list == nullptr) {
+      // Only one of the racing writers gets its list installed.
+      EntryList *created = new EntryList(arena_, cmp_);
+      if (bucket.compare_exchange_strong(list, created,
+                                         std::memory_order_acq_rel)) {
+        list = created;
+        num_lists_.fetch_add(1, std::memory_order_relaxed);
+      } else {
+        delete created;
+      }
+    }
+    list->InsertConcurrently(entry);
+  }
+
+  const char *Find(const char *key) const override {
+    const EntryList *list = bucketOf(key).load(std::memory_order_acquire);
+    if (list == nullptr)
+      return nullptr;
+    auto it = list->Find(key);
+    return it.Valid() ? *it : nullptr;
+  }
+
+  // Merges all the buckets into a sorted vector.
+  Iterator *NewIterator() const override {
+    auto entries = std::make_shared<std::vector<const char *>>();
+    for (size_t i = 0; i < bucket_count_; i++) {
+      const EntryList *list = buckets_[i].load(std::memory_order_acquire);
+      if (list == nullptr)
+        continue;
+      for (auto it = list->Begin(); it != list->End(); it++)
+        entries->push_back(*it);
+    }
+    SortEntries(entries.get(), cmp_);
+    return new SortedVectorIterator(std::move(entries), cmp_);
+  }
+
+  // Only iterates over the bucket of key, which has all the entries of the
+  // same user key.
+  Iterator *NewLookupIterator(const char *key) const override {
+    const EntryList *list = bucketOf(key).load(std::memory_order_acquire);
+    if (list == nullptr)
+      list = &empty_;
+    return new EntryListIterator(list, list->LowerBound(key));
+  }
+
+  const char *LowerBound(const char *key) const override {
+    const EntryList *list = bucketOf(key).load(std::memory_order_acquire);
+    if (list == nullptr)
+      return nullptr;
+    auto it = list->LowerBound(key);
+    return it.Valid() ? *it : nullptr;
+  }
+
+  // The lists of the non-empty buckets, the nodes of which are allocated
+  // from the arena.
+  size_t ApproximateMemoryUsage() const override {
+    return num_lists_.load(std::memory_order_relaxed) * sizeof(EntryList);
+  }
+
+ private:
+  std::atomic<EntryList *> &bucketOf(const char *entry) const {
+    uint32_t len;
+    const char *p = coding::DecodeVar32(entry, &len);
+    assert(len >= 8);
+    size_t n = std::min<size_t>(len - 8, prefix_length_);
+    return buckets_[boost::hash_range(p, p + n) % bucket_count_];
+  }
+
+ private:
+  const MemTableKeyComparator cmp_;
+  ConcurrentArena *arena_;
+  const size_t prefix_length_;
+  const size_t bucket_count_;
+  std::unique_ptr<std::atomic<EntryList *>[]> buckets_;
+  std::atomic<size_t> num_lists_;
+
+  // Lookups into an empty bucket iterate over it.
+  EntryList empty_{arena_, cmp_};
+};
+
+class HashPrefixRepFactory : public MemTableRepFactory {
+ public:
+  HashPrefixRepFactory(size_t prefix_length, size_t bucket_count)
+      : prefix_length_(prefix_length), bucket_count_(bucket_count) {}
+
+  MemTableRep *CreateMemTableRep(const MemTableKeyComparator &cmp,
+                                 ConcurrentArena *arena) const override {
+    return new HashPrefixRep(cmp, arena, prefix_length_, bucket_count_);
+  }
+
+  const char *Name() const override {
+    return "lessdb.HashPrefixRepFactory";
+  }
+
+ private:
+  const size_t prefix_length_;
+  const size_t bucket_count_;
+};
+
+/// VectorRep
+
+class VectorRep : public MemTableRep {
+ public:
+  typedef std::vector<const char *> Entries;
+
+  explicit VectorRep(const MemTableKeyComparator &cmp)
+      : cmp_(cmp), entries_(std::make_shared<Entries>()), sorted_(false) {}
+
+  void Insert(const char *entry) override {
+    std::lock_guard<std::mutex> guard(mu_);
+    assert(!sorted_);
+    entries_->push_back(entry);
+  }
+
+  void InsertConcurrently(const char *entry) override {
+    Insert(entry);
+  }
+
+  const char *Find(const char *key) const override {
+    const char *entry = LowerBound(key);
+    return (entry != nullptr && cmp_(entry, key) == 0) ? entry : nullptr;
+  }
+
+  Iterator *NewIterator() const override {
+    return new SortedVectorIterator(sortedEntries(), cmp_);
+  }
+
+  const char *LowerBound(const char *key) const override {
+    std::shared_ptr<const Entries> entries = sortedEntries();
+    auto it = SortedVectorIterator::LowerBoundOf(*entries, key, cmp_);
+    return it != entries->end() ? *it : nullptr;
+  }
+
+  void MarkReadOnly() override {
+    std::lock_guard<std::mutex> guard(mu_);
+    if (!sorted_) {
+      SortEntries(entries_.get(), cmp_);
+      sorted_ = true;
+      snapshot_.reset();
+    }
+  }
+
+  size_t ApproximateMemoryUsage() const override {
+    std::lock_guard<std::mutex> guard(mu_);
+    size_t usage = entries_->capacity() * sizeof(const char *);
+    if (snapshot_)
+      usage += snapshot_->capacity() * sizeof(const char *);
+    return usage;
+  }
+
+ private:
+  // Returns the entries in sorted order, which are shared by the readers
+  // until more entries are inserted. The entries are only appended to
+  // entries_, so the new ones since the last snapshot are sorted alone and
+  // merged into it.
+  std::shared_ptr<const Entries> sortedEntries() const {
+    std::lock_guard<std::mutex> guard(mu_);
+    if (sorted_)
+      return entries_;
+    if (snapshot_ && snapshot_->size() == entries_->size())
+      return snapshot_;
+
+    size_t covered = snapshot_ ? snapshot_->size() : 0;
+
+    Entries added(entries_->begin() + covered, entries_->end());
+    SortEntries(&added, cmp_);
+    auto merged = std::make_shared<Entries>();
+    merged->reserve(entries_->size());
+    auto less = [this](const char *a, const char *b) {
+      return cmp_(a, b) < 0;
+    };
+    if (snapshot_) {
+      std::merge(snapshot_->begin(), snapshot_->end(), added.begin(),
+                 added.end(), std::back_inserter(*merged), less);
+    } else {
+      *merged = std::move(added);
+    }
+    snapshot_ = merged;
+    return snapshot_;
+  }
+
+ private:
+  const MemTableKeyComparator cmp_;
+  mutable std::mutex mu_;
+  std::shared_ptr<Entries> entries_;
+  bool sorted_;
+
+  // The sorted snapshot of a prefix of entries_, before the rep is marked
+  // read-only.
+  mutable std::shared_ptr<const Entries> snapshot_;
+};
+
+class VectorRepFactory : public MemTableRepFactory {
+ public:
+  MemTableRep *CreateMemTableRep(const MemTableKeyComparator &cmp,
+                                 ConcurrentArena *) const override {
+    return new VectorRep(cmp);
+  }
+
+  const char *Name() const override {
+    return "lessdb.VectorRepFactory";
+  }
+};
+
+}  // anonymous namespace
+
+const MemTableRepFactory *NewSkipListRepFactory() {
+  static SkipListRepFactory factory;
+  return &factory;
+}
+
+const MemTableRepFactory *NewHashPrefixRepFactory(size_t prefix_length,
+                                                  size_t bucket_count) {
+  return new HashPrefixRepFactory(prefix_length, bucket_count);
+}
+
+const MemTableRepFactory *NewVectorRepFactory() {
+  return new VectorRepFactory();
+}
+
+}  // namespace lessdb
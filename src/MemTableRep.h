@@ -0,0 +1,240 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+#include <memory>
+
+#include "Coding.h"
+#include "Comparator.h"
+#include "DataView.h"
+#include "Disallowcopying.h"
+#include "InternalKey.h"
+
+namespace lessdb {
+
+class ConcurrentArena;
+
+// MemTableKeyComparator compares two memtable entries by their internal
+// keys. It's a concrete function object rather than std::function, so that
+// the comparison can be inlined into SkipList.
+struct MemTableKeyComparator {
+  const InternalKeyComparator comparator;
+
+  // True iff the user keys are compared by the builtin bytewise
+  // comparator, in which case the entries are compared in place by memcmp
+  // without any virtual call.
+  const bool bytewise;
+
+  explicit MemTableKeyComparator(const InternalKeyComparator &c)
+      : comparator(c),
+        bytewise(c.user_comparator() == NewBytewiseComparator()) {}
+
+  int operator()(const char *a_buf, const char *b_buf) const;
+
+  // The first 8 bytes of the user key as a big-endian integer, padded
+  // with zeros, which is consistent with the bytewise order. SkipList
+  // keeps it inline in each node (@see SkipList).
+  uint64_t Prefix(const char *buf) const;
+};
+
+// MemTableRep is the in-memory index of the entries of a MemTable.
+// The entries are encoded and allocated by MemTable (@see MemTable.cc),
+// a MemTableRep only keeps the pointers to them, ordered by
+// MemTableKeyComparator.
+//
+// All the implementations allow a single writer running concurrently with
+// readers, and multiple writers calling InsertConcurrently at the same time.
+class MemTableRep {
+  __DISALLOW_COPYING__(MemTableRep);
+
+ public:
+  MemTableRep() = default;
+
+  virtual ~MemTableRep() = default;
+
+  // Iterator over the entries in the order of MemTableKeyComparator.
+  class Iterator {
+   public:
+    virtual ~Iterator() = default;
+
+    // Returns the entry at the current position, or nullptr if the iterator
+    // is exhausted.
+    virtual const char *Entry() const = 0;
+
+    // REQUIRES: Entry() != nullptr
+    virtual void Next() = 0;
+
+    // Position at the first entry that is not less than target.
+    virtual void Seek(const char *target) = 0;
+
+    virtual void SeekToFirst() = 0;
+
+    // Returns a new iterator at the same position, which advances
+    // independently of this one.
+    virtual Iterator *Clone() const = 0;
+  };
+
+  virtual void Insert(const char *entry) = 0;
+
+  // Like Insert, but safe with other concurrent writers calling
+  // InsertConcurrently.
+  virtual void InsertConcurrently(const char *entry) = 0;
+
+  // Like Insert, but may use *hint to locate the position of entry.
+  // *hint must be nullptr at the first call, after which it's owned by the
+  // rep, and must not be shared with other reps. A rep may keep a single
+  // hint for all the writers, only one of which may insert with a hint at a
+  // time.
+  virtual void InsertWithHint(const char *entry, void **hint) {
+    Insert(entry);
+  }
+
+  // Returns the entry equal to key, or nullptr if not found.
+  virtual const char *Find(const char *key) const = 0;
+
+  // Returns an iterator over all the entries, positioned at the first one.
+  virtual Iterator *NewIterator() const = 0;
+
+  // Returns an iterator positioned at the first entry not less than key.
+  // It's the fast path of point lookups: the iterator is only guaranteed to
+  // go through the entries with the same user key as key, some reps stop
+  // earlier than NewIterator() would.
+  virtual Iterator *NewLookupIterator(const char *key) const {
+    Iterator *iter = NewIterator();
+    iter->Seek(key);
+    return iter;
+  }
+
+  // Returns the entry NewLookupIterator(key) is positioned at, or nullptr
+  // if there's none. Reps override it to locate the entry without
+  // allocating an iterator.
+  virtual const char *LowerBound(const char *key) const {
+    std::unique_ptr<Iterator> iter(NewLookupIterator(key));
+    return iter->Entry();
+  }
+
+  // Called by MemTable once no more entries will be inserted, which allows
+  // the rep to reorganize itself for reads (e.g sorting).
+  virtual void MarkReadOnly() {}
+
+  // Memory used by the rep besides the arena, which grows with the entries.
+  // The memory allocated up front (e.g. the buckets of a hash rep) is not
+  // counted, as it's what MemTable checks against write_buffer_size to see
+  // if the memtable is full.
+  virtual size_t ApproximateMemoryUsage() const {
+    return 0;
+  }
+};
+
+class MemTableRepFactory {
+ public:
+  virtual ~MemTableRepFactory() = default;
+
+  // Entries compared by cmp. All the memory of the nodes should be allocated
+  // from arena, which outlives the returned rep.
+  virtual MemTableRep *CreateMemTableRep(const MemTableKeyComparator &cmp,
+                                         ConcurrentArena *arena) const = 0;
+
+  virtual const char *Name() const = 0;
+};
+
+// The default rep, a SkipList sorted by the internal keys. Both insertion
+// and lookup take O(log n).
+// The result of NewSkipListRepFactory() must not be deleted.
+extern const MemTableRepFactory *NewSkipListRepFactory();
+
+// The entries are hashed into bucket_count buckets by the first
+// prefix_length bytes of their user keys (the whole user key if shorter),
+// each bucket is a small SkipList. Point lookups only search the bucket of
+// the key, while iterating over the whole memtable (e.g. flushing) has to
+// sort all the entries first.
+// Suitable for workloads of point lookups and writes only.
+// The bucket array of bucket_count pointers is allocated up front with each
+// memtable, and isn't counted towards Options::write_buffer_size.
+// Caller should delete the result when it's no longer needed.
+extern const MemTableRepFactory *NewHashPrefixRepFactory(
+    size_t prefix_length, size_t bucket_count = 1000000);
+
+// The entries are appended into a vector without ordering, which is sorted
+// when the memtable is marked read-only, i.e. right before it's flushed.
+// Lookups and iterations on a writable memtable go through a sorted snapshot
+// of the entries, into which the entries appended since the last snapshot
+// are sorted and merged. So reads following each write are slow, and it's
+// mostly suitable for bulk loading.
+// Caller should delete the result when it's no longer needed.
+extern const MemTableRepFactory *NewVectorRepFactory();
+
+inline int MemTableKeyComparator::operator()(const char *a_buf,
+                                             const char *b_buf) const {
+  // InternalKeys are encoded as varstrings.
+  uint32_t a_len, b_len;
+  const char *a = coding::DecodeVar32(a_buf, &a_len);
+  const char *b = coding::DecodeVar32(b_buf, &b_len);
+
+  if (!bytewise) {
+    return comparator.Compare(Slice(a, a_len), Slice(b, b_len));
+  }
+
+  // Inlined version of InternalKeyComparator::Compare with bytewise
+  // comparator.
+  assert(a_len >= 8 && b_len >= 8);
+  uint32_t a_user_len = a_len - 8, b_user_len = b_len - 8;
+  int r = memcmp(a, b, std::min(a_user_len, b_user_len));
+  if (r != 0)
+    return r;
+  if (a_user_len != b_user_len)
+    return a_user_len < b_user_len ? -1 : +1;
+
+  // Larger sequence numbers sort first.
+  uint64_t a_num = ConstDataView(a + a_user_len).ReadNum<uint64_t>();
+  uint64_t b_num = ConstDataView(b + b_user_len).ReadNum<uint64_t>();
+  if (a_num > b_num)
+    return -1;
+  if (a_num < b_num)
+    return +1;
+  return 0;
+}
+
+inline uint64_t MemTableKeyComparator::Prefix(const char *buf) const {
+  if (!bytewise) {
+    // All nodes have the same prefix, the order is told by operator().
+    return 0;
+  }
+
+  uint32_t len;
+  const char *p = coding::DecodeVar32(buf, &len);
+  uint32_t user_len = len < 8 ? 0 : len - 8;
+
+  uint64_t prefix = 0;
+  for (uint32_t i = 0; i < 8; i++) {
+    prefix <<= 8;
+    if (i < user_len)
+      prefix |= static_cast<uint8_t>(p[i]);
+  }
+  return prefix;
+}
+
+}  // namespace lessdb
@@ -0,0 +1,210 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <cassert>
+
+#include "MergingIterator.h"
+#include "Block.h"
+#include "Comparator.h"
+#include "MemTable.h"
+#include "SSTable.h"
+
+namespace lessdb {
+
+MergingIterator::MergingIterator(const Comparator *comparator,
+                                 std::vector<std::unique_ptr<Child>> children)
+    : comparator_(comparator), children_(std::move(children)) {
+  heap_.reserve(children_.size());
+}
+
+void MergingIterator::Next() {
+  assert(Valid());
+
+  // The smallest child is advanced in place and sifted down, rather than
+  // being popped and pushed back.
+  heap_.front()->Next();
+  if (!heap_.front()->Valid()) {
+    Status s = heap_.front()->Stat();
+    if (!s)
+      stat_ = s;
+    heap_.front() = heap_.back();
+    heap_.pop_back();
+  }
+  if (!heap_.empty())
+    siftDown(0);
+}
+
+void MergingIterator::SeekToFirst() {
+  heap_.clear();
+  stat_ = Status::OK();
+  for (auto &child : children_) {
+    addChild(child.get(), child->SeekToFirst());
+  }
+  buildHeap();
+}
+
+void MergingIterator::Seek(const Slice &target) {
+  heap_.clear();
+  stat_ = Status::OK();
+  for (auto &child : children_) {
+    addChild(child.get(), child->Seek(target));
+  }
+  buildHeap();
+}
+
+void MergingIterator::SeekPrefix(const Slice &target, const Slice &prefix) {
+  heap_.clear();
+  stat_ = Status::OK();
+  for (auto &child : children_) {
+    if (child->PrefixMayMatch(prefix))
+      addChild(child.get(), child->Seek(target));
+  }
+  buildHeap();
+}
+
+void MergingIterator::addChild(Child *child, const Status &s) {
+  if (!s) {
+    stat_ = s;
+  } else if (child->Valid()) {
+    heap_.push_back(child);
+  }
+}
+
+void MergingIterator::buildHeap() {
+  for (size_t i = heap_.size() / 2; i-- > 0;) {
+    siftDown(i);
+  }
+}
+
+void MergingIterator::siftDown(size_t i) {
+  Child *child = heap_[i];
+  size_t n = heap_.size();
+  while (2 * i + 1 < n) {
+    size_t smallest = 2 * i + 1;
+    if (smallest + 1 < n && greater(heap_[smallest], heap_[smallest + 1]))
+      smallest++;
+    if (!greater(child, heap_[smallest]))
+      break;
+    heap_[i] = heap_[smallest];
+    i = smallest;
+  }
+  heap_[i] = child;
+}
+
+bool MergingIterator::greater(const Child *lhs, const Child *rhs) const {
+  return comparator_->Compare(lhs->Key(), rhs->Key()) > 0;
+}
+
+/// Children
+
+namespace {
+
+class MemTableChild final : public MergingIterator::Child {
+ public:
+  explicit MemTableChild(std::shared_ptr<MemTable> mem)
+      : mem_(std::move(mem)), it_(mem_->end()) {}
+
+  bool Valid() const override {
+    return it_ != mem_->end();
+  }
+
+  Slice Key() const override {
+    return it_->first;
+  }
+
+  Slice Value() const override {
+    return it_->second;
+  }
+
+  void Next() override {
+    ++it_;
+  }
+
+  Status SeekToFirst() override {
+    it_ = mem_->begin();
+    return Status::OK();
+  }
+
+  Status Seek(const Slice &target) override {
+    it_ = mem_->lower_bound(target);
+    return Status::OK();
+  }
+
+ private:
+  std::shared_ptr<MemTable> mem_;
+  MemTable::ConstIterator it_;
+};
+
+class TableChild final : public MergingIterator::Child {
+ public:
+  explicit TableChild(const SSTable *table)
+      : table_(table), it_(table->end()) {}
+
+  bool Valid() const override {
+    return it_ != table_->end();
+  }
+
+  Slice Key() const override {
+    return it_.Key();
+  }
+
+  Slice Value() const override {
+    return it_.Value();
+  }
+
+  void Next() override {
+    ++it_;
+  }
+
+  Status Stat() const override {
+    return it_.Stat();
+  }
+
+  Status SeekToFirst() override {
+    it_ = table_->begin();
+    return it_.Stat();
+  }
+
+  Status Seek(const Slice &target) override {
+    return table_->Seek(target, &it_);
+  }
+
+  bool PrefixMayMatch(const Slice &prefix) const override {
+    return table_->PrefixMayMatch(prefix);
+  }
+
+ private:
+  const SSTable *table_;
+  SSTable::ConstIterator it_;
+};
+
+}  // namespace
+
+MergingIterator::Child *NewMemTableChild(std::shared_ptr<MemTable> mem) {
+  return new MemTableChild(std::move(mem));
+}
+
+MergingIterator::Child *NewTableChild(const SSTable *table) {
+  return new TableChild(table);
+}
+
+}  // namespace lessdb
@@ -0,0 +1,140 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "Disallowcopying.h"
+#include "Slice.h"
+#include "Status.h"
+
+namespace lessdb {
+
+class Comparator;
+class MemTable;
+class SSTable;
+
+// MergingIterator merges several sorted sources into a single sorted
+// sequence. The sources are kept in a binary heap by their current keys, so
+// that a step costs a single sift down of the heap, O(log n) comparisons
+// for n sources.
+// Entries with the same key are yielded in an unspecified order, which is
+// fine for the internal keys, as they are unique.
+class MergingIterator {
+  __DISALLOW_COPYING__(MergingIterator);
+
+ public:
+  // A sorted source of entries.
+  class Child {
+   public:
+    virtual ~Child() = default;
+
+    virtual bool Valid() const = 0;
+
+    // REQUIRES: Valid()
+    virtual Slice Key() const = 0;
+    virtual Slice Value() const = 0;
+    virtual void Next() = 0;
+
+    // The error that has made the source invalid, if any.
+    virtual Status Stat() const {
+      return Status::OK();
+    }
+
+    virtual Status SeekToFirst() = 0;
+
+    // Position at the first entry not less than target.
+    virtual Status Seek(const Slice &target) = 0;
+
+    // Returns false if the source has no user key of prefix (@see
+    // Options::prefix_extractor).
+    virtual bool PrefixMayMatch(const Slice &prefix) const {
+      return true;
+    }
+  };
+
+  // The keys of children are ordered by comparator.
+  MergingIterator(const Comparator *comparator,
+                  std::vector<std::unique_ptr<Child>> children);
+
+  bool Valid() const {
+    return !heap_.empty();
+  }
+
+  // REQUIRES: Valid()
+  Slice Key() const {
+    return heap_.front()->Key();
+  }
+
+  Slice Value() const {
+    return heap_.front()->Value();
+  }
+
+  // A child that fails while advancing is left out, and its error is
+  // returned by Stat().
+  void Next();
+
+  // The children failed to be positioned are left out, and their errors
+  // are returned by Stat().
+  void SeekToFirst();
+  void Seek(const Slice &target);
+
+  // Like Seek, but leaves out the children without the user keys of prefix,
+  // for a scan that stops at the end of prefix.
+  void SeekPrefix(const Slice &target, const Slice &prefix);
+
+  Status Stat() const {
+    return stat_;
+  }
+
+ private:
+  // Add child to heap_ if it's valid, or its error to stat_.
+  void addChild(Child *child, const Status &s);
+
+  // Turn heap_ into a heap.
+  void buildHeap();
+
+  // Move heap_[i] down to where it's not greater than its children.
+  void siftDown(size_t i);
+
+  bool greater(const Child *lhs, const Child *rhs) const;
+
+ private:
+  const Comparator *comparator_;
+  std::vector<std::unique_ptr<Child>> children_;
+
+  // The valid children, a min-heap by their current keys.
+  std::vector<Child *> heap_;
+  Status stat_;
+};
+
+/// Children
+
+// Iterates the entries of mem, which is kept alive by the child.
+MergingIterator::Child *NewMemTableChild(std::shared_ptr<MemTable> mem);
+
+// Iterates the records of table, which must outlive the child.
+MergingIterator::Child *NewTableChild(const SSTable *table);
+
+}  // namespace lessdb
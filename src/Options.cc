@@ -22,13 +22,38 @@
 
 #include "Options.h"
 #include "Comparator.h"
+#include "MemTableRep.h"
 
 namespace lessdb {
 
 Options::Options()
     : block_restart_interval(16),
       block_cache(nullptr),
+      filter_strategy(nullptr),
+      prefix_extractor(nullptr),
+      index_partition_size(0),
       block_size(4 * 1024),
+      data_block_hash_table_util_ratio(0),
+      max_auto_readahead_size(256 << 10),
+      enable_pipelined_write(false),
+      allow_concurrent_memtable_write(false),
+      paranoid_checks(false),
+      recovery_threads(2),
+      log_preallocate_size(4 << 20),
+      recycle_log_file_num(0),
+      wal_sync_interval_ms(0),
+      wal_sync_bytes(0),
+      memtable_factory(NewSkipListRepFactory()),
+      arena_block_size(0),
+      memtable_huge_page_size(0),
+      write_buffer_size(4 << 20),
+      max_write_buffer_number(4),
+      max_background_flushes(2),
+      level0_slowdown_writes_trigger(0),
+      level0_stop_writes_trigger(0),
+      soft_pending_compaction_bytes_limit(0),
+      hard_pending_compaction_bytes_limit(0),
+      delayed_write_rate(16 << 20),
       comparator(NewBytewiseComparator()) {}
 
 }  // namespace lessdb
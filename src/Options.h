@@ -23,11 +23,15 @@
 #pragma once
 
 #include <cstddef>
+#include <cstdint>
 namespace lessdb {
 
 class Comparator;
 class CacheStrategy;
 class FilterStrategy;
+class MemTableRepFactory;
+class PrefixExtractor;
+class Snapshot;
 
 // TODO: Singleton
 struct Options {
@@ -45,9 +49,24 @@ struct Options {
   CacheStrategy *block_cache;
 
   // If non-NULL, use the specified filter strategy to reduce disk reads.
+  // The filters are built over the user keys.
   // Default: NULL
   const FilterStrategy *filter_strategy;
 
+  // If non-NULL along with filter_strategy, the tables have a second filter
+  // built over the prefixes of the user keys, which lets the scans within a
+  // prefix skip the tables without it (@see ReadOptions::prefix_same_as_start).
+  // Default: NULL
+  const PrefixExtractor *prefix_extractor;
+
+  // If non-zero, the index of a table is cut into partitions of about this
+  // size, which are read on demand through block_cache like data blocks,
+  // so that an open table only holds a small top-level index over the
+  // partitions, rather than the whole index. Tables whose index fits into
+  // a single partition keep the single index block.
+  // Default: 0
+  size_t index_partition_size;
+
   // Approximate size of user data packed per block.  Note that the
   // block size specified here corresponds to uncompressed data.  The
   // actual size of the unit read from disk may be smaller if
@@ -56,6 +75,154 @@ struct Options {
   // Default: 4K
   size_t block_size;
 
+  // If positive, each data block carries a hash index of its user keys, so
+  // that a point lookup jumps to the restart interval of its key instead of
+  // binary searching the restart points. The index has about
+  // (number of user keys / data_block_hash_table_util_ratio) one-byte
+  // buckets, the larger the ratio the smaller the index and the more
+  // collisions, which fall back to the binary search. Blocks with more than
+  // 253 restart points are built without the index.
+  //
+  // Default: 0
+  double data_block_hash_table_util_ratio;
+
+  // Once an iterator has read a few data blocks of a table in a row, the
+  // blocks ahead are prefetched in the background (@see
+  // RandomAccessFile::Prefetch), starting with 8KB, and doubling the
+  // readahead each time it's used up, up to this size. 0 disables the
+  // readahead.
+  //
+  // Default: 256KB
+  size_t max_auto_readahead_size;
+
+  // If true, DBImpl::Write runs the log write of a write group and the
+  // memtable insertion of the previous group concurrently, instead of
+  // finishing both stages before the next group can start. Sequence numbers
+  // are still published in the order of the log.
+  //
+  // Default: false
+  bool enable_pipelined_write;
+
+  // If true, the writers in a write group insert their own batches into the
+  // memtable in parallel, after the leader has written the group into the
+  // log.
+  //
+  // Default: false
+  bool allow_concurrent_memtable_write;
+
+  // If true, DB::Open fails on any corruption found in the log files.
+  // Otherwise the corrupted records are dropped.
+  //
+  // Default: false
+  bool paranoid_checks;
+
+  // The number of threads splitting the log files into records and
+  // verifying their checksums during recovery, while the records are
+  // inserted into the memtable in order by the opening thread. 0 means
+  // everything is done by the opening thread.
+  //
+  // Default: 2
+  int recovery_threads;
+
+  // The space of log files is allocated ahead in chunks of this size, so
+  // that most of the appends don't allocate blocks of the file system. The
+  // file size still grows with every append, which a synced write has to
+  // flush along with the data; only recycled logs avoid that (@see
+  // recycle_log_file_num). 0 disables preallocation.
+  //
+  // Default: 4MB
+  size_t log_preallocate_size;
+
+  // If positive, up to this number of obsolete log files are kept, and
+  // overwritten by the new logs instead of creating new files. The appends
+  // stay within the old file size until they run past it, so neither the
+  // file space nor the size has to be updated, and a synced write only
+  // flushes the data. The log records are written in the recyclable format
+  // (@see LogFormat.h).
+  //
+  // Default: 0
+  size_t recycle_log_file_num;
+
+  // If positive, the log is synced by a background thread every
+  // wal_sync_interval_ms milliseconds, so that a machine crash loses no more
+  // than about the last interval of writes, without syncing every write.
+  //
+  // Default: 0
+  uint64_t wal_sync_interval_ms;
+
+  // If positive, the background thread also syncs the log as soon as this
+  // many bytes have been written since the last sync. If it's the only
+  // trigger, i.e. wal_sync_interval_ms is 0, the writers waiting for the sync
+  // (@see WriteOptions::wait_for_sync) trigger it as well.
+  //
+  // Default: 0
+  size_t wal_sync_bytes;
+
+  // Creates the in-memory index of the entries in each memtable.
+  // @see MemTableRep.h for the available representations.
+  // Default: NewSkipListRepFactory()
+  const MemTableRepFactory *memtable_factory;
+
+  // The size of the blocks memtables allocate their memory in. 0 means an
+  // eighth of write_buffer_size. @see Arena.
+  //
+  // Default: 0
+  size_t arena_block_size;
+
+  // If positive, the memory of memtables is backed by huge pages of this
+  // size, e.g. 2MB, if the system has them reserved (see
+  // /proc/sys/vm/nr_hugepages), or else by transparent huge pages if
+  // they're enabled. The heap is used if neither is available.
+  //
+  // Default: 0
+  size_t memtable_huge_page_size;
+
+  // Amount of data to build up in a memtable before it's switched to be
+  // immutable, and flushed into a level-0 table by the background threads.
+  // A new memtable and a new log file take over the writes meanwhile.
+  //
+  // Default: 4MB
+  size_t write_buffer_size;
+
+  // The maximum number of memtables, the active one included, to be kept in
+  // memory. Writes wait for a flush when all of them are full.
+  //
+  // Default: 4
+  int max_write_buffer_number;
+
+  // The number of background threads flushing the immutable memtables, so
+  // that several of them can be flushed in parallel.
+  //
+  // Default: 2
+  int max_background_flushes;
+
+  // Writes are slowed down gradually as the number of level-0 tables grows
+  // from level0_slowdown_writes_trigger towards level0_stop_writes_trigger,
+  // where they run at the slowest rate. 0 disables the trigger.
+  //
+  // Nothing reduces the level-0 tables until they can be compacted, so the
+  // writes are never stopped by them, and both are disabled by default.
+  //
+  // Default: 0
+  int level0_slowdown_writes_trigger;
+  int level0_stop_writes_trigger;
+
+  // Like the level-0 triggers, for the estimated bytes waiting to be
+  // compacted, i.e. the size of the level-0 tables. 0 disables the limit.
+  //
+  // Default: 0
+  uint64_t soft_pending_compaction_bytes_limit;
+  uint64_t hard_pending_compaction_bytes_limit;
+
+  // The write rate in bytes per second, when the writes are slowed down by
+  // the level-0 triggers, the pending compaction bytes limits, or by the
+  // immutable memtables when all but one of the memtables are full (@see
+  // max_write_buffer_number, if it's more than 3). The rate goes down to a
+  // sixteenth of it as the pressure approaches the stop limits.
+  //
+  // Default: 16MB
+  uint64_t delayed_write_rate;
+
   Options();
 };
 
@@ -79,7 +246,14 @@ struct WriteOptions {
   // Default: false
   bool sync;
 
-  WriteOptions() : sync(false) {}
+  // If true and sync is false, Write returns only after the write has been
+  // synced by the background thread (@see Options::wal_sync_interval_ms),
+  // which lets a batch of writers share a single sync.
+  //
+  // Default: false
+  bool wait_for_sync;
+
+  WriteOptions() : sync(false), wait_for_sync(false) {}
 };
 
 struct ReadOptions {
@@ -88,7 +262,24 @@ struct ReadOptions {
   // Default: false
   bool verify_checksums;
 
-  ReadOptions() : verify_checksums(false) {}
+  // If true, and Options::prefix_extractor is set, DBIterator::Seek(key)
+  // only yields the keys of the same prefix as key, and skips the tables
+  // whose prefix filters rule out the prefix. Seeking a key out of the
+  // domain of the extractor, or SeekToFirst, scans the whole database.
+  // Default: false
+  bool prefix_same_as_start;
+
+  // If non-NULL, read as of the supplied snapshot (which must belong to the
+  // DB that is being read and which must not have been released). If NULL,
+  // use an implicit snapshot of the state at the beginning of this read
+  // operation.
+  // Default: NULL
+  const Snapshot *snapshot;
+
+  ReadOptions()
+      : verify_checksums(false),
+        prefix_same_as_start(false),
+        snapshot(nullptr) {}
 };
 
 }  // namespace lessdb
\ No newline at end of file
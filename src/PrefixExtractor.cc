@@ -0,0 +1,57 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <string>
+
+#include "PrefixExtractor.h"
+#include "Slice.h"
+
+namespace lessdb {
+
+class FixedPrefixExtractor final : public PrefixExtractor {
+ public:
+  explicit FixedPrefixExtractor(size_t prefix_len)
+      : prefix_len_(prefix_len),
+        name_("lessdb.FixedPrefix." + std::to_string(prefix_len)) {}
+
+  const char *Name() const override {
+    return name_.c_str();
+  }
+
+  bool InDomain(const Slice &key) const override {
+    return key.Len() >= prefix_len_;
+  }
+
+  Slice Transform(const Slice &key) const override {
+    return Slice(key.RawData(), prefix_len_);
+  }
+
+ private:
+  const size_t prefix_len_;
+  const std::string name_;
+};
+
+PrefixExtractor *PrefixExtractor::Fixed(size_t prefix_len) {
+  return new FixedPrefixExtractor(prefix_len);
+}
+
+}  // namespace lessdb
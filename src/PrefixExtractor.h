@@ -0,0 +1,62 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+#include "Disallowcopying.h"
+#include "SliceFwd.h"
+
+namespace lessdb {
+
+// A PrefixExtractor maps keys to their prefixes, which are put into the
+// prefix filters of tables (@see Options::prefix_extractor), so that a scan
+// within a prefix skips the tables without it.
+// The extractor must preserve the order of keys: the keys of a prefix are
+// contiguous in the order of the comparator.
+class PrefixExtractor {
+  __DISALLOW_COPYING__(PrefixExtractor);
+
+ public:
+  virtual ~PrefixExtractor() = default;
+
+  // The name of the extractor, which is stored along with the prefix
+  // filters, so that a filter is never probed by an incompatible extractor.
+  virtual const char *Name() const = 0;
+
+  // Returns true if key has a prefix. The keys that don't are not filtered
+  // by prefix.
+  virtual bool InDomain(const Slice &key) const = 0;
+
+  // Returns the prefix of key.
+  // REQUIRES: InDomain(key)
+  virtual Slice Transform(const Slice &key) const = 0;
+
+  // The first prefix_len bytes of the keys that are not shorter.
+  static PrefixExtractor *Fixed(size_t prefix_len);
+
+ protected:
+  PrefixExtractor() = default;
+};
+
+}  // namespace lessdb
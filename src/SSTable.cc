@@ -20,6 +20,7 @@
  * SOFTWARE.
  */
 
+#include <algorithm>
 #include <boost/any.hpp>
 
 #include "SSTable.h"
@@ -28,6 +29,9 @@
 #include "BlockUtils.h"
 #include "CacheStrategy.h"
 #include "Block.h"
+#include "Comparator.h"
+#include "FilterStrategy.h"
+#include "PrefixExtractor.h"
 
 namespace lessdb {
 
@@ -62,77 +66,216 @@ SSTable *SSTable::Open(const Options &options, RandomAccessFile *file,
     return nullptr;
 
   table->file_ = file;
+  table->options_ = options;
+  table->index_partitioned_ = false;
+  table->cache_id_ = options.block_cache ? options.block_cache->NewId() : 0;
+
+  // A table without metaindex has neither a partitioned index nor filters.
+  if (footer.mataindex_handle.size > 0) {
+    // The names of meta blocks are ordered bytewise.
+    std::unique_ptr<Block> metaindex(
+        ReadBlockFromFile(file, read_options, NewBytewiseComparator(),
+                          footer.mataindex_handle, s));
+    if (!s)
+      return nullptr;
+
+    table->index_partitioned_ =
+        metaindex->find(kPartitionedIndexBlockName) != metaindex->end();
+    if (options.filter_strategy) {
+      table->readFilters(*metaindex);
+    }
+  }
   return table.release();
 }
 
+void SSTable::readFilters(const Block &metaindex) {
+  std::string name = kFilterBlockPrefix;
+  name.append(options_.filter_strategy->Name());
+  readFilter(metaindex, name, &filter_, &filter_data_);
+
+  if (options_.prefix_extractor) {
+    readFilter(metaindex, PrefixFilterBlockName(options_), &prefix_filter_,
+               &prefix_filter_data_);
+  }
+}
+
+void SSTable::readFilter(const Block &metaindex, const std::string &name,
+                         Slice *filter, std::unique_ptr<char[]> *data) {
+  auto it = metaindex.find(name);
+  if (it == metaindex.end())
+    return;
+
+  BlockHandle handle;
+  Slice handle_buf = it.Value();
+  if (!BlockHandle::DecodeFrom(&handle_buf, &handle))
+    return;
+
+  BlockContent content;
+  ReadOptions read_options;
+  if (!ReadBlockContent(file_, read_options, handle, &content))
+    return;
+  if (content.heap_allocated)
+    data->reset(const_cast<char *>(content.data.RawData()));
+  *filter = content.data;
+}
+
+bool SSTable::KeyMayMatch(const Slice &key) const {
+  if (filter_.Empty())
+    return true;
+  return options_.filter_strategy->MightContain(
+      options_.comparator->UserKey(key), filter_);
+}
+
+bool SSTable::PrefixMayMatch(const Slice &prefix) const {
+  if (prefix_filter_.Empty())
+    return true;
+  return options_.filter_strategy->MightContain(prefix, prefix_filter_);
+}
+
 SSTable::ConstIterator SSTable::begin() const {
-  auto block = ObtainBlockByIndexIterator(index_block_->begin());
-  if (!block) {
-    return end();
+  IndexIterator idx_it(this);
+  boost::intrusive_ptr<Block> block;
+  Status s = idx_it.SeekToFirst();
+  if (s && idx_it.Valid()) {
+    s = ObtainBlockByIndexIterator(idx_it, &block);
+  }
+  // Only the data block of an empty table is empty.
+  if (!block || block->begin() == block->end()) {
+    ConstIterator it = end();
+    it.stat_ = s;
+    return it;
   }
-  return TwoLevelIterator(new BlockConstIterator(block->begin()),
-                          new BlockConstIterator(index_block_->begin()), this);
+  return TwoLevelIterator(new BlockConstIterator(block->begin()), idx_it, this);
 }
 
 SSTable::ConstIterator SSTable::end() const {
-  return TwoLevelIterator();
+  return TwoLevelIterator(this);
 }
 
 SSTable::ConstIterator SSTable::find(const Slice &key) const {
-  auto idx_it = index_block_->lower_bound(key);
-  if (idx_it == index_block_->end()) {
-    // index < key
-    fprintf(stderr, "this 1\n");
-    fprintf(stderr, "%s\n", key.RawData());
-    for(auto it = index_block_->begin(); it!=index_block_->end(); it++) {
-      fprintf(stderr, "[%s,%s] ", it.Key().RawData(), it.Value().RawData());
-    }
-    fprintf(stderr, "\n");
+  if (!KeyMayMatch(key))
     return end();
+
+  IndexIterator idx_it(this);
+  boost::intrusive_ptr<Block> block;
+  Status s = idx_it.Seek(key);
+  // index >= key, otherwise index < key and there's no such record.
+  if (s && idx_it.Valid()) {
+    s = ObtainBlockByIndexIterator(idx_it, &block);
   }
-  // index >= key
-  auto block = ObtainBlockByIndexIterator(idx_it);
   if (!block) {
-    fprintf(stderr, "this 2\n");
-    return end();
+    ConstIterator it = end();
+    it.stat_ = s;
+    return it;
   }
   auto blck_it = block->find(key);
   if (blck_it == block->end()) {
-    fprintf(stderr, "this 3\n");
     return end();
   }
-  return TwoLevelIterator(new BlockConstIterator(blck_it),
-                          new BlockConstIterator(idx_it), this);
+  return TwoLevelIterator(new BlockConstIterator(blck_it), idx_it, this);
+}
+
+Status SSTable::Seek(const Slice &key, ConstIterator *iter) const {
+  // The index entry of a data block is not less than any key in the block,
+  // so the block pointed to by the first index entry not less than key is
+  // the first one that may have a record not less than key. If it doesn't,
+  // the record is the first one of the next block.
+  IndexIterator idx_it(this);
+  Status s;
+  for (s = idx_it.Seek(key); s && idx_it.Valid(); s = idx_it.Next()) {
+    boost::intrusive_ptr<Block> block;
+    s = readBlock(idx_it.Value(), &block);
+    if (!s)
+      return s;
+
+    auto blck_it = block->lower_bound(key);
+    if (blck_it != block->end()) {
+      *iter = TwoLevelIterator(new BlockConstIterator(blck_it), idx_it, this);
+      return Status::OK();
+    }
+  }
+  *iter = end();
+  return s;
+}
+
+Status SSTable::MultiSeek(size_t n, const Slice *keys,
+                          ConstIterator *iters) const {
+  if (n == 0)
+    return Status::OK();
+
+  IndexIterator idx_it(this);
+  Status s = idx_it.Seek(keys[0]);
+  if (!s)
+    return s;
+  boost::intrusive_ptr<Block> block;
+  for (size_t i = 0; i < n; i++) {
+    // The block of keys[i] is either the current one, or a later one as the
+    // keys are sorted.
+    if (idx_it.Valid() &&
+        options_.comparator->Compare(idx_it.Key(), keys[i]) < 0) {
+      s = idx_it.Seek(keys[i]);
+      if (!s)
+        return s;
+      block.reset();
+    }
+
+    // The same as Seek from here.
+    for (; idx_it.Valid(); block.reset()) {
+      if (!block) {
+        s = readBlock(idx_it.Value(), &block);
+        if (!s)
+          return s;
+      }
+
+      auto blck_it = block->lower_bound(keys[i]);
+      if (blck_it != block->end()) {
+        iters[i] =
+            TwoLevelIterator(new BlockConstIterator(blck_it), idx_it, this);
+        break;
+      }
+      s = idx_it.Next();
+      if (!s)
+        return s;
+    }
+    if (!idx_it.Valid())
+      iters[i] = end();
+  }
+  return Status::OK();
 }
 
-Block *SSTable::ObtainBlockByIndexIterator(const BlockConstIterator &it) const {
+Status SSTable::ObtainBlockByIndexIterator(
+    const IndexIterator &it, boost::intrusive_ptr<Block> *block) const {
+  return readBlock(it.Value(), block);
+}
+
+Status SSTable::readBlock(const Slice &handle_value,
+                          boost::intrusive_ptr<Block> *result) const {
   // Obtain a block handle that contains index of the data block.
   BlockHandle handle;
-  Slice block_index_buf = it.Value();
-  stat_ = BlockHandle::DecodeFrom(&block_index_buf, &handle);
-  if (!stat_) {
-    return nullptr;
+  Slice block_index_buf = handle_value;
+  Status s = BlockHandle::DecodeFrom(&block_index_buf, &handle);
+  if (!s) {
+    return s;
   }
 
   boost::intrusive_ptr<Block> block;
   CacheStrategy *cache = options_.block_cache;
 
+  // The key of a BlockCache is in format of:
+  // key          := unique_id block_offset
+  // unique_id    := uint64, the cache_id_ of the table
+  // block_offset := uint64
+  char key_buf[16];
+  Slice key(key_buf, sizeof(key_buf));
   if (cache) {
-    // The key of a BlockCache is in format of:
-    // key          := unique_id block_offset
-    // unique_id    := uint64
-    // block_offset := uint64
-    char key_buf[16];
-    (*reinterpret_cast<uint64_t *>(key_buf)) = cache->NewId();
-    (*reinterpret_cast<uint64_t *>(key_buf + 8)) = handle.offset;
-    Slice key(key_buf, sizeof(key_buf));
-
-    CacheStrategy::HANDLE h = cache->Lookup(key);
-    if (h != NULL) {
-      //
-      block = *boost::unsafe_any_cast<decltype(block)>(&cache->Value(h));
-    } else {
-      cache->Insert(key, block);
+    DataView(key_buf).WriteNum(cache_id_);
+    DataView(key_buf + 8).WriteNum(handle.offset);
+
+    // The block is copied out under the lock of the cache, as the entry may
+    // be evicted by other readers at any time.
+    boost::any value;
+    if (cache->Lookup(key, &value)) {
+      block = *boost::unsafe_any_cast<decltype(block)>(&value);
     }
   }
 
@@ -140,27 +283,174 @@ Block *SSTable::ObtainBlockByIndexIterator(const BlockConstIterator &it) const {
     /// Iff cache is not set or block is not found in cache.
     ReadOptions read_options;
     block.reset(ReadBlockFromFile(file_, read_options, options_.comparator,
-                                  handle, stat_));
-    if (!stat_)
-      return nullptr;
+                                  handle, s));
+    if (!s)
+      return s;
+    if (cache)
+      cache->Insert(key, block);
+  }
+  *result = std::move(block);
+  return Status::OK();
+}
+
+IndexIterator::IndexIterator(const SSTable *table)
+    : table_(table), block_(nullptr) {}
+
+IndexIterator::IndexIterator(const IndexIterator &rhs)
+    : table_(rhs.table_), partition_(rhs.partition_), block_(rhs.block_) {
+  if (rhs.top_iter_)
+    top_iter_.reset(new BlockConstIterator(*rhs.top_iter_));
+  if (rhs.iter_)
+    iter_.reset(new BlockConstIterator(*rhs.iter_));
+}
+
+IndexIterator &IndexIterator::operator=(const IndexIterator &rhs) {
+  IndexIterator tmp(rhs);
+  std::swap(*this, tmp);
+  return *this;
+}
+
+IndexIterator::~IndexIterator() = default;
+
+Slice IndexIterator::Key() const {
+  assert(Valid());
+  return iter_->Key();
+}
+
+Slice IndexIterator::Value() const {
+  assert(Valid());
+  return iter_->Value();
+}
+
+Status IndexIterator::SeekToFirst() {
+  const Block *index = table_->index_block_.get();
+  if (!table_->index_partitioned_) {
+    block_ = index;
+    setIter(index->begin());
+    return Status::OK();
+  }
+
+  top_iter_.reset(new BlockConstIterator(index->begin()));
+  Status s = readPartition();
+  if (s)
+    setIter(block_->begin());
+  return s;
+}
+
+Status IndexIterator::SeekToLast() {
+  const Block *index = table_->index_block_.get();
+  if (!table_->index_partitioned_) {
+    block_ = index;
+    setIter(--index->end());
+    return Status::OK();
+  }
+
+  top_iter_.reset(new BlockConstIterator(--index->end()));
+  Status s = readPartition();
+  if (s)
+    setIter(--block_->end());
+  return s;
+}
+
+Status IndexIterator::Seek(const Slice &key) {
+  const Block *index = table_->index_block_.get();
+  if (!table_->index_partitioned_) {
+    block_ = index;
+    setIter(index->lower_bound(key));
+    return Status::OK();
+  }
+
+  // The last key of a partition is not less than any key in it, the entry
+  // of key is in the first partition whose last key is not less than key.
+  auto top_it = index->lower_bound(key);
+  if (top_it == index->end()) {
+    iter_.reset();
+    return Status::OK();
+  }
+
+  // Forward seeks within the partition, e.g. by MultiSeek, don't read it
+  // again.
+  if (!Valid() || *top_iter_ != top_it) {
+    top_iter_.reset(new BlockConstIterator(top_it));
+    Status s = readPartition();
+    if (!s)
+      return s;
+  }
+  setIter(block_->lower_bound(key));
+  return Status::OK();
+}
+
+Status IndexIterator::Next() {
+  assert(Valid());
+  ++(*iter_);
+  if (*iter_ != block_->end())
+    return Status::OK();
+
+  iter_.reset();
+  if (!table_->index_partitioned_)
+    return Status::OK();
+  ++(*top_iter_);
+  if (*top_iter_ == top_iter_->GetBlock()->end())
+    return Status::OK();
+  Status s = readPartition();
+  if (s)
+    setIter(block_->begin());
+  return s;
+}
+
+Status IndexIterator::Prev() {
+  assert(Valid());
+  if (*iter_ != block_->begin()) {
+    --(*iter_);
+    return Status::OK();
+  }
+
+  iter_.reset();
+  if (!table_->index_partitioned_ ||
+      *top_iter_ == top_iter_->GetBlock()->begin()) {
+    return Status::OK();
+  }
+  --(*top_iter_);
+  Status s = readPartition();
+  if (s)
+    setIter(--block_->end());
+  return s;
+}
+
+Status IndexIterator::readPartition() {
+  iter_.reset();
+  partition_.reset();
+  block_ = nullptr;
+  Status s = table_->readBlock(top_iter_->Value(), &partition_);
+  block_ = partition_.get();
+  return s;
+}
+
+void IndexIterator::setIter(const BlockConstIterator &it) {
+  if (it == block_->end()) {
+    iter_.reset();
+  } else {
+    iter_.reset(new BlockConstIterator(it));
   }
-  return block.detach();
 }
 
 TwoLevelIterator::TwoLevelIterator(BlockConstIterator *data_it,
-                                   BlockConstIterator *idx_it,
+                                   const IndexIterator &idx_it,
                                    const SSTable *table)
     : data_iter_(data_it),
       index_iter_(idx_it),
       block_(data_it->GetBlock()),
       table_(table) {}
 
-TwoLevelIterator::TwoLevelIterator(const TwoLevelIterator &rhs) {
+TwoLevelIterator::TwoLevelIterator(const TwoLevelIterator &rhs)
+    : index_iter_(rhs.table_),
+      table_(rhs.table_),
+      stat_(rhs.stat_),
+      readahead_(rhs.readahead_) {
   if (rhs.valid()) {
     data_iter_.reset(new BlockConstIterator(*rhs.data_iter_));
-    index_iter_.reset(new BlockConstIterator(*rhs.index_iter_));
+    index_iter_ = rhs.index_iter_;
     block_ = rhs.block_;
-    table_ = rhs.table_;
   }
 }
 
@@ -192,20 +482,105 @@ void TwoLevelIterator::increment() {
 
   (*data_iter_)++;
   if ((*data_iter_) == data_iter_->GetBlock()->end()) {
-    (*index_iter_)++;
-    if ((*index_iter_) == index_iter_->GetBlock()->end()) {
+    Status s = index_iter_.Next();
+    if (!index_iter_.Valid()) {
       // Iff the iterator hits the end, swap it with the end() iterator.
-      TwoLevelIterator tmp;
-      std::swap(*this, tmp);
+      setEnd(s);
     } else {
-      auto block = table_->ObtainBlockByIndexIterator(*index_iter_);
-      TwoLevelIterator tmp(new BlockConstIterator(block->begin()),
-                           new BlockConstIterator(*index_iter_), table_);
-      std::swap(*this, tmp);
+      readahead();
+      boost::intrusive_ptr<Block> block;
+      s = table_->ObtainBlockByIndexIterator(index_iter_, &block);
+      if (!s) {
+        setEnd(s);
+        return;
+      }
+      data_iter_.reset(new BlockConstIterator(block->begin()));
+      block_ = std::move(block);
     }
   }
 }
 
+void TwoLevelIterator::setEnd(const Status &s) {
+  TwoLevelIterator tmp(table_);
+  tmp.stat_ = s;
+  std::swap(*this, tmp);
+}
+
+static const int kMinSequentialReads = 2;
+static const size_t kInitReadaheadSize = 8 << 10;
+
+void TwoLevelIterator::readahead() {
+  size_t max_size = table_->options_.max_auto_readahead_size;
+  if (max_size == 0)
+    return;
+
+  BlockHandle handle;
+  Slice handle_buf = index_iter_.Value();
+  if (!BlockHandle::DecodeFrom(&handle_buf, &handle))
+    return;
+
+  // The offset of a handle is the end of the block, and the size includes
+  // the trailer.
+  uint64_t start = handle.offset - handle.size;
+  Readahead &r = readahead_;
+  if (start != r.next_offset) {
+    r = Readahead();
+  } else {
+    r.num_sequential_reads++;
+  }
+  r.next_offset = handle.offset;
+  if (r.num_sequential_reads < kMinSequentialReads || r.next_offset <= r.limit)
+    return;
+
+  r.size = std::min(std::max(r.size * 2, kInitReadaheadSize), max_size);
+  // The block may have been prefetched in part.
+  uint64_t offset = std::max(start, r.limit);
+  // The prefetch is only a hint, failures show up in the reads.
+  table_->file_->Prefetch(offset, r.size);
+  r.limit = offset + r.size;
+}
+
+void TwoLevelIterator::decrement() {
+  IndexIterator idx_it(table_);
+  Status s;
+  if (!valid()) {
+    // the last record of the table
+    assert(table_);
+    s = idx_it.SeekToLast();
+  } else if (*data_iter_ != block_->begin()) {
+    --(*data_iter_);
+    return;
+  } else {
+    // the last record of the previous block
+    idx_it = index_iter_;
+    s = idx_it.Prev();
+    assert(!s || idx_it.Valid());
+  }
+
+  if (!idx_it.Valid()) {
+    setEnd(s);
+    return;
+  }
+  seekToLastOfBlock(idx_it);
+}
+
+void TwoLevelIterator::seekToLastOfBlock(const IndexIterator &idx_it) {
+  boost::intrusive_ptr<Block> block;
+  Status s = table_->ObtainBlockByIndexIterator(idx_it, &block);
+  if (!s) {
+    setEnd(s);
+    return;
+  }
+  // Only the data block of an empty table is empty.
+  if (block->begin() == block->end()) {
+    setEnd(Status::OK());
+    return;
+  }
+  auto blck_it = block->end();
+  TwoLevelIterator tmp(new BlockConstIterator(--blck_it), idx_it, table_);
+  std::swap(*this, tmp);
+}
+
 // @return false iff the data iterator hits the end.
 inline bool TwoLevelIterator::valid() const {
   return *this != TwoLevelIterator();
@@ -23,6 +23,8 @@
 #pragma once
 
 #include <cstddef>
+#include <memory>
+#include <string>
 #include <boost/intrusive_ptr.hpp>
 
 #include "Disallowcopying.h"
@@ -38,9 +40,84 @@ class Block;
 class BlockConstIterator;
 class SSTable;
 class TwoLevelIterator;
+struct BlockHandle;
+
+// Iterates over the index entries of an SSTable, which are either in a single
+// index block, or partitioned (@see Options::index_partition_size). A
+// partitioned index is read through the top-level index block, one partition
+// at a time, and the partition being iterated over is held by the iterator.
+// The index has at least one entry, for the data block of an empty table.
+class IndexIterator {
+  // intentionally copyable
+ public:
+  // Positioned at the end.
+  explicit IndexIterator(const SSTable* table);
+
+  IndexIterator(const IndexIterator& rhs);
+
+  IndexIterator& operator=(const IndexIterator& rhs);
+
+  IndexIterator(IndexIterator&&) = default;
+
+  IndexIterator& operator=(IndexIterator&&) = default;
+
+  ~IndexIterator();
+
+  bool Valid() const {
+    return iter_ != nullptr;
+  }
+
+  // REQUIRES: Valid()
+  Slice Key() const;
+
+  // The handle of the data block.
+  // REQUIRES: Valid()
+  Slice Value() const;
+
+  // The following positioning methods leave the iterator at the end if a
+  // partition fails to be read, and return the error.
+
+  Status SeekToFirst();
+
+  Status SeekToLast();
+
+  // Positions at the first entry not less than key.
+  Status Seek(const Slice& key);
+
+  // REQUIRES: Valid()
+  Status Next();
+
+  // Moves to the end if it's at the first entry.
+  // REQUIRES: Valid()
+  Status Prev();
+
+ private:
+  // Read the partition pointed to by top_iter_ into partition_ and block_.
+  Status readPartition();
+
+  // Positions iter_ in block_ at it, or at the end if it's the end of
+  // block_.
+  void setIter(const BlockConstIterator& it);
+
+ private:
+  const SSTable* table_;
+
+  // The top-level index entry of partition_, if the index is partitioned.
+  std::unique_ptr<BlockConstIterator> top_iter_;
+
+  // The partition iter_ is iterating over, if the index is partitioned.
+  boost::intrusive_ptr<Block> partition_;
+
+  // The block iter_ is iterating over, which is partition_, or the index
+  // block owned by the table if it's not partitioned.
+  const Block* block_;
+
+  // nullptr at the end.
+  std::unique_ptr<BlockConstIterator> iter_;
+};
 
 using TwoLevelIteratorFacade =
-    IteratorFacadeNoValueType<TwoLevelIterator, ForwardIteratorTag, true>;
+    IteratorFacadeNoValueType<TwoLevelIterator, BidirectionalIteratorTag, true>;
 
 class TwoLevelIterator : public TwoLevelIteratorFacade {
   // intentionally copyable
@@ -62,15 +139,40 @@ class TwoLevelIterator : public TwoLevelIteratorFacade {
 
   Slice Value() const;
 
+  // The error that has ended the iteration, if any. The iterator is at the
+  // end when it's not ok.
+  Status Stat() const {
+    return stat_;
+  }
+
  private:
   TwoLevelIterator(BlockConstIterator* data_iter,
-                   BlockConstIterator* index_iter, const SSTable* table);
+                   const IndexIterator& index_iter, const SSTable* table);
 
-  TwoLevelIterator() = default;
+  // The past-the-end iterator of table, which can be decremented.
+  explicit TwoLevelIterator(const SSTable* table = nullptr)
+      : index_iter_(table), table_(table) {}
 
+  // Sequential scans prefetch the blocks ahead (@see readahead).
+  // @MayGenerateErrorStatus.
   void increment();
 
-  // void decrement();
+  // @MayGenerateErrorStatus.
+  void decrement();
+
+  // Called before the data block of index_iter_ is read by increment. Once
+  // kMinSequentialReads blocks have been read in a row, the next
+  // readahead_.size bytes are prefetched whenever the block goes past the
+  // range prefetched last time, and the size is doubled up to
+  // Options::max_auto_readahead_size.
+  void readahead();
+
+  // Positions at the last record of the data block pointed to by idx_it, or
+  // at the end if the block can't be read.
+  void seekToLastOfBlock(const IndexIterator& idx_it);
+
+  // Turns into the end iterator, keeping the error of s.
+  void setEnd(const Status& s);
 
   bool equal(const TwoLevelIterator& other) const;
 
@@ -78,9 +180,20 @@ class TwoLevelIterator : public TwoLevelIteratorFacade {
 
  private:
   std::unique_ptr<BlockConstIterator> data_iter_;
-  std::unique_ptr<BlockConstIterator> index_iter_;
+  IndexIterator index_iter_;
   boost::intrusive_ptr<const Block> block_;
   const SSTable* table_;
+  Status stat_;
+
+  struct Readahead {
+    uint64_t next_offset;      // the block after the last one read
+    int num_sequential_reads;  // blocks read in a row
+    size_t size;               // the size of the next prefetch
+    uint64_t limit;            // the end of the last prefetch
+
+    Readahead() : next_offset(0), num_sequential_reads(0), size(0), limit(0) {}
+  };
+  Readahead readahead_;
 };
 
 // SSTable, short for Sorted String Table, is an on-disk storage format
@@ -105,39 +218,81 @@ class SSTable {
   static SSTable* Open(const Options& options, RandomAccessFile* file,
                        uint64_t file_size, Status& s);
 
+  friend class IndexIterator;
   friend class TwoLevelIterator;
   typedef TwoLevelIterator ConstIterator;
 
-  // NOTE: begin() != end() when sstable is empty.
-  // @MayGenerateErrorStatus.
+  // begin() == end() when sstable is empty, though it has an (empty) data
+  // block.
+  // @MayGenerateErrorStatus, in the returned iterator.
   ConstIterator begin() const;
 
   ConstIterator end() const;
 
   // Searches the record with specified key in data blocks.
-  // @MayGenerateErrorStatus.
+  // @MayGenerateErrorStatus, in the returned iterator.
   ConstIterator find(const Slice& key) const;
 
-  Status Stat() const {
-    return stat_;
-  }
+  // Positions *iter at the first record not less than key, or end() if
+  // there's none.
+  Status Seek(const Slice& key, ConstIterator* iter) const;
 
-  // @MayGenerateErrorStatus.
-  Block* ObtainBlockByIndexIterator(const BlockConstIterator& it) const;
+  // Like Seek, but for n keys in ascending order, positioning iters[i] for
+  // keys[i]. Keys in the same data block share a single index search and a
+  // single read of the block.
+  Status MultiSeek(size_t n, const Slice* keys, ConstIterator* iters) const;
+
+  // Returns false if the filter of the table tells that key is not in the
+  // table, true otherwise, or if the table has no filter of
+  // Options::filter_strategy. The filter is probed by the user key of key
+  // (@see Comparator::UserKey).
+  bool KeyMayMatch(const Slice& key) const;
+
+  // Like KeyMayMatch, for a prefix of user keys extracted by
+  // Options::prefix_extractor.
+  bool PrefixMayMatch(const Slice& prefix) const;
+
+  // Read the data block pointed to by it into *block.
+  Status ObtainBlockByIndexIterator(const IndexIterator& it,
+                                    boost::intrusive_ptr<Block>* block) const;
 
   SSTable() = default;
 
  public:
   const Block* TEST_GetIndexBlock() const;
 
+ private:
+  // Load the filter blocks of Options::filter_strategy and
+  // Options::prefix_extractor, if they're in metaindex. Failures are
+  // ignored, as the filters are optional.
+  void readFilters(const Block& metaindex);
+
+  // Load the filter block of name into *filter, which is backed by *data.
+  void readFilter(const Block& metaindex, const std::string& name,
+                  Slice* filter, std::unique_ptr<char[]>* data);
+
+  // Read the block pointed to by handle_value, an encoded BlockHandle of an
+  // index entry, through the block cache if there's one.
+  Status readBlock(const Slice& handle_value,
+                   boost::intrusive_ptr<Block>* block) const;
+
  private:
   // Rather than holding the entire bunch of data blocks, an SSTable only keeps
-  // the index block.
+  // the index block, or the top-level index block if the index is
+  // partitioned.
   RandomAccessFile* file_;
   std::unique_ptr<Block> index_block_;
+  bool index_partitioned_;
   Options options_;
 
-  mutable Status stat_;
+  // Prefixes the keys of the blocks of this table in Options::block_cache.
+  uint64_t cache_id_;
+
+  // Empty if there's no filter.
+  Slice filter_;
+  std::unique_ptr<char[]> filter_data_;
+  Slice prefix_filter_;
+  std::unique_ptr<char[]> prefix_filter_data_;
 };
 
 }  // namespace lessdb
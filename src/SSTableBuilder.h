@@ -22,6 +22,9 @@
 
 #pragma once
 
+#include <string>
+#include <utility>
+#include <vector>
 #include <boost/crc.hpp>
 
 #include "Disallowcopying.h"
@@ -31,6 +34,8 @@
 #include "BlockBuilder.h"
 #include "TableFormat.h"
 #include "Comparator.h"
+#include "FilterStrategy.h"
+#include "PrefixExtractor.h"
 
 namespace lessdb {
 
@@ -43,12 +48,13 @@ class SSTableBuilder {
   // building in *file. Does not close the file.  It is up to the
   // caller to close the file after calling Finish().
   SSTableBuilder(const Options *options, WritableFile *file)
-      : data_block_(options),
+      : data_block_(options, true),
         index_block_(options),
         options_(options),
         file_(file),
         pending_index_entry_(false),
-        num_entries_(0) {}
+        num_entries_(0),
+        file_size_(0) {}
 
   // Add key,value to the table being constructed.
   // REQUIRES: key is after any previously added key according to comparator.
@@ -61,11 +67,20 @@ class SSTableBuilder {
       // pending_handle_.offset now points at index block (updated by
       // writeBlock), with pending_handle_.size indicating the size of the
       // previous data_block.
-      std::string index_value = pending_handle_.EncodeToString();
-      index_block_.Add(last_key_, index_value);
+      addIndexEntry(false);
       pending_index_entry_ = false;
     }
 
+    if (options_->filter_strategy) {
+      // The versions of a user key are put into the filters once.
+      Slice user_key = options_->comparator->UserKey(key);
+      filter_keys_.AddUnique(user_key);
+
+      const PrefixExtractor *extractor = options_->prefix_extractor;
+      if (extractor && extractor->InDomain(user_key))
+        prefix_keys_.AddUnique(extractor->Transform(user_key));
+    }
+
     num_entries_++;
     data_block_.Add(key, value);
     last_key_.assign(key.RawData(), key.Len());
@@ -77,30 +92,70 @@ class SSTableBuilder {
   }
 
   Status Finish() {
-    // flush the last data block
-    Status s = flush();
-    if (!s)
-      return s;
+    // flush the last data block, unless it's been flushed by the last Add,
+    // an empty table still has an (empty) data block.
+    Status s;
+    if (!pending_index_entry_) {
+      s = flush();
+      if (!s)
+        return s;
+    }
 
-    // recording the index information of the last data block
+    // recording the index information of the last data block, whose index
+    // key only has to be >= the last key.
+    options_->comparator->FindShortSuccessor(&last_key_);
+    addIndexEntry(true);
 
-    if (!last_key_.empty() &&
-        last_key_.back() < std::numeric_limits<char>::max())
-      last_key_.back() = static_cast<char>(last_key_.back() + 1);
-    else
-      last_key_.push_back('a');
+    // write filter blocks, the names of which are added to the metaindex
+    // block in order later.
+    std::string filter_handle, prefix_filter_handle;
+    if (options_->filter_strategy) {
+      s = writeFilterBlock(filter_keys_);
+      if (!s)
+        return s;
+      filter_handle = pending_handle_.EncodeToString();
 
-    index_block_.Add(last_key_, pending_handle_.EncodeToString());
+      if (options_->prefix_extractor) {
+        s = writeFilterBlock(prefix_keys_);
+        if (!s)
+          return s;
+        prefix_filter_handle = pending_handle_.EncodeToString();
+      }
+    }
 
     // write index block
-    s = writeBlock(&index_block_);
+    s = writeIndex();
+    if (!s)
+      return s;
+    BlockHandle index_handle = pending_handle_;
+
+    // write the metaindex block, "filter." < "index." < "prefixfilter."
+    BlockBuilder metaindex_block(options_);
+    if (!filter_handle.empty()) {
+      std::string filter_name = kFilterBlockPrefix;
+      filter_name.append(options_->filter_strategy->Name());
+      metaindex_block.Add(filter_name, filter_handle);
+    }
+    if (!index_partitions_.empty()) {
+      metaindex_block.Add(kPartitionedIndexBlockName,
+                          index_handle.EncodeToString());
+    }
+    if (!prefix_filter_handle.empty()) {
+      metaindex_block.Add(PrefixFilterBlockName(*options_),
+                          prefix_filter_handle);
+    }
+    s = writeBlock(&metaindex_block);
     if (!s)
       return s;
 
     // write footer
     Footer footer;
-    footer.index_handle = pending_handle_;
-    s = file_->Append(footer.EncodeToString());
+    footer.mataindex_handle = pending_handle_;
+    footer.index_handle = index_handle;
+    std::string footer_buf = footer.EncodeToString();
+    s = file_->Append(footer_buf);
+    if (s)
+      file_size_ += footer_buf.size();
     return s;
   }
 
@@ -108,6 +163,12 @@ class SSTableBuilder {
     return num_entries_;
   }
 
+  // Size of the file generated so far. If invoked after a successful
+  // Finish(), returns the size of the final table.
+  uint64_t FileSize() const {
+    return file_size_;
+  }
+
  private:
   // Flush the building data block to file.
   // pending_index_entry_ will be updated.
@@ -120,8 +181,79 @@ class SSTableBuilder {
     return Status::OK();
   }
 
+  // Add the index entry of the last data block, keyed by last_key_. The
+  // index partition is cut once it's full (@see
+  // Options::index_partition_size), or at the last entry if the index has
+  // been partitioned.
+  void addIndexEntry(bool last) {
+    index_block_.Add(last_key_, pending_handle_.EncodeToString());
+    size_t partition_size = options_->index_partition_size;
+    if ((partition_size > 0 && index_block_.Size() >= partition_size) ||
+        (last && !index_partitions_.empty())) {
+      index_partitions_.emplace_back(last_key_,
+                                     index_block_.Finish().ToString());
+      index_block_.Reset();
+    }
+  }
+
+  // Write the index block, or the index partitions followed by the
+  // top-level index block, which maps the last key of each partition to its
+  // handle. pending_handle_ points to the block written last.
+  Status writeIndex() {
+    if (index_partitions_.empty())
+      return writeBlock(&index_block_);
+
+    BlockBuilder top_index_block(options_);
+    for (const auto &partition : index_partitions_) {
+      Status s = writeRawBlock(partition.second);
+      if (!s)
+        return s;
+      top_index_block.Add(partition.first, pending_handle_.EncodeToString());
+    }
+    return writeBlock(&top_index_block);
+  }
+
+  // The keys put into a filter, concatenated.
+  struct FilterKeys {
+    std::string keys;
+    std::vector<size_t> starts;
+
+    size_t Size() const {
+      return starts.size();
+    }
+
+    Slice Key(size_t i) const {
+      size_t limit = (i + 1 < starts.size()) ? starts[i + 1] : keys.size();
+      return Slice(keys.data() + starts[i], limit - starts[i]);
+    }
+
+    // Adds key unless it's the same as the last one.
+    void AddUnique(const Slice &key) {
+      if (!starts.empty() && Key(starts.size() - 1).Compare(key) == 0)
+        return;
+      starts.push_back(keys.size());
+      keys.append(key.RawData(), key.Len());
+    }
+  };
+
+  // A single filter of all the keys in the table, which tells whether a key
+  // may be in the table without reading the index and data blocks.
+  Status writeFilterBlock(const FilterKeys &keys) {
+    const FilterStrategy *strategy = options_->filter_strategy;
+    std::string filter(strategy->FilterSize(keys.Size()), '\0');
+    Slice bits(&filter[0], filter.size());
+    for (size_t i = 0; i < keys.Size(); i++) {
+      strategy->Put(keys.Key(i), bits);
+    }
+    return writeRawBlock(filter);
+  }
+
   // pending_handle will be updated.
   Status writeBlock(BlockBuilder *block) {
+    return writeRawBlock(block->Finish());
+  }
+
+  Status writeRawBlock(const Slice &block_buf) {
     // Each block is followed by a trailer in the format of:
     //     compression_type: uint8
     //     crc:              uint32
@@ -129,7 +261,6 @@ class SSTableBuilder {
     Status s;
 
     // process block data
-    Slice block_buf = block->Finish();
     s = file_->Append(block_buf);
     if (!s)
       return s;
@@ -146,6 +277,7 @@ class SSTableBuilder {
     uint64_t block_size_with_trailer = block_buf.Len() + kBlockTrailerSize;
     pending_handle_.size = block_size_with_trailer;
     pending_handle_.offset += block_size_with_trailer;
+    file_size_ += block_size_with_trailer;
     //    fprintf(stderr, "pending handle size: %llu, offset %llu\n",
     //            pending_handle_.size, pending_handle_.offset);
 
@@ -176,7 +308,17 @@ class SSTableBuilder {
   bool pending_index_entry_;
   BlockHandle pending_handle_;  // Handle to add to index block
 
+  // The index partitions cut so far, with their last keys. They are written
+  // after the data blocks, so that the data blocks stay contiguous for
+  // readahead.
+  std::vector<std::pair<std::string, std::string>> index_partitions_;
+
+  // The user keys added, and their prefixes, for building the filters.
+  FilterKeys filter_keys_;
+  FilterKeys prefix_keys_;
+
   size_t num_entries_;
+  uint64_t file_size_;
 };
 
 }  // namespace lessdb
\ No newline at end of file
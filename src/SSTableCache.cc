@@ -0,0 +1,62 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "SSTableCache.h"
+#include "Block.h"
+#include "FileName.h"
+#include "FileUtils.h"
+#include "SSTable.h"
+
+namespace lessdb {
+
+SSTableCache::SSTableCache(const std::string &dbname, const Options &options)
+    : dbname_(dbname), options_(options) {}
+
+SSTableCache::~SSTableCache() = default;
+
+Status SSTableCache::FindTable(uint64_t number, uint64_t file_size,
+                               const SSTable **table) {
+  std::lock_guard<std::mutex> guard(mu_);
+  auto it = tables_.find(number);
+  if (it != tables_.end()) {
+    *table = it->second->table.get();
+    return Status::OK();
+  }
+
+  Status s;
+  std::unique_ptr<Entry> entry(new Entry());
+  std::string fname = TableFileName(dbname_, number);
+  entry->file.reset(FileFactory::Default()->NewRandomAccessFile(fname, &s));
+  if (!s)
+    return s;
+
+  entry->table.reset(
+      SSTable::Open(options_, entry->file.get(), file_size, s));
+  if (!s)
+    return s;
+
+  *table = entry->table.get();
+  tables_.emplace(number, std::move(entry));
+  return Status::OK();
+}
+
+}  // namespace lessdb
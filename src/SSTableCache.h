@@ -0,0 +1,70 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "Disallowcopying.h"
+#include "Options.h"
+#include "Status.h"
+
+namespace lessdb {
+
+class RandomAccessFile;
+class SSTable;
+
+// SSTableCache keeps the tables of a database open, so that a lookup
+// doesn't reopen the file and reload the index block each time.
+// Tables stay open until the cache is destroyed, as they are never deleted
+// from the database.
+class SSTableCache {
+  __DISALLOW_COPYING__(SSTableCache);
+
+ public:
+  // The tables are opened with options (@see SSTable::Open).
+  SSTableCache(const std::string &dbname, const Options &options);
+
+  ~SSTableCache();
+
+  // Sets *table to the table of number, which is file_size bytes long. The
+  // table is owned by the cache. Thread-safe.
+  Status FindTable(uint64_t number, uint64_t file_size, const SSTable **table);
+
+ private:
+  struct Entry {
+    std::unique_ptr<RandomAccessFile> file;
+    std::unique_ptr<SSTable> table;
+  };
+
+ private:
+  const std::string dbname_;
+  const Options options_;
+
+  std::mutex mu_;
+  std::unordered_map<uint64_t, std::unique_ptr<Entry>> tables_;
+};
+
+}  // namespace lessdb
@@ -22,11 +22,14 @@
 
 #pragma once
 
+#include <algorithm>
 #include <atomic>
 #include <cassert>
 #include <folly/Arena.h>
 #include <functional>
 #include <random>
+#include <type_traits>
+#include <utility>
 
 #include "Disallowcopying.h"
 #include "IteratorFacade.h"
@@ -35,6 +38,87 @@ namespace lessdb {
 
 using folly::SysArena;
 
+namespace internal {
+
+// HasKeyPrefix<Compare, T>::value is true iff Compare provides
+//   uint64_t Prefix(const T &key) const;
+template <class Compare, class T> struct HasKeyPrefix {
+ private:
+  template <class C>
+  static auto test(int) -> decltype(
+      std::declval<const C &>().Prefix(std::declval<const T &>()),
+      std::true_type());
+
+  template <class C> static std::false_type test(...);
+
+ public:
+  static constexpr bool value = decltype(test<Compare>(0))::value;
+};
+
+// The key prefix stored in SkipList nodes, which is empty unless Compare
+// provides a prefix.
+template <class Comp, class T, bool = HasKeyPrefix<Comp, T>::value>
+struct SkipListKeyPrefix {
+  SkipListKeyPrefix(const Comp &, const T &) {}
+
+  SkipListKeyPrefix() = default;
+
+  // Returns 0 if the order can't be told by prefixes.
+  int Compare(const SkipListKeyPrefix &) const {
+    return 0;
+  }
+};
+
+template <class Comp, class T> struct SkipListKeyPrefix<Comp, T, true> {
+  uint64_t prefix;
+
+  SkipListKeyPrefix(const Comp &compare, const T &key)
+      : prefix(compare.Prefix(key)) {}
+
+  SkipListKeyPrefix() : prefix(0) {}
+
+  int Compare(const SkipListKeyPrefix &other) const {
+    if (prefix < other.prefix)
+      return -1;
+    if (prefix > other.prefix)
+      return +1;
+    return 0;
+  }
+};
+
+// The key of a SkipList node, followed by its prefix unless the prefix is
+// empty, so that the nodes of a Compare without a prefix take no more bytes
+// than the key.
+template <class T, class KeyPrefix, bool = std::is_empty<KeyPrefix>::value>
+struct SkipListNodeKey {
+  const T key;
+
+ private:
+  // Placed next to the forward links of the node, so that comparing with
+  // the prefix touches only the cache line that's loaded for the links.
+  const KeyPrefix prefix_;
+
+ public:
+  SkipListNodeKey(const T &k, const KeyPrefix &p) : key(k), prefix_(p) {}
+
+  const KeyPrefix &Prefix() const {
+    return prefix_;
+  }
+};
+
+template <class T, class KeyPrefix>
+struct SkipListNodeKey<T, KeyPrefix, true> {
+  const T key;
+
+  SkipListNodeKey(const T &k, const KeyPrefix &) : key(k) {}
+
+  KeyPrefix Prefix() const {
+    return KeyPrefix();
+  }
+};
+
+}  // namespace internal
+
 /**
  * SkipLists are a probabilistic balanced data structure.
  * This implementation is based on the paper
@@ -50,13 +134,23 @@ using folly::SysArena;
  *  == 0 iff a == b,
  *  > 0 iff a > b
  *
+ * Compare may optionally provide a normalized key prefix by defining
+ *   uint64_t Prefix(const T &key) const;
+ * which must be consistent with the order, i.e. Prefix(a) < Prefix(b)
+ * implies a < b. The prefix is stored inline in each node, so that most of
+ * the comparisons during a search are resolved without dereferencing the
+ * key. A Compare that cannot provide a meaningful prefix may return a
+ * constant.
+ *
  * SkipList is designed to be used in the situations where only single writer is
- * running, with multiple readers reading concurrently.
+ * running, with multiple readers reading concurrently. InsertConcurrently
+ * allows multiple writers to insert simultaneously, as long as the Arena is
+ * thread-safe (@see ConcurrentArena).
  *
  * SkipList is the internal data structure of MemTable.
  *
  */
-template <class T, class Compare> class SkipList {
+template <class T, class Compare, class Arena = SysArena> class SkipList {
   __DISALLOW_COPYING__(SkipList);
 
  public:
@@ -65,6 +159,8 @@ template <class T, class Compare> class SkipList {
  private:
   struct Node;
 
+  typedef internal::SkipListKeyPrefix<Compare, T> KeyPrefix;
+
   static const unsigned kMaxLevel = 12;
 
   using ConstIteratorFacade =
@@ -106,12 +202,40 @@ template <class T, class Compare> class SkipList {
   };
 
  public:
-  explicit SkipList(SysArena *arena, const Compare &compare = Compare());
+  explicit SkipList(Arena *arena, const Compare &compare = Compare());
+
+  // InsertHint remembers the position of the last insertion made with it.
+  // If the next key goes right after the last one, which is common for
+  // appends at the tail or runs of sorted keys, Insert with the hint locates
+  // the position in O(1) instead of searching from head_.
+  // A hint can only be used with the SkipList that creates it.
+  class InsertHint {
+    friend class SkipList;
+
+   public:
+    InsertHint() {
+      std::fill(prev_, prev_ + kMaxLevel, nullptr);
+    }
+
+   private:
+    // prev_[i] is the last node before the hinted position at level i,
+    // or nullptr if unknown.
+    Node *prev_[kMaxLevel];
+  };
 
   // Insert does not require external synchronization with
   // only single writer running, it's safe with concurrent
   // readers.
-  ConstIterator Insert(const T &key);
+  // If hint is non-null, it's used to locate the position of key, and is
+  // updated to the position right after key.
+  ConstIterator Insert(const T &key, InsertHint *hint = nullptr);
+
+  // Like Insert, but safe with other concurrent writers calling
+  // InsertConcurrently. The nodes are linked in with CAS on each level,
+  // from bottom to top.
+  // NOTE: It's not safe to call Insert and InsertConcurrently at the same
+  // time.
+  ConstIterator InsertConcurrently(const T &key);
 
   bool Empty() const noexcept {
     return Begin() == End();
@@ -142,14 +266,31 @@ template <class T, class Compare> class SkipList {
 
   int randomLevel();
 
-  int random();
+  // Fill update[0, height) with the predecessors of key from hint.
+  // Returns false if the hinted position doesn't fit key on any of the
+  // levels.
+  bool spliceFromHint(const T &key, const KeyPrefix &prefix,
+                      const InsertHint &hint, int height,
+                      Node **update) const;
+
+  // Find the splice of key at the given level, starting from node before,
+  // which must be (or be null and) less than key: *prev < key <= *next.
+  void findSpliceForLevel(const T &key, const KeyPrefix &prefix, Node *before,
+                          int level, Node **prev, Node **next) const;
+
+  // Three-way comparison between the key of node n and key, whose prefix is
+  // given. The full keys are compared only if the prefixes are equal.
+  int compareNode(const Node *n, const T &key, const KeyPrefix &prefix) const {
+    int r = n->Prefix().Compare(prefix);
+    return r != 0 ? r : compare_(n->key, key);
+  }
 
-  Node *createNode(const T &key, int height) {
+  Node *createNode(const T &key, const KeyPrefix &prefix, int height) {
     size_t sz = sizeof(Node) + sizeof(std::atomic<Node *>) * (height - 1);
     void *mem = nullptr;
     mem = arena_->allocate(sz);
     // perform proper initialization
-    return new (mem) Node(key);
+    return new (mem) Node(key, prefix);
   }
 
  private:
@@ -158,18 +299,16 @@ template <class T, class Compare> class SkipList {
   std::atomic<int> height_;
   Compare compare_;
 
-  // random number ranges in [0, 3]
-  std::default_random_engine gen_;
-  std::uniform_int_distribution<int> distrib_;
-
-  SysArena *const arena_;
+  Arena *const arena_;
 };
 
-template <class T, class Compare> struct SkipList<T, Compare>::Node {
-  const T key;
+template <class T, class Compare, class Arena>
+struct SkipList<T, Compare, Arena>::Node
+    : public internal::SkipListNodeKey<T, KeyPrefix> {
   std::atomic<Node *> forward[1];
 
-  Node(const T &k) : key(k) {}
+  Node(const T &k, const KeyPrefix &p)
+      : internal::SkipListNodeKey<T, KeyPrefix>(k, p) {}
 
   Node *Next(int level) const {
     // observe an fully initialized version of the pointer.
@@ -191,44 +330,82 @@ template <class T, class Compare> struct SkipList<T, Compare>::Node {
   void NoSyncSetNext(Node *next, int level) {
     forward[level].store(next, std::memory_order_relaxed);
   }
+
+  // Link next at the given level iff the current link is still expected.
+  bool CASNext(Node *expected, Node *next, int level) {
+    return forward[level].compare_exchange_strong(expected, next,
+                                                  std::memory_order_acq_rel);
+  }
 };
 
-template <class T, class Compare>
-inline int SkipList<T, Compare>::randomLevel() {
+template <class T, class Compare, class Arena>
+inline int SkipList<T, Compare, Arena>::randomLevel() {
+  // Each writer thread has its own generator, so that concurrent writers
+  // never contend on it.
+  // random number ranges in [0, 3]
+  static thread_local std::default_random_engine gen(std::random_device{}());
+  std::uniform_int_distribution<int> distrib(0, 3);
+
   int height = 1;
-  while (height < kMaxLevel && random() == 0)
+  while (height < kMaxLevel && distrib(gen) == 0)
     height++;
   return height;
 }
 
-template <class T, class Compare> inline int SkipList<T, Compare>::random() {
-  return distrib_(gen_);
+template <class T, class Compare, class Arena>
+bool SkipList<T, Compare, Arena>::spliceFromHint(const T &key,
+                                                 const KeyPrefix &prefix,
+                                                 const InsertHint &hint,
+                                                 int height,
+                                                 Node **update) const {
+  // Check from bottom to top, the higher levels are rarely needed.
+  for (int level = 0; level < height; level++) {
+    Node *prev = hint.prev_[level];
+    if (prev == nullptr)
+      return false;
+    if (prev != head_ && compareNode(prev, key, prefix) >= 0)
+      return false;
+
+    // prev->key < key <= next->key
+    Node *next = prev->Next(level);
+    if (next != nullptr && compareNode(next, key, prefix) < 0)
+      return false;
+
+    update[level] = prev;
+  }
+  return true;
 }
 
-template <class T, class Compare>
-typename SkipList<T, Compare>::ConstIterator SkipList<T, Compare>::Insert(
-    const T &key) {
+template <class T, class Compare, class Arena>
+typename SkipList<T, Compare, Arena>::ConstIterator
+SkipList<T, Compare, Arena>::Insert(const T &key, InsertHint *hint) {
   Node *update[kMaxLevel];
   Node *x = head_;
+  KeyPrefix prefix(compare_, key);
 
-  for (int level = getHeight() - 1; level >= 0; level--) {
-    Node *next = x->Next(level);
-    while (next != nullptr && compare_(next->key, key) < 0) {
-      x = next;
-      next = x->Next(level);
+  int level = randomLevel();
+  bool hinted = hint != nullptr &&
+                spliceFromHint(key, prefix, *hint, level, update);
+
+  if (!hinted) {
+    for (int i = getHeight() - 1; i >= 0; i--) {
+      Node *next = x->Next(i);
+      while (next != nullptr && compareNode(next, key, prefix) < 0) {
+        x = next;
+        next = x->Next(i);
+      }
+      // next == nullptr or x->key < key <= next->key
+      update[i] = x;
     }
-    // next == nullptr or x->key < key <= next->key
-    update[level] = x;
   }
 
-  x = x->Next(0);  // x->key >= key or x == nullptr
-  if (x != nullptr && compare_(key, x->key) == 0) {
+  x = update[0]->Next(0);  // x->key >= key or x == nullptr
+  if (x != nullptr && compareNode(x, key, prefix) == 0) {
     return ConstIterator(x);
   }
 
   assert(Find(key) == End());
 
-  int level = randomLevel();
   if (level > getHeight()) {
     for (int i = getHeight(); i < level; i++) {
       update[i] = head_;
@@ -244,7 +421,7 @@ typename SkipList<T, Compare>::ConstIterator SkipList<T, Compare>::Insert(
     height_.store(level, std::memory_order_relaxed);
   }
 
-  x = createNode(key, level);
+  x = createNode(key, prefix, level);
 
   // Intentionally repeat from bottom to top.
   for (int i = 0; i < level; i++) {
@@ -254,24 +431,114 @@ typename SkipList<T, Compare>::ConstIterator SkipList<T, Compare>::Insert(
     update[i]->SetNext(x, i);
   }
 
+  if (hint != nullptr) {
+    // The position right after x.
+    for (int i = 0; i < level; i++) {
+      hint->prev_[i] = x;
+    }
+    if (!hinted) {
+      // The higher levels are only known after a full search.
+      for (int i = level; i < kMaxLevel; i++) {
+        hint->prev_[i] = i < getHeight() ? update[i] : head_;
+      }
+    }
+  }
+
+  return ConstIterator(x);
+}
+
+template <class T, class Compare, class Arena>
+inline void SkipList<T, Compare, Arena>::findSpliceForLevel(
+    const T &key, const KeyPrefix &prefix, Node *before, int level,
+    Node **prev, Node **next) const {
+  while (true) {
+    Node *after = before->Next(level);
+    if (after == nullptr || compareNode(after, key, prefix) >= 0) {
+      *prev = before;
+      *next = after;
+      return;
+    }
+    before = after;
+  }
+}
+
+template <class T, class Compare, class Arena>
+typename SkipList<T, Compare, Arena>::ConstIterator
+SkipList<T, Compare, Arena>::InsertConcurrently(const T &key) {
+  Node *prev[kMaxLevel];
+  Node *next[kMaxLevel];
+
+  const int searched_height = getHeight();
+  Node *x = head_;
+  KeyPrefix prefix(compare_, key);
+  for (int level = searched_height - 1; level >= 0; level--) {
+    findSpliceForLevel(key, prefix, x, level, &prev[level], &next[level]);
+    x = prev[level];
+  }
+
+  if (next[0] != nullptr && compareNode(next[0], key, prefix) == 0) {
+    return ConstIterator(next[0]);
+  }
+
+  int height = randomLevel();
+  int max_height = searched_height;
+  while (height > max_height) {
+    // On failure max_height is reloaded with the latest height_.
+    if (height_.compare_exchange_weak(max_height, height,
+                                      std::memory_order_relaxed)) {
+      break;
+    }
+  }
+
+  // The levels above the height we searched with may have been populated by
+  // other writers, they are resolved by the CAS loop below starting from
+  // head_.
+  for (int level = searched_height; level < height; level++) {
+    prev[level] = head_;
+    next[level] = nullptr;
+  }
+
+  x = createNode(key, prefix, height);
+
+  // Link from bottom to top. Once x is linked at level 0 it's visible to
+  // readers, and the duplicates of key will find x there.
+  for (int i = 0; i < height; i++) {
+    while (true) {
+      if (i == 0 && next[0] != nullptr &&
+          compareNode(next[0], key, prefix) == 0) {
+        // Another writer has inserted the same key, x is abandoned in arena.
+        return ConstIterator(next[0]);
+      }
+
+      x->NoSyncSetNext(next[i], i);
+      if (prev[i]->CASNext(next[i], x, i))
+        break;
+
+      // prev[i] has been changed by another writer, which can only insert
+      // nodes between prev[i] and next[i]. Search again from prev[i].
+      findSpliceForLevel(key, prefix, prev[i], i, &prev[i], &next[i]);
+    }
+  }
+
   return ConstIterator(x);
 }
 
-template <class T, class Compare>
-inline int SkipList<T, Compare>::getHeight() const {
+template <class T, class Compare, class Arena>
+inline int SkipList<T, Compare, Arena>::getHeight() const {
   // It's ok to load height_ without synchronization.
   return height_.load(std::memory_order_relaxed);
 }
 
-template <class T, class Compare>
-typename SkipList<T, Compare>::ConstIterator SkipList<T, Compare>::LowerBound(
-    const T &key) const {
+template <class T, class Compare, class Arena>
+typename SkipList<T, Compare, Arena>::ConstIterator
+SkipList<T, Compare, Arena>::LowerBound(const T &key) const {
   Node *x = head_;
   int height = getHeight() - 1;
+  KeyPrefix prefix(compare_, key);
 
   for (int level = height; level >= 0; level--) {
     Node *next = x->Next(level);
-    while (next != nullptr && compare_(next->key, key) < 0) {
+    while (next != nullptr && compareNode(next, key, prefix) < 0) {
       x = next;
       next = x->Next(level);
     }
@@ -282,16 +549,17 @@ typename SkipList<T, Compare>::ConstIterator SkipList<T, Compare>::LowerBound(
   assert(0);
 }
 
-template <class T, class Compare>
-typename SkipList<T, Compare>::ConstIterator SkipList<T, Compare>::UpperBound(
-    const T &key) const {
+template <class T, class Compare, class Arena>
+typename SkipList<T, Compare, Arena>::ConstIterator
+SkipList<T, Compare, Arena>::UpperBound(const T &key) const {
   Node *x = head_;
   int height = getHeight() - 1;
+  KeyPrefix prefix(compare_, key);
 
   for (int level = height; level >= 0; level--) {
     Node *next = x->Next(level);
     // key >= next->key
-    while (next != nullptr && compare_(key, next->key) >= 0) {
+    while (next != nullptr && compareNode(next, key, prefix) <= 0) {
       x = next;
       next = x->Next(level);
     }
@@ -302,29 +570,26 @@ typename SkipList<T, Compare>::ConstIterator SkipList<T, Compare>::UpperBound(
   assert(0);
 }
 
-template <class T, class Compare>
-SkipList<T, Compare>::SkipList(SysArena *arena, const Compare &compare)
-    : compare_(compare),
-      height_(1),
-      arena_(arena),
-      head_(nullptr),
-      distrib_(0, 3) {
+template <class T, class Compare, class Arena>
+SkipList<T, Compare, Arena>::SkipList(Arena *arena, const Compare &compare)
+    : compare_(compare), height_(1), arena_(arena), head_(nullptr) {
   // const_cast is safe here.
   // initializer-list does not guarantee that arena_ will be well-initialized
   // before createNode (std::bad_allocation), so we must reinitialize head_.
-  (*const_cast<Node **>(&head_)) = createNode(0, kMaxLevel);
+  (*const_cast<Node **>(&head_)) = createNode(0, KeyPrefix(), kMaxLevel);
   for (int i = 0; i < kMaxLevel; i++)
     head_->SetNext(nullptr, i);
 }
 
-template <class T, class Compare>
-typename SkipList<T, Compare>::ConstIterator SkipList<T, Compare>::Find(
-    const T &key) const {
+template <class T, class Compare, class Arena>
+typename SkipList<T, Compare, Arena>::ConstIterator
+SkipList<T, Compare, Arena>::Find(const T &key) const {
   Node *x = head_;
+  KeyPrefix prefix(compare_, key);
 
   for (int level = getHeight() - 1; level >= 0; level--) {
     Node *next = x->Next(level);
-    while (next != nullptr && compare_(next->key, key) < 0) {
+    while (next != nullptr && compareNode(next, key, prefix) < 0) {
       x = next;
       next = x->Next(level);
     }
@@ -332,7 +597,7 @@ typename SkipList<T, Compare>::ConstIterator SkipList<T, Compare>::Find(
   }
 
   x = x->Next(0);  // x->key >= key or x == nullptr
-  if (x != nullptr && compare_(key, x->key) < 0)
+  if (x != nullptr && compareNode(x, key, prefix) > 0)
     return End();
   return ConstIterator(x);
 }
@@ -0,0 +1,58 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <set>
+
+#include "DBFormat.h"
+#include "Disallowcopying.h"
+
+namespace lessdb {
+
+// A Snapshot is a consistent view of the database at a point in time
+// (@see DB::GetSnapshot). Reads through a snapshot see the entries written
+// up to its sequence number, and nothing written after.
+class Snapshot {
+  __DISALLOW_COPYING__(Snapshot);
+
+ public:
+  SequenceNumber Sequence() const {
+    return sequence_;
+  }
+
+ private:
+  friend class DBImpl;
+
+  Snapshot(SequenceNumber sequence,
+           std::multiset<SequenceNumber>::iterator position)
+      : sequence_(sequence), position_(position) {}
+
+  ~Snapshot() = default;
+
+  const SequenceNumber sequence_;
+
+  // The entry of the snapshot in the list of the live snapshots.
+  const std::multiset<SequenceNumber>::iterator position_;
+};
+
+}  // namespace lessdb
@@ -20,6 +20,8 @@
  * SOFTWARE.
  */
 
+#include <cassert>
+
 #include "Status.h"
 
 namespace lessdb {
@@ -35,6 +37,9 @@ std::string Status::ToString() const {
     case kIOError:
       ret = "IOError";
       break;
+    case kNotFound:
+      ret = "NotFound";
+      break;
     default:
       ret = "Unknown ErrorCode";
   }
@@ -42,15 +47,38 @@ std::string Status::ToString() const {
 }
 
 void Status::copy(const Status &rhs) {
-  if (!rhs.info_) {
-    info_.release();
-  } else if (!info_) {
-    info_ =
-        std::unique_ptr<ErrorInfo>(new ErrorInfo(rhs.code(), rhs.info_->msg));
+  if (!rhs.info_ || rhs.info_->shared) {
+    info_.reset(rhs.info_.get());
+  } else if (!info_ || info_->shared) {
+    info_.reset(new ErrorInfo(rhs.code(), rhs.info_->msg));
   } else {
     info_->code = rhs.info_->code;
     info_->msg = rhs.info_->msg;
   }
 }
 
+Status::ErrorInfo *Status::sharedInfo(ErrorCodes code) {
+  static ErrorInfo corruption(kCorruption, Slice(), true);
+  static ErrorInfo io_error(kIOError, Slice(), true);
+  static ErrorInfo not_found(kNotFound, Slice(), true);
+  switch (code) {
+    case kCorruption:
+      return &corruption;
+    case kIOError:
+      return &io_error;
+    case kNotFound:
+      return &not_found;
+    default:
+      assert(false);
+      return nullptr;
+  }
+}
+
+Status::ErrorInfo *Status::mutableInfo() {
+  if (info_->shared) {
+    info_.reset(new ErrorInfo(code(), Slice()));
+  }
+  return info_.get();
+}
+
 }  // namespace lessdb
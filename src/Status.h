@@ -30,7 +30,7 @@ namespace lessdb {
 
 class Status {
  private:
-  enum ErrorCodes { kOK = 0, kCorruption = 1, kIOError = 2 };
+  enum ErrorCodes { kOK = 0, kCorruption = 1, kIOError = 2, kNotFound = 3 };
 
  public:
   // An empty Status will be treated as an OK status.
@@ -81,11 +81,20 @@ class Status {
     return code() == kIOError;
   }
 
+  // The key is not found, or has been deleted.
+  static Status NotFound(const Slice &msg = Slice()) {
+    return Status(kNotFound, msg);
+  }
+
+  bool IsNotFound() const {
+    return code() == kNotFound;
+  }
+
   std::string ToString() const;
 
   Status &operator<<(const char str[]) {
     if (info_) {
-      info_->msg.append(str);
+      mutableInfo()->msg.append(str);
       // It's fine for operator<< being applied to an OK Status.
     }
     return (*this);
@@ -105,26 +114,46 @@ class Status {
   }
 
  private:
+  // An error without message doesn't allocate, e.g. the NotFound of a
+  // missing key.
   Status(ErrorCodes errorCode, const Slice &msg) noexcept
-      : info_(new ErrorInfo(errorCode, msg)) {}
+      : info_(msg.Empty() ? sharedInfo(errorCode)
+                          : new ErrorInfo(errorCode, msg)) {}
 
   struct ErrorInfo {
     unsigned char code;
     std::string msg;
 
-    ErrorInfo(ErrorCodes c, const Slice &s)
-        : code(static_cast<unsigned char>(c)), msg(s.RawData(), s.Len()) {}
+    // The static ErrorInfo of a code without message is shared by all the
+    // Statuses, which never modify or delete it.
+    bool shared;
+
+    ErrorInfo(ErrorCodes c, const Slice &s, bool shared = false)
+        : code(static_cast<unsigned char>(c)),
+          msg(s.RawData(), s.Len()),
+          shared(shared) {}
   };
 
+  struct ErrorInfoDeleter {
+    void operator()(ErrorInfo *info) const {
+      if (!info->shared)
+        delete info;
+    }
+  };
+
+  static ErrorInfo *sharedInfo(ErrorCodes code);
+
+  // Returns info_, which is copied first if it's shared.
+  ErrorInfo *mutableInfo();
+
   ErrorCodes code() const {
-    assert(info_);
-    return static_cast<ErrorCodes>(info_->code);
+    return info_ ? static_cast<ErrorCodes>(info_->code) : kOK;
   }
 
   void copy(const Status &);
 
  private:
-  std::unique_ptr<ErrorInfo> info_;
+  std::unique_ptr<ErrorInfo, ErrorInfoDeleter> info_;
 };
 
 }  // namespace lessdb
\ No newline at end of file
@@ -27,9 +27,20 @@
 #include "Coding.h"
 #include "DataView.h"
 #include "Status.h"
+#include "Options.h"
+#include "FilterStrategy.h"
+#include "PrefixExtractor.h"
 
 namespace lessdb {
 
+std::string PrefixFilterBlockName(const Options &options) {
+  std::string name = kPrefixFilterBlockPrefix;
+  name.append(options.prefix_extractor->Name());
+  name.append(":");
+  name.append(options.filter_strategy->Name());
+  return name;
+}
+
 std::string BlockHandle::EncodeToString() const {
   std::string r;
   coding::AppendVar64(&r, offset);
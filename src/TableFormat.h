@@ -22,6 +22,7 @@
 
 #pragma once
 
+#include "Hash.h"
 #include "Slice.h"
 
 namespace lessdb {
@@ -52,6 +53,11 @@ struct BlockHandle {
 
 struct BlockContent {
   Slice data;
+
+  // True iff data is allocated by new[] and owned by the block.
+  bool heap_allocated;
+
+  BlockContent() : heap_allocated(false) {}
 };
 
 // kTableMagicNumber was picked by running
@@ -65,6 +71,42 @@ static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 // @see TableBuilder::writeBlock
 static const uint64_t kBlockTrailerSize = 5;
 
+// The hash index of a data block maps the hash of each user key to the
+// index of the restart interval in which the key first appears, or to one of
+// the following markers. The highest bit of num_restarts tells whether a
+// block has the index. @see BlockBuilder
+static const uint8_t kBlockHashNoEntry = 255;
+static const uint8_t kBlockHashCollision = 254;
+static const uint32_t kBlockHashMaxRestarts = 253;
+static const uint32_t kBlockHashIndexFlag = 1u << 31;
+
+// The hash of user_key in the hash index of a data block. The index is
+// persisted, so the hash must be the same everywhere.
+inline uint32_t BlockHash(const Slice &user_key) {
+  return Hash(user_key.RawData(), user_key.Len(), 0);
+}
+
+// The metaindex block maps the name of each meta block to its handle. The
+// filter block of a table is named kFilterBlockPrefix followed by the name
+// of the filter strategy (@see FilterStrategy::Name).
+static const char kFilterBlockPrefix[] = "filter.";
+
+// The prefix filter of a table, built by Options::prefix_extractor, is named
+// kPrefixFilterBlockPrefix followed by the names of the prefix extractor
+// and the filter strategy, separated by a colon.
+static const char kPrefixFilterBlockPrefix[] = "prefixfilter.";
+
+// A table with a partitioned index (@see Options::index_partition_size) has
+// kPartitionedIndexBlockName in its metaindex block, pointing to the
+// top-level index block, which is the index block of the footer as well.
+static const char kPartitionedIndexBlockName[] = "index.partitioned";
+
+struct Options;
+
+// The name of the prefix filter of options in the metaindex block.
+// REQUIRES: options.prefix_extractor and options.filter_strategy are set.
+std::string PrefixFilterBlockName(const Options &options);
+
 // Footer encapsulates the fixed information stored at the tail
 // end of every table file.
 // The information contains the BlockHandle of the metaindex and index blocks as
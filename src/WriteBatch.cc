@@ -29,6 +29,8 @@ namespace lessdb {
 
 WriteBatch::WriteBatch() : pImpl_(new WriteBatchImpl()) {}
 
+WriteBatch::~WriteBatch() = default;
+
 void WriteBatch::Put(const Slice &key, const Slice &value) {
   pImpl_->PutRecord(key, value);
 }
@@ -37,6 +39,10 @@ void WriteBatch::Delete(const Slice &key) {
   pImpl_->DeleteRecord(key);
 }
 
+void WriteBatch::Clear() {
+  pImpl_->Clear();
+}
+
 Status WriteBatch::Iterate(WriteBatch::Handler *handler) const {
   return pImpl_->Iterate(handler);
 }
@@ -44,23 +50,59 @@ Status WriteBatch::Iterate(WriteBatch::Handler *handler) const {
 // used for WriteBatch::InsertInto
 class MemTableInserter : public WriteBatch::Handler {
  public:
-  MemTableInserter(MemTable *table) : table_(table), seq_(0) {}
+  // The hint is not worth it for single-entry batches, which always search
+  // from the head of the memtable.
+  MemTableInserter(MemTable *table, SequenceNumber seq, int batch_count,
+                   bool concurrently)
+      : table_(table),
+        seq_(seq),
+        concurrently_(concurrently),
+        sorted_(!concurrently && batch_count > 1),
+        count_(0),
+        hint_(nullptr) {}
 
   void Put(const Slice &key, const Slice &value) override {
-    table_->Add(seq_++, kTypeValue, key, value);
+    add(kTypeValue, key, value);
   }
 
   void Delete(const Slice &key) override {
-    table_->Add(seq_++, kTypeDeletion, key, Slice());
+    add(kTypeDeletion, key, Slice());
+  }
+
+ private:
+  void add(ValueType type, const Slice &key, const Slice &value) {
+    // As long as the keys of the batch are in strictly increasing order, each
+    // entry goes right after the previous one in the memtable, so the
+    // position can be located with the hint in O(1).
+    if (sorted_ && count_ > 0 &&
+        table_->UserComparator()->Compare(last_key_, key) >= 0) {
+      sorted_ = false;
+    }
+    last_key_ = key;
+    count_++;
+
+    if (sorted_) {
+      table_->Add(seq_++, type, key, value, &hint_);
+    } else {
+      table_->Add(seq_++, type, key, value, concurrently_);
+    }
   }
 
  private:
   SequenceNumber seq_;
   MemTable *table_;
+  bool concurrently_;
+
+  // Keys are valid during WriteBatch::Iterate.
+  bool sorted_;
+  Slice last_key_;
+  int count_;
+  MemTable::InsertHint hint_;
 };
 
-Status WriteBatch::InsertInto(MemTable *table) {
-  MemTableInserter inserter(table);
+Status WriteBatch::InsertInto(MemTable *table, bool concurrently) {
+  MemTableInserter inserter(table, pImpl_->Sequence(), pImpl_->Count(),
+                            concurrently);
   return pImpl_->Iterate(&inserter);
 }
 
@@ -32,6 +32,7 @@ namespace lessdb {
 class Status;
 class MemTable;
 class WriteBatchImpl;
+class DBImpl;
 
 /**
  * WriteBatch holds a collection of updates.
@@ -42,6 +43,8 @@ class WriteBatch {
  public:
   WriteBatch();
 
+  ~WriteBatch();
+
   // Store the element (key, value) into database.
   void Put(const Slice &key, const Slice &value);
 
@@ -49,6 +52,9 @@ class WriteBatch {
   // Internally, a "tombstone" record is appended for deletes.
   void Delete(const Slice &key);
 
+  // Clear all updates buffered in this batch.
+  void Clear();
+
   // WriteBatch::Handler provides interfaces to iterate the
   // contents of WriteBatch, and for each of the updates, do
   // the corresponding operation.
@@ -63,10 +69,16 @@ class WriteBatch {
   // Status::Corruptions
   Status Iterate(Handler *handler) const;
 
-  // Insert contents of this WriteBatch into MemTable.
-  Status InsertInto(MemTable *table);
+  // Insert contents of this WriteBatch into MemTable, the records are
+  // numbered starting from the sequence number of this batch.
+  // @see MemTable::Add for concurrently.
+  Status InsertInto(MemTable *table, bool concurrently = false);
 
  private:
+  // DBImpl assigns sequence numbers to the batch and merges batches of
+  // concurrent writers into a single log record.
+  friend class DBImpl;
+
   std::unique_ptr<WriteBatchImpl> pImpl_;
 };
 
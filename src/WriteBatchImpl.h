@@ -66,6 +66,39 @@ class WriteBatchImpl {
     DataView(&bytes_[kSeqSize]).WriteNum(count);
   }
 
+  // The sequence number of the first record in this batch.
+  SequenceNumber Sequence() const {
+    return ConstDataView(&bytes_[0]).ReadNum<SequenceNumber>();
+  }
+
+  void SetSequence(SequenceNumber seq) {
+    DataView(&bytes_[0]).WriteNum(seq);
+  }
+
+  // The encoded batch, which is exactly what's written into the log.
+  Slice Contents() const {
+    return Slice(bytes_);
+  }
+
+  size_t ByteSize() const {
+    return bytes_.size();
+  }
+
+  void Clear() {
+    bytes_.clear();
+    bytes_.resize(kHeaderSize);
+  }
+
+  // Replace the batch with contents, which is typically a record read from
+  // the log.
+  Status SetContents(const Slice &contents) {
+    if (UNLIKELY(contents.Len() < kHeaderSize)) {
+      return Status::Corruption("malformed WriteBatch (too small)");
+    }
+    bytes_.assign(contents.RawData(), contents.Len());
+    return Status::OK();
+  }
+
   void PutRecord(const Slice &key, const Slice &value) {
     SetCount(Count() + 1);  // count++
     bytes_.push_back(static_cast<char>(kTypeValue));
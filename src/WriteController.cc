@@ -0,0 +1,68 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <algorithm>
+
+#include "WriteController.h"
+
+namespace lessdb {
+
+void WriteController::SetDelayedWriteRate(uint64_t rate) {
+  if (rate == 0 || delayed_write_rate_ == 0) {
+    // Start over, the credit earned before the slowdown doesn't count.
+    credit_ = 0;
+    last_refill_ = 0;
+  }
+  delayed_write_rate_ = rate;
+}
+
+uint64_t WriteController::GetDelay(uint64_t now_micros, uint64_t num_bytes) {
+  if (delayed_write_rate_ == 0) {
+    return 0;
+  }
+
+  // last_refill_ is the time the credit has been earned up to, which may be
+  // ahead of now_micros if the delayed writes haven't finished sleeping.
+  if (now_micros > last_refill_) {
+    if (last_refill_ != 0) {
+      uint64_t max_credit = delayed_write_rate_ * kMaxBurstMicros / 1000000;
+      uint64_t refill =
+          (now_micros - last_refill_) * delayed_write_rate_ / 1000000;
+      credit_ = std::min(credit_ + refill, std::max(max_credit, num_bytes));
+    }
+    last_refill_ = now_micros;
+  }
+
+  if (credit_ >= num_bytes) {
+    credit_ -= num_bytes;
+    return 0;
+  }
+
+  // The write waits until the missing credit is earned, after those
+  // delayed before it.
+  uint64_t needed = (num_bytes - credit_) * 1000000 / delayed_write_rate_;
+  credit_ = 0;
+  last_refill_ += std::max<uint64_t>(needed, 1);
+  return last_refill_ - now_micros;
+}
+
+}  // namespace lessdb
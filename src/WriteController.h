@@ -0,0 +1,85 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#pragma once
+
+#include <cstdint>
+
+#include "Disallowcopying.h"
+
+namespace lessdb {
+
+// Counters of the time writes have spent in stalls.
+struct WriteStallStats {
+  // Writes slowed down by the write controller, and the total time they
+  // were delayed.
+  uint64_t delayed_writes;
+  uint64_t delay_micros;
+
+  // Writes stopped until the pressure went away, and the total time they
+  // were stopped.
+  uint64_t stopped_writes;
+  uint64_t stop_micros;
+
+  WriteStallStats()
+      : delayed_writes(0), delay_micros(0), stopped_writes(0), stop_micros(0) {}
+};
+
+// WriteController paces the writes at a delayed write rate with a token
+// bucket: writes consume the credit refilled at the rate, and the ones
+// running out of credit are delayed until they've earned it. Short bursts
+// pass through, while the throughput is bounded by the rate, and each write
+// is delayed a little rather than stopped for long.
+//
+// Not thread-safe, the callers synchronize (@see DBImpl::makeRoomForWrite).
+class WriteController {
+  __DISALLOW_COPYING__(WriteController);
+
+ public:
+  WriteController() : delayed_write_rate_(0), credit_(0), last_refill_(0) {}
+
+  // Writes are delayed to rate bytes per second, 0 ends the slowdown.
+  void SetDelayedWriteRate(uint64_t rate);
+
+  bool IsDelayed() const {
+    return delayed_write_rate_ > 0;
+  }
+
+  uint64_t delayed_write_rate() const {
+    return delayed_write_rate_;
+  }
+
+  // Consume the credit of a write of num_bytes at now_micros, and return
+  // the microseconds it has to be delayed.
+  uint64_t GetDelay(uint64_t now_micros, uint64_t num_bytes);
+
+ private:
+  // Credit is accumulated up to this many microseconds of the rate, which
+  // bounds the burst after a pause.
+  static constexpr uint64_t kMaxBurstMicros = 1000;
+
+  uint64_t delayed_write_rate_;
+  uint64_t credit_;  // in bytes
+  uint64_t last_refill_;
+};
+
+}  // namespace lessdb
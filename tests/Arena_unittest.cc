@@ -0,0 +1,117 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "Arena.h"
+#include "ConcurrentArena.h"
+
+using namespace lessdb;
+
+static bool Aligned(void *p) {
+  return reinterpret_cast<uintptr_t>(p) % Arena::kAlignUnit == 0;
+}
+
+TEST(Arena, Allocate) {
+  Arena arena(4096);
+  ASSERT_EQ(arena.bytesUsed(), 0);
+
+  std::vector<std::pair<char *, size_t>> allocated;
+  for (size_t i = 0; i < 2000; i++) {
+    // Mostly small ones, with a large one once in a while.
+    size_t size = (i % 100 == 0) ? 3000 : (i % 37) + 1;
+    char *p = static_cast<char *>(arena.allocate(size));
+    ASSERT_TRUE(Aligned(p));
+    memset(p, static_cast<int>(i % 256), size);
+    allocated.emplace_back(p, size);
+  }
+
+  for (size_t i = 0; i < allocated.size(); i++) {
+    for (size_t j = 0; j < allocated[i].second; j++) {
+      ASSERT_EQ(allocated[i].first[j] & 0xff, static_cast<int>(i % 256));
+    }
+  }
+  ASSERT_GT(arena.bytesUsed(), 20 * 3000);
+}
+
+TEST(Arena, HugePage) {
+  // Works whether the huge pages are available or not.
+  const size_t kHugePageSize = 2 << 20;
+  Arena arena(4096, kHugePageSize);
+  ASSERT_EQ(arena.BlockSize(), kHugePageSize);
+
+  char *p = static_cast<char *>(arena.allocate(100));
+  memset(p, 1, 100);
+  char *q = static_cast<char *>(arena.allocate(kHugePageSize));
+  memset(q, 2, kHugePageSize);
+  ASSERT_EQ(p[99], 1);
+  ASSERT_EQ(arena.bytesUsed(), 2 * kHugePageSize);
+}
+
+TEST(ConcurrentArena, Allocate) {
+  ConcurrentArena arena(64 << 10);
+  const int kThreads = 8;
+  const int kAllocations = 20000;
+
+  std::vector<std::vector<char *>> allocated(kThreads);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < kThreads; t++) {
+    threads.emplace_back([&, t]() {
+      for (int i = 0; i < kAllocations; i++) {
+        size_t size = (i % 500 == 0) ? 5000 : (i % 13) + 1;
+        char *p = static_cast<char *>(arena.allocate(size));
+        ASSERT_TRUE(Aligned(p));
+        memset(p, t, size);
+        allocated[t].push_back(p);
+      }
+    });
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  // No allocation is overwritten by another thread.
+  for (int t = 0; t < kThreads; t++) {
+    for (int i = 0; i < kAllocations; i++) {
+      size_t size = (i % 500 == 0) ? 5000 : (i % 13) + 1;
+      for (size_t j = 0; j < size; j++) {
+        ASSERT_EQ(allocated[t][i][j], t);
+      }
+    }
+  }
+
+  // Allocations are rounded up to kAlignUnit, and the bytes held by the
+  // shards are not counted.
+  size_t requested = 0;
+  for (int i = 0; i < kAllocations; i++) {
+    size_t size = (i % 500 == 0) ? 5000 : (i % 13) + 1;
+    requested += (size + Arena::kAlignUnit - 1) / Arena::kAlignUnit *
+                 Arena::kAlignUnit;
+  }
+  requested *= kThreads;
+  ASSERT_GE(arena.bytesUsed(), requested);
+  ASSERT_LE(arena.bytesUsed(), requested + requested / 4);
+}
@@ -22,6 +22,7 @@
 
 #include <gtest/gtest.h>
 #include <map>
+#include <algorithm>
 
 #include "BlockBuilder.h"
 #include "Options.h"
@@ -29,6 +30,7 @@
 #include "TestUtils.h"
 #include "TableFormat.h"
 #include "Comparator.h"
+#include "InternalKey.h"
 
 using namespace lessdb;
 using namespace test;
@@ -79,6 +81,27 @@ TEST(Basic, Build) {
     }
     assert(block.end() == it);
 
+    for (auto it2 = table.rbegin(); it2 != table.rend(); it2++) {
+      --it;
+      ASSERT_EQ(it.Key().ToString(), it2->first);
+      ASSERT_EQ(it.Value().ToString(), it2->second);
+    }
+    ASSERT_TRUE(block.begin() == it);
+
+    // Steps back and forth from the middle.
+    if (!table.empty()) {
+      auto mid = std::next(table.begin(), table.size() / 2);
+      auto it3 = block.find(mid->first);
+      for (auto it2 = mid; it2 != table.begin();) {
+        --it2, --it3;
+        ASSERT_EQ(it3.Key().ToString(), it2->first);
+        ++it2, ++it3;
+        ASSERT_EQ(it3.Key().ToString(), it2->first);
+        --it2, --it3;
+      }
+      ASSERT_TRUE(block.begin() == it3);
+    }
+
     for (auto it2 = table.rbegin(); it2 != table.rend(); it2++) {
       if (RandomIn(0, 1) == 0) {
         ASSERT_TRUE(block.find(it2->first) != block.end());
@@ -90,4 +113,124 @@ TEST(Basic, Build) {
       }
     }
   }
-}
\ No newline at end of file
+}
+
+TEST(Basic, HashIndex) {
+  Options options;
+  options.block_restart_interval = 4;
+  options.data_block_hash_table_util_ratio = 0.75;
+  BlockBuilder builder(&options, true);
+  BlockBuilder plain_builder(&options);
+
+  std::map<std::string, std::string> table;
+  for (int i = 0; i < 200; i++) {
+    table[RandomString(RandomIn(1, 1 << 4))] = RandomString(RandomIn(0, 8));
+  }
+  for (const auto& it : table) {
+    builder.Add(it.first, it.second);
+    plain_builder.Add(it.first, it.second);
+  }
+
+  BlockContent content, plain_content;
+  content.data = builder.Finish();
+  plain_content.data = plain_builder.Finish();
+  ASSERT_GT(content.data.Len(), plain_content.data.Len());
+
+  Block block(content, options.comparator);
+  Block plain_block(plain_content, options.comparator);
+
+  auto it = block.begin();
+  for (const auto& kv : table) {
+    ASSERT_TRUE(it != block.end());
+    ASSERT_EQ(it.Key().ToString(), kv.first);
+    ++it;
+
+    ASSERT_TRUE(block.find(kv.first) != block.end());
+    ASSERT_EQ(block.find(kv.first).Value().ToString(), kv.second);
+    ASSERT_EQ(block.lower_bound(kv.first).Key().ToString(), kv.first);
+  }
+  ASSERT_TRUE(it == block.end());
+
+  // Absent keys are found by neither, and lower_bound returns the same
+  // entries as the binary search.
+  for (int i = 0; i < 1000; i++) {
+    std::string key = RandomString(RandomIn(0, 1 << 4));
+    if (table.find(key) != table.end())
+      continue;
+    ASSERT_TRUE(block.find(key) == block.end());
+
+    auto lb = block.lower_bound(key);
+    auto plain_lb = plain_block.lower_bound(key);
+    ASSERT_EQ(lb == block.end(), plain_lb == plain_block.end());
+    if (lb != block.end())
+      ASSERT_EQ(lb.Key().ToString(), plain_lb.Key().ToString());
+  }
+}
+
+TEST(Basic, HashIndexInternalKeys) {
+  InternalKeyComparator cmp(NewBytewiseComparator());
+  Options options;
+  options.comparator = &cmp;
+  options.block_restart_interval = 2;
+  options.data_block_hash_table_util_ratio = 1;
+  BlockBuilder builder(&options, true);
+
+  // Versions of a user key span several restart intervals.
+  std::vector<std::string> keys;
+  for (int i = 0; i < 20; i++) {
+    std::string user_key = "key" + std::to_string(100 + i);
+    for (SequenceNumber seq = i % 5 + 1; seq > 0; seq--) {
+      keys.push_back(InternalKeyBuf(user_key, seq * 10, kTypeValue)
+                         .Data()
+                         .ToString());
+      builder.Add(keys.back(), std::to_string(seq * 10));
+    }
+  }
+
+  BlockContent content;
+  content.data = builder.Finish();
+  Block block(content, &cmp);
+
+  for (int i = 0; i < 20; i++) {
+    std::string user_key = "key" + std::to_string(100 + i);
+    for (SequenceNumber seq = 0; seq < 60; seq += 5) {
+      LookupKey lkey(user_key, seq);
+      auto expected = std::lower_bound(
+          keys.begin(), keys.end(), lkey.Key().ToString(),
+          [&](const std::string& a, const std::string& b) {
+            return cmp.Compare(a, b) < 0;
+          });
+      auto it = block.lower_bound(lkey.Key());
+      ASSERT_EQ(it == block.end(), expected == keys.end());
+      if (it != block.end())
+        ASSERT_EQ(it.Key().ToString(), *expected);
+    }
+  }
+  ASSERT_TRUE(block.find(InternalKeyBuf("key099", 10, kTypeValue).Data()) ==
+              block.end());
+}
+
+// The hash index is persisted, the buckets of the same keys must be the
+// same on every platform and build.
+TEST(Basic, StableHashIndex) {
+  Options options;
+  options.block_restart_interval = 2;
+  options.data_block_hash_table_util_ratio = 1;
+  BlockBuilder builder(&options, true);
+  for (const char* key : {"apple", "banana", "cherry", "date", "elder", "fig",
+                          "grape", "honey"}) {
+    builder.Add(key, "value");
+  }
+
+  // The buckets are followed by num_buckets and num_restarts.
+  Slice data = builder.Finish();
+  size_t num_buckets =
+      ConstDataView(data.RawData() + data.Len() - 6).ReadNum<uint16_t>();
+  ASSERT_EQ(num_buckets, 8);
+  std::string buckets(data.RawData() + data.Len() - 6 - num_buckets,
+                      num_buckets);
+  ASSERT_EQ(buckets, std::string("\x01\xfe\xfe\xff\x01\xff\xff\xfe", 8));
+
+  ASSERT_EQ(BlockHash("apple"), 0xa3fab0c1);
+  ASSERT_EQ(BlockHash("banana"), 0x09fdb062);
+}
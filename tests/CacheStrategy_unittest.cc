@@ -61,3 +61,23 @@ TEST(Correctness, T1) {
   val = boost::any_cast<int>(lru_strategy->Value(look));
   ASSERT_EQ(val, 3);
 }
+
+TEST(Correctness, LookupCopy) {
+  std::unique_ptr<CacheStrategy> lru_strategy(CacheStrategy::Default(2));
+  lru_strategy->Insert("1", 1);
+  lru_strategy->Insert("2", 2);
+
+  boost::any value;
+  ASSERT_TRUE(lru_strategy->Lookup("1", &value));
+  ASSERT_EQ(boost::any_cast<int>(value), 1);
+
+  // The copy outlives the eviction of its entry.
+  ASSERT_TRUE(lru_strategy->Lookup("2", &value));
+  lru_strategy->Insert("3", 3);
+  lru_strategy->Insert("4", 4);
+  ASSERT_EQ(boost::any_cast<int>(value), 2);
+  ASSERT_FALSE(lru_strategy->Lookup("1", &value));
+  ASSERT_FALSE(lru_strategy->Lookup("2", &value));
+  ASSERT_TRUE(lru_strategy->Lookup("3", &value));
+  ASSERT_EQ(boost::any_cast<int>(value), 3);
+}
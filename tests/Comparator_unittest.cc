@@ -0,0 +1,59 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include "Comparator.h"
+#include "Slice.h"
+
+using namespace lessdb;
+
+TEST(Comparator, BytewiseShortening) {
+  const Comparator *comparator = NewBytewiseComparator();
+
+  std::string start = "abcdef";
+  comparator->FindShortestSeparator(&start, "abzz");
+  ASSERT_EQ(start, "abd");
+
+  // Adjacent bytes can't be separated.
+  start = "abc";
+  comparator->FindShortestSeparator(&start, "abd");
+  ASSERT_EQ(start, "abc");
+
+  // Bytes are compared as unsigned.
+  start = std::string("a\x10", 2);
+  comparator->FindShortestSeparator(&start, std::string("a\xf0", 2));
+  ASSERT_EQ(start, std::string("a\x11", 2));
+
+  // A prefix is left alone.
+  start = "ab";
+  comparator->FindShortestSeparator(&start, "abc");
+  ASSERT_EQ(start, "ab");
+
+  std::string key = "abc";
+  comparator->FindShortSuccessor(&key);
+  ASSERT_EQ(key, "b");
+
+  key = std::string("\xff\xff", 2);
+  comparator->FindShortSuccessor(&key);
+  ASSERT_EQ(key, std::string("\xff\xff", 2));
+}
@@ -0,0 +1,826 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <boost/filesystem.hpp>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "DB.h"
+#include "DBImpl.h"
+#include "DBIterator.h"
+#include "FileUtils.h"
+#include "FilterStrategy.h"
+#include "LogWriter.h"
+#include "MemTableRep.h"
+#include "Options.h"
+#include "PrefixExtractor.h"
+#include "Snapshot.h"
+#include "WriteBatch.h"
+#include "utils/Random.h"
+
+using namespace lessdb;
+
+uint64_t DBImpl::TEST_NumWriteGroups() {
+  std::lock_guard<std::mutex> guard(mu_);
+  return num_write_groups_;
+}
+
+size_t DBImpl::TEST_NumImmutableMemTables() {
+  std::lock_guard<std::mutex> guard(mu_);
+  return imm_.size();
+}
+
+size_t DBImpl::TEST_NumLevel0Files() {
+  std::lock_guard<std::mutex> guard(mu_);
+  return level0_.size();
+}
+
+SequenceNumber DBImpl::TEST_LastSequence() {
+  std::lock_guard<std::mutex> guard(mu_);
+  return last_sequence_;
+}
+
+SequenceNumber DBImpl::TEST_SyncedSequence() {
+  std::lock_guard<std::mutex> guard(mu_);
+  return synced_sequence_;
+}
+
+// REQUIRES: Nothing has been written to the log yet.
+void DBImpl::TEST_WrapLogFile(
+    const std::function<WritableFile *(WritableFile *)> &wrap) {
+  std::lock_guard<std::mutex> guard(mu_);
+  logfile_.reset(wrap(logfile_.release()));
+  log_.reset(new log::Writer(logfile_.get(), logfile_number_,
+                             options_.recycle_log_file_num > 0));
+}
+
+class DBTest : public ::testing::Test {
+ protected:
+  DBTest() : dbname_("/tmp/lessdb_DB_unittest") {
+    boost::filesystem::remove_all(dbname_);
+    options_.write_buffer_size = 64 << 10;
+  }
+
+  ~DBTest() {
+    db_.reset();
+    boost::filesystem::remove_all(dbname_);
+  }
+
+  void DestroyAndReopen() {
+    db_.reset();
+    boost::filesystem::remove_all(dbname_);
+    Reopen();
+  }
+
+  void Reopen() {
+    db_.reset();
+    DB *db;
+    Status s = DB::Open(options_, dbname_, &db);
+    ASSERT_TRUE(s) << s.ToString();
+    db_.reset(db);
+  }
+
+  std::string Get(const std::string &key,
+                  const Snapshot *snapshot = nullptr) {
+    ReadOptions options;
+    options.snapshot = snapshot;
+    std::string value;
+    Status s = db_->Get(options, key, &value);
+    if (s.IsNotFound())
+      return "NOT_FOUND";
+    if (!s)
+      return s.ToString();
+    return value;
+  }
+
+  const std::string dbname_;
+  Options options_;
+  std::unique_ptr<DB> db_;
+};
+
+TEST_F(DBTest, Empty) {
+  Reopen();
+  ASSERT_EQ(Get("foo"), "NOT_FOUND");
+}
+
+TEST_F(DBTest, PutDeleteGet) {
+  Reopen();
+  ASSERT_TRUE(db_->Put(WriteOptions(), "foo", "v1"));
+  ASSERT_EQ(Get("foo"), "v1");
+  ASSERT_TRUE(db_->Put(WriteOptions(), "foo", "v2"));
+  ASSERT_EQ(Get("foo"), "v2");
+  ASSERT_TRUE(db_->Delete(WriteOptions(), "foo"));
+  ASSERT_EQ(Get("foo"), "NOT_FOUND");
+  ASSERT_EQ(Get("fo"), "NOT_FOUND");
+  ASSERT_EQ(Get("fooo"), "NOT_FOUND");
+
+  WriteBatch batch;
+  batch.Put("a", "va");
+  batch.Put("foo", "v3");
+  batch.Delete("a");
+  ASSERT_TRUE(db_->Write(WriteOptions(), &batch));
+  ASSERT_EQ(Get("a"), "NOT_FOUND");
+  ASSERT_EQ(Get("foo"), "v3");
+}
+
+// Overwrites and deletions spread over the memtables and level-0 tables,
+// the newest of which wins.
+TEST_F(DBTest, GetAcrossTables) {
+  Reopen();
+  std::map<std::string, std::string> model;
+  for (int i = 0; i < 20000; i++) {
+    std::string key = "key" + std::to_string(test::RandomIn(0, 1999));
+    if (test::RandomIn(0, 4) == 0) {
+      ASSERT_TRUE(db_->Delete(WriteOptions(), key));
+      model.erase(key);
+    } else {
+      std::string value = std::to_string(i) + test::RandomString(100);
+      ASSERT_TRUE(db_->Put(WriteOptions(), key, value));
+      model[key] = value;
+    }
+  }
+
+  for (int pass = 0; pass < 2; pass++) {
+    for (int k = 0; k < 2000; k++) {
+      std::string key = "key" + std::to_string(k);
+      auto it = model.find(key);
+      ASSERT_EQ(Get(key), it == model.end() ? "NOT_FOUND" : it->second);
+    }
+    ASSERT_EQ(Get("kez"), "NOT_FOUND");
+
+    // Everything is in level-0 after recovery.
+    Reopen();
+  }
+}
+
+TEST_F(DBTest, MultiGet) {
+  Reopen();
+  for (int i = 0; i < 5000; i++) {
+    std::string key = "key" + std::to_string(test::RandomIn(0, 999));
+    if (i % 7 == 0) {
+      ASSERT_TRUE(db_->Delete(WriteOptions(), key));
+    } else {
+      ASSERT_TRUE(db_->Put(WriteOptions(), key, test::RandomString(200)));
+    }
+  }
+
+  // Unsorted, duplicated, and missing keys.
+  std::vector<std::string> keys;
+  for (int i = 0; i < 300; i++) {
+    keys.push_back("key" + std::to_string(test::RandomIn(0, 1100)));
+  }
+  keys.push_back(keys.front());
+  keys.push_back("");
+
+  for (int pass = 0; pass < 2; pass++) {
+    std::vector<Slice> slices(keys.begin(), keys.end());
+    std::vector<std::string> values(keys.size());
+    std::vector<Status> statuses(keys.size());
+    db_->MultiGet(ReadOptions(), keys.size(), slices.data(), values.data(),
+                  statuses.data());
+    for (size_t i = 0; i < keys.size(); i++) {
+      if (statuses[i].IsNotFound()) {
+        ASSERT_EQ(Get(keys[i]), "NOT_FOUND");
+      } else {
+        ASSERT_TRUE(statuses[i]) << statuses[i].ToString();
+        ASSERT_EQ(Get(keys[i]), values[i]);
+      }
+    }
+    Reopen();
+  }
+}
+
+// Scans merge the memtables and level-0 tables, skipping the overwritten
+// and deleted entries.
+TEST_F(DBTest, Iterator) {
+  Reopen();
+  std::map<std::string, std::string> model;
+  for (int pass = 0; pass < 3; pass++) {
+    for (int i = 0; i < 3000; i++) {
+      std::string key = "key" + std::to_string(test::RandomIn(0, 999));
+      if (test::RandomIn(0, 3) == 0) {
+        ASSERT_TRUE(db_->Delete(WriteOptions(), key));
+        model.erase(key);
+      } else {
+        std::string value = test::RandomString(100);
+        ASSERT_TRUE(db_->Put(WriteOptions(), key, value));
+        model[key] = value;
+      }
+    }
+    // Spread the entries over several level-0 tables.
+    if (pass < 2)
+      Reopen();
+  }
+
+  std::unique_ptr<DBIterator> iter(db_->NewIterator(ReadOptions()));
+  // Invisible to iter.
+  ASSERT_TRUE(db_->Put(WriteOptions(), "key0000", "v"));
+  ASSERT_TRUE(db_->Delete(WriteOptions(), model.begin()->first));
+
+  auto it = model.begin();
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++it) {
+    ASSERT_TRUE(it != model.end());
+    ASSERT_EQ(iter->Key().ToString(), it->first);
+    ASSERT_EQ(iter->Value().ToString(), it->second);
+  }
+  ASSERT_TRUE(it == model.end());
+  ASSERT_TRUE(iter->Stat()) << iter->Stat().ToString();
+
+  for (int i = 0; i < 100; i++) {
+    std::string key = "key" + std::to_string(test::RandomIn(0, 1000));
+    iter->Seek(key);
+    auto lb = model.lower_bound(key);
+    ASSERT_EQ(iter->Valid(), lb != model.end());
+    if (iter->Valid()) {
+      ASSERT_EQ(iter->Key().ToString(), lb->first);
+      ASSERT_EQ(iter->Value().ToString(), lb->second);
+    }
+  }
+}
+
+TEST_F(DBTest, Filter) {
+  std::unique_ptr<FilterStrategy> bloom(FilterStrategy::Default(10));
+  options_.filter_strategy = bloom.get();
+  Reopen();
+  for (int i = 0; i < 5000; i += 2) {
+    ASSERT_TRUE(db_->Put(WriteOptions(), std::to_string(i),
+                         test::RandomString(100)));
+  }
+  Reopen();
+
+  std::vector<std::string> keys;
+  for (int i = 0; i < 5000; i++) {
+    keys.push_back(std::to_string(i));
+    ASSERT_EQ(Get(keys.back()) == "NOT_FOUND", i % 2 == 1);
+  }
+
+  std::vector<Slice> slices(keys.begin(), keys.end());
+  std::vector<std::string> values(keys.size());
+  std::vector<Status> statuses(keys.size());
+  db_->MultiGet(ReadOptions(), keys.size(), slices.data(), values.data(),
+                statuses.data());
+  for (size_t i = 0; i < keys.size(); i++) {
+    if (i % 2 == 1) {
+      ASSERT_TRUE(statuses[i].IsNotFound());
+    } else {
+      ASSERT_TRUE(statuses[i]) << statuses[i].ToString();
+      ASSERT_EQ(values[i], Get(keys[i]));
+    }
+  }
+}
+
+TEST_F(DBTest, PrefixScan) {
+  std::unique_ptr<FilterStrategy> bloom(FilterStrategy::Default(10));
+  std::unique_ptr<PrefixExtractor> prefix_extractor(PrefixExtractor::Fixed(4));
+  options_.filter_strategy = bloom.get();
+  options_.prefix_extractor = prefix_extractor.get();
+  Reopen();
+
+  // Each level-0 table holds its own range of prefixes "p%03d".
+  std::map<std::string, std::string> model;
+  for (int pass = 0; pass < 4; pass++) {
+    for (int i = 0; i < 1000; i++) {
+      char key[16];
+      snprintf(key, sizeof(key), "p%03d%03d", pass * 50 + i % 50, i / 50);
+      std::string value = test::RandomString(20);
+      ASSERT_TRUE(db_->Put(WriteOptions(), key, value));
+      model[key] = value;
+    }
+    Reopen();
+  }
+
+  ReadOptions read_options;
+  read_options.prefix_same_as_start = true;
+  std::unique_ptr<DBIterator> iter(db_->NewIterator(read_options));
+  for (int i = 0; i < 300; i++) {
+    char prefix[16];
+    snprintf(prefix, sizeof(prefix), "p%03d", i);
+    std::string start = std::string(prefix) + std::to_string(i % 10);
+    auto it = model.lower_bound(start);
+    for (iter->Seek(start); iter->Valid(); iter->Next(), ++it) {
+      ASSERT_TRUE(it != model.end());
+      ASSERT_EQ(iter->Key().ToString(), it->first);
+      ASSERT_EQ(iter->Value().ToString(), it->second);
+    }
+    ASSERT_TRUE(iter->Stat()) << iter->Stat().ToString();
+    // Stopped at the end of the prefix.
+    ASSERT_TRUE(it == model.end() || it->first.compare(0, 4, prefix) != 0);
+  }
+
+  // Keys out of the domain of the extractor are not bounded.
+  iter->Seek("p");
+  int n = 0;
+  for (; iter->Valid(); iter->Next())
+    n++;
+  ASSERT_EQ(n, model.size());
+
+  // Not bounded without prefix_same_as_start.
+  iter.reset(db_->NewIterator(ReadOptions()));
+  iter->Seek("p049");
+  ASSERT_TRUE(iter->Valid());
+  iter->Seek("p049999");
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(iter->Key().ToString(), "p050000");
+}
+
+// The snapshots keep seeing the versions of their time, while the keys are
+// overwritten and flushed into level-0 over and over.
+TEST_F(DBTest, Snapshot) {
+  Reopen();
+  std::vector<const Snapshot *> snapshots;
+  std::vector<std::map<std::string, std::string>> models;
+  std::map<std::string, std::string> model;
+  for (int pass = 0; pass < 5; pass++) {
+    for (int i = 0; i < 2000; i++) {
+      std::string key = "key" + std::to_string(test::RandomIn(0, 199));
+      if (test::RandomIn(0, 4) == 0) {
+        ASSERT_TRUE(db_->Delete(WriteOptions(), key));
+        model.erase(key);
+      } else {
+        std::string value = std::to_string(i) + test::RandomString(100);
+        ASSERT_TRUE(db_->Put(WriteOptions(), key, value));
+        model[key] = value;
+      }
+    }
+    snapshots.push_back(db_->GetSnapshot());
+    models.push_back(model);
+  }
+  // The snapshot of the second pass no longer holds its versions.
+  db_->ReleaseSnapshot(snapshots[1]);
+  ASSERT_TRUE(db_->Put(WriteOptions(), "key0", "latest"));
+  model["key0"] = "latest";
+
+  for (size_t i = 0; i < snapshots.size(); i++) {
+    if (i == 1)
+      continue;
+    for (int k = 0; k < 200; k++) {
+      std::string key = "key" + std::to_string(k);
+      auto it = models[i].find(key);
+      ASSERT_EQ(Get(key, snapshots[i]),
+                it == models[i].end() ? "NOT_FOUND" : it->second);
+    }
+
+    ReadOptions options;
+    options.snapshot = snapshots[i];
+    std::unique_ptr<DBIterator> iter(db_->NewIterator(options));
+    auto it = models[i].begin();
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++it) {
+      ASSERT_TRUE(it != models[i].end());
+      ASSERT_EQ(iter->Key().ToString(), it->first);
+      ASSERT_EQ(iter->Value().ToString(), it->second);
+    }
+    ASSERT_TRUE(it == models[i].end());
+    ASSERT_TRUE(iter->Stat()) << iter->Stat().ToString();
+  }
+  ASSERT_EQ(Get("key0"), "latest");
+  for (size_t i = 0; i < snapshots.size(); i++) {
+    if (i != 1)
+      db_->ReleaseSnapshot(snapshots[i]);
+  }
+
+  // Without the snapshots, only the latest versions survive.
+  Reopen();
+  for (int k = 0; k < 200; k++) {
+    std::string key = "key" + std::to_string(k);
+    auto it = model.find(key);
+    ASSERT_EQ(Get(key), it == model.end() ? "NOT_FOUND" : it->second);
+  }
+}
+
+// Concurrent writers are committed in groups, and none of the writes is lost,
+// either before or after the logs are replayed.
+TEST_F(DBTest, GroupCommit) {
+  const int kThreads = 8;
+  const int kWrites = 300;
+  auto key_of = [](int t, int i) {
+    return std::to_string(t) + "." + std::to_string(i);
+  };
+  {
+    DBImpl impl(options_, dbname_);
+    ASSERT_TRUE(impl.Open());
+
+    std::vector<std::thread> writers;
+    for (int t = 0; t < kThreads; t++) {
+      writers.emplace_back([&, t]() {
+        WriteOptions options;
+        options.sync = true;
+        for (int i = 0; i < kWrites; i++) {
+          WriteBatch batch;
+          batch.Put(key_of(t, i), std::to_string(i));
+          ASSERT_TRUE(impl.Write(options, &batch));
+        }
+      });
+    }
+    for (auto &writer : writers) {
+      writer.join();
+    }
+    ASSERT_LT(impl.TEST_NumWriteGroups(), kThreads * kWrites);
+
+    for (int t = 0; t < kThreads; t++) {
+      for (int i = 0; i < kWrites; i++) {
+        std::string value;
+        ASSERT_TRUE(impl.Get(ReadOptions(), key_of(t, i), &value));
+        ASSERT_EQ(value, std::to_string(i));
+      }
+    }
+  }
+
+  Reopen();
+  for (int t = 0; t < kThreads; t++) {
+    for (int i = 0; i < kWrites; i++) {
+      ASSERT_EQ(Get(key_of(t, i)), std::to_string(i));
+    }
+  }
+}
+
+// In pipelined mode, the groups are published in the order of their
+// sequence numbers: a reader never sees a write without the ones before it,
+// and the last sequence number ends up covering all the writes.
+TEST_F(DBTest, PipelinedWrite) {
+  const int kThreads = 4;
+  const int kWrites = 500;
+  options_.enable_pipelined_write = true;
+  for (bool concurrent_insert : {false, true}) {
+    options_.allow_concurrent_memtable_write = concurrent_insert;
+    DestroyAndReopen();
+
+    std::atomic<int> running(kThreads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+      threads.emplace_back([&, t]() {
+        for (int i = 0; i < kWrites; i++) {
+          // Each batch updates the counter of the thread, and adds the
+          // key of the count.
+          WriteBatch batch;
+          batch.Put("counter" + std::to_string(t), std::to_string(i));
+          batch.Put(std::to_string(t) + "." + std::to_string(i), "v");
+          ASSERT_TRUE(db_->Write(WriteOptions(), &batch));
+        }
+        running--;
+      });
+    }
+
+    // The counters seen through the snapshots never go backwards, and the
+    // keys written along with them are visible as well.
+    std::vector<int> counters(kThreads, -1);
+    SequenceNumber last = 0;
+    while (running > 0) {
+      const Snapshot *snapshot = db_->GetSnapshot();
+      ASSERT_GE(snapshot->Sequence(), last);
+      last = snapshot->Sequence();
+      for (int t = 0; t < kThreads; t++) {
+        std::string value = Get("counter" + std::to_string(t), snapshot);
+        if (value == "NOT_FOUND")
+          continue;
+        int counter = std::stoi(value);
+        ASSERT_GE(counter, counters[t]);
+        counters[t] = counter;
+        ASSERT_EQ(Get(std::to_string(t) + "." + value, snapshot), "v");
+      }
+      db_->ReleaseSnapshot(snapshot);
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+
+    const Snapshot *snapshot = db_->GetSnapshot();
+    ASSERT_EQ(snapshot->Sequence(), kThreads * kWrites * 2);
+    db_->ReleaseSnapshot(snapshot);
+    for (int t = 0; t < kThreads; t++) {
+      ASSERT_EQ(Get("counter" + std::to_string(t)),
+                std::to_string(kWrites - 1));
+    }
+  }
+}
+
+TEST_F(DBTest, ConcurrentGet) {
+  Reopen();
+  const int kKeys = 1000;
+  for (int k = 0; k < kKeys; k++) {
+    ASSERT_TRUE(db_->Put(WriteOptions(), std::to_string(k), "0"));
+  }
+
+  // Readers never miss a key, while the writer keeps overwriting them.
+  std::vector<std::thread> readers;
+  for (int t = 0; t < 4; t++) {
+    readers.emplace_back([&]() {
+      for (int i = 0; i < 20000; i++) {
+        std::string value;
+        ASSERT_TRUE(db_->Get(ReadOptions(), std::to_string(i % kKeys), &value));
+      }
+    });
+  }
+  for (int i = 1; i < 20; i++) {
+    for (int k = 0; k < kKeys; k++) {
+      ASSERT_TRUE(db_->Put(WriteOptions(), std::to_string(k),
+                           std::string(100, '0' + i % 10)));
+    }
+  }
+  for (auto &reader : readers) {
+    reader.join();
+  }
+}
+
+// Full memtables are switched and flushed into level-0 in the background,
+// and a reopen recovers both the level-0 tables and the records left in
+// the logs.
+TEST_F(DBTest, FlushAndRecover) {
+  options_.write_buffer_size = 16 << 10;
+  options_.max_write_buffer_number = 4;
+  std::map<std::string, std::string> model;
+  size_t level0_files;
+  {
+    DBImpl db(options_, dbname_);
+    ASSERT_TRUE(db.Open());
+    for (int i = 0; i < 2000; i++) {
+      std::string key = "key" + std::to_string(i % 500);
+      std::string value = std::to_string(i) + std::string(100, 'v');
+      WriteBatch batch;
+      batch.Put(key, value);
+      ASSERT_TRUE(db.Write(WriteOptions(), &batch));
+      model[key] = value;
+    }
+
+    for (int i = 0; i < 500 && db.TEST_NumImmutableMemTables() > 0; i++)
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    ASSERT_EQ(db.TEST_NumImmutableMemTables(), 0);
+    level0_files = db.TEST_NumLevel0Files();
+    ASSERT_GT(level0_files, 1);
+
+    // Only in the log of the current memtable.
+    WriteBatch batch;
+    batch.Put("unflushed", "value");
+    ASSERT_TRUE(db.Write(WriteOptions(), &batch));
+    model["unflushed"] = "value";
+  }
+
+  DBImpl db(options_, dbname_);
+  ASSERT_TRUE(db.Open());
+  ASSERT_GE(db.TEST_NumLevel0Files(), level0_files);
+  std::string value;
+  for (const auto &entry : model) {
+    ASSERT_TRUE(db.Get(ReadOptions(), entry.first, &value));
+    ASSERT_EQ(value, entry.second);
+  }
+}
+
+// The buckets of the hash rep take far more than write_buffer_size, which
+// must not make every memtable look full.
+TEST_F(DBTest, HashPrefixMemTable) {
+  std::unique_ptr<const MemTableRepFactory> factory(
+      NewHashPrefixRepFactory(4));
+  options_.memtable_factory = factory.get();
+  DBImpl db(options_, dbname_);
+  ASSERT_TRUE(db.Open());
+
+  for (int i = 0; i < 100; i++) {
+    WriteBatch batch;
+    batch.Put("key" + std::to_string(i), std::to_string(i));
+    ASSERT_TRUE(db.Write(WriteOptions(), &batch));
+  }
+  ASSERT_EQ(db.TEST_NumImmutableMemTables(), 0);
+  ASSERT_EQ(db.TEST_NumLevel0Files(), 0);
+
+  std::string value;
+  for (int i = 0; i < 100; i++) {
+    ASSERT_TRUE(db.Get(ReadOptions(), "key" + std::to_string(i), &value));
+    ASSERT_EQ(value, std::to_string(i));
+  }
+}
+
+// The DB crashed in the middle of writing the last record, the part of
+// which not yet written reads as zeros. The records before it are
+// recovered, and the torn one is dropped without failing the Open.
+TEST_F(DBTest, TornLogTail) {
+  options_.paranoid_checks = true;
+  Reopen();
+  for (int i = 0; i < 100; i++) {
+    ASSERT_TRUE(db_->Put(WriteOptions(), "key" + std::to_string(i),
+                         std::string(100, 'a' + i % 26)));
+  }
+  ASSERT_TRUE(db_->Put(WriteOptions(), "last", std::string(1000, 'z')));
+  db_.reset();
+
+  std::string log;
+  for (boost::filesystem::directory_iterator it(dbname_), end; it != end;
+       ++it) {
+    std::string name = it->path().string();
+    if (name.size() > 4 && name.substr(name.size() - 4) == ".log" &&
+        name > log)
+      log = name;
+  }
+  ASSERT_FALSE(log.empty());
+
+  // The preallocated space is not a part of the file.
+  uint64_t size = boost::filesystem::file_size(log);
+  ASSERT_LT(size, options_.log_preallocate_size);
+
+  FILE *file = fopen(log.c_str(), "r+");
+  ASSERT_TRUE(file != nullptr);
+  ASSERT_EQ(fseek(file, static_cast<long>(size - 500), SEEK_SET), 0);
+  std::string zeros(500, '\0');
+  ASSERT_EQ(fwrite(zeros.data(), 1, zeros.size(), file), zeros.size());
+  fclose(file);
+
+  Reopen();
+  for (int i = 0; i < 100; i++)
+    ASSERT_EQ(Get("key" + std::to_string(i)), std::string(100, 'a' + i % 26));
+  ASSERT_EQ(Get("last"), "NOT_FOUND");
+}
+
+// Level-0 tables past the stop triggers only slow the writes down, as
+// nothing reduces them without compactions.
+TEST_F(DBTest, Level0Slowdown) {
+  options_.write_buffer_size = 16 << 10;
+  options_.level0_slowdown_writes_trigger = 1;
+  options_.level0_stop_writes_trigger = 2;
+  options_.soft_pending_compaction_bytes_limit = 1;
+  options_.hard_pending_compaction_bytes_limit = 2;
+  options_.delayed_write_rate = 64 << 20;
+  DBImpl db(options_, dbname_);
+  ASSERT_TRUE(db.Open());
+
+  auto put = [&db](int i) {
+    WriteBatch batch;
+    batch.Put("key" + std::to_string(i), std::string(100, 'v'));
+    return db.Write(WriteOptions(), &batch);
+  };
+  int i = 0;
+  while (db.TEST_NumLevel0Files() <= 2) {
+    ASSERT_LT(i, 100000);
+    ASSERT_TRUE(put(i++));
+  }
+
+  // The writes keep going past the stop trigger.
+  for (int n = 0; n < 1000; n++) {
+    ASSERT_TRUE(put(i++));
+  }
+  ASSERT_GT(db.GetWriteStallStats().delayed_writes, 0);
+}
+
+// Wait up to 5 seconds for the log of db to be synced up to sequence.
+static bool WaitUntilSynced(DBImpl *db, SequenceNumber sequence) {
+  for (int i = 0; i < 500; i++) {
+    if (db->TEST_SyncedSequence() >= sequence)
+      return true;
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  return false;
+}
+
+// The writes are synced in the background, either every interval, or once
+// enough bytes are written.
+TEST_F(DBTest, BackgroundWalSync) {
+  for (int trigger = 0; trigger < 2; trigger++) {
+    boost::filesystem::remove_all(dbname_);
+    options_.wal_sync_interval_ms = (trigger == 0) ? 10 : 0;
+    options_.wal_sync_bytes = (trigger == 0) ? 0 : 4096;
+    DBImpl db(options_, dbname_);
+    ASSERT_TRUE(db.Open());
+
+    for (int i = 0; i < 10; i++) {
+      WriteBatch batch;
+      batch.Put("key" + std::to_string(i), std::string(1000, 'v'));
+      ASSERT_TRUE(db.Write(WriteOptions(), &batch));
+    }
+    SequenceNumber last = db.TEST_LastSequence();
+    if (trigger == 0) {
+      ASSERT_TRUE(WaitUntilSynced(&db, last));
+    } else {
+      // Those after the last trigger are left for the next one.
+      ASSERT_TRUE(WaitUntilSynced(&db, last - 4));
+    }
+  }
+}
+
+// Writes with sync, or waiting for the sync, have been synced by the time
+// they return, with or without the background sync.
+TEST_F(DBTest, SyncedWrites) {
+  for (int config = 0; config < 3; config++) {
+    boost::filesystem::remove_all(dbname_);
+    options_.wal_sync_interval_ms = (config == 0) ? 100 : 0;
+    options_.wal_sync_bytes = (config == 1) ? (1 << 20) : 0;
+    DBImpl db(options_, dbname_);
+    ASSERT_TRUE(db.Open());
+
+    for (int i = 0; i < 10; i++) {
+      WriteOptions options;
+      options.sync = (i % 2 == 0);
+      options.wait_for_sync = !options.sync;
+      WriteBatch batch;
+      batch.Put("key" + std::to_string(i), "value");
+      ASSERT_TRUE(db.Write(options, &batch));
+      ASSERT_GE(db.TEST_SyncedSequence(), db.TEST_LastSequence());
+    }
+  }
+}
+
+// Once armed, appends only half of the data, and fails the appends and
+// syncs.
+class FailingLogFile final : public WritableFile {
+ public:
+  explicit FailingLogFile(WritableFile *base) : base_(base), failing_(false) {}
+
+  Status Append(const Slice &data) override {
+    if (!failing_)
+      return base_->Append(data);
+    base_->Append(Slice(data.RawData(), data.Len() / 2));
+    return Status::IOError("FailingLogFile::Append");
+  }
+
+  Status Sync() override {
+    if (failing_)
+      return Status::IOError("FailingLogFile::Sync");
+    return base_->Sync();
+  }
+
+  Status Close() override {
+    return base_->Close();
+  }
+
+  Status Flush() override {
+    return base_->Flush();
+  }
+
+  void SetFailing(bool failing) {
+    failing_ = failing;
+  }
+
+ private:
+  std::unique_ptr<WritableFile> base_;
+  std::atomic<bool> failing_;
+};
+
+// A failed log write fails all the later writes, rather than appending
+// them after the torn bytes.
+TEST_F(DBTest, LogWriteError) {
+  for (int config = 0; config < 3; config++) {
+    boost::filesystem::remove_all(dbname_);
+    options_.enable_pipelined_write = (config == 2);
+    {
+      DBImpl db(options_, dbname_);
+      ASSERT_TRUE(db.Open());
+      FailingLogFile *file = nullptr;
+      db.TEST_WrapLogFile([&file](WritableFile *base) {
+        return file = new FailingLogFile(base);
+      });
+
+      WriteOptions options;
+      options.sync = (config == 1);
+      WriteBatch batch;
+      batch.Put("k1", "v1");
+      ASSERT_TRUE(db.Write(options, &batch));
+
+      file->SetFailing(true);
+      batch.Clear();
+      batch.Put("k2", std::string(1000, 'v'));
+      Status s = db.Write(options, &batch);
+      ASSERT_TRUE(s.IsIOError()) << s.ToString();
+
+      // The error sticks even if the file recovers.
+      file->SetFailing(false);
+      batch.Clear();
+      batch.Put("k3", "v3");
+      s = db.Write(options, &batch);
+      ASSERT_TRUE(s.IsIOError()) << s.ToString();
+
+      std::string value;
+      ASSERT_TRUE(db.Get(ReadOptions(), "k1", &value));
+      ASSERT_EQ(value, "v1");
+      ASSERT_TRUE(db.Get(ReadOptions(), "k3", &value).IsNotFound());
+    }
+
+    // The torn record is dropped by the next Open.
+    Reopen();
+    ASSERT_EQ(Get("k1"), "v1");
+    ASSERT_EQ(Get("k2"), "NOT_FOUND");
+    ASSERT_EQ(Get("k3"), "NOT_FOUND");
+    ASSERT_TRUE(db_->Put(WriteOptions(), "k4", "v4"));
+    ASSERT_EQ(Get("k4"), "v4");
+    db_.reset();
+  }
+}
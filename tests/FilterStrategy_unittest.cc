@@ -0,0 +1,97 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+
+#include "FilterStrategy.h"
+#include "Slice.h"
+
+using namespace lessdb;
+
+static std::string Key(int i) {
+  return "key" + std::to_string(i);
+}
+
+TEST(Bloom, Empty) {
+  std::unique_ptr<FilterStrategy> bloom(FilterStrategy::Default(10));
+  std::string filter(bloom->FilterSize(0), '\0');
+  ASSERT_GT(filter.size(), 0);
+  ASSERT_FALSE(bloom->MightContain("hello", filter));
+}
+
+TEST(Bloom, FalsePositiveRate) {
+  std::unique_ptr<FilterStrategy> bloom(FilterStrategy::Default(10));
+
+  for (int num_keys = 1; num_keys <= 10000; num_keys *= 10) {
+    std::string filter(bloom->FilterSize(num_keys), '\0');
+    Slice bits(&filter[0], filter.size());
+    for (int i = 0; i < num_keys; i++) {
+      bloom->Put(Key(i), bits);
+    }
+
+    // No false negatives.
+    for (int i = 0; i < num_keys; i++) {
+      ASSERT_TRUE(bloom->MightContain(Key(i), filter)) << Key(i);
+    }
+
+    // About 1% false positives with 10 bits per key.
+    int false_positives = 0;
+    for (int i = 0; i < 10000; i++) {
+      if (bloom->MightContain(Key(i + 1000000000), filter))
+        false_positives++;
+    }
+    ASSERT_LE(false_positives, 300) << num_keys;
+  }
+}
+
+// The filters are persisted in the tables, their bits must be the same on
+// every platform and build.
+TEST(Bloom, StableBits) {
+  std::unique_ptr<FilterStrategy> bloom(FilterStrategy::Default(10));
+  std::string filter(bloom->FilterSize(2), '\0');
+  Slice bits(&filter[0], filter.size());
+  bloom->Put("hello", bits);
+  bloom->Put("world", bits);
+  ASSERT_EQ(filter, std::string("\x11\x40\x00\x41\x44\x10\x40\x10\x06", 9));
+}
+
+// A filter is probed with the number of probes it's built with, whatever
+// the bits per key of the strategy probing it.
+TEST(Bloom, DifferentBitsPerKey) {
+  for (size_t build_bits : {5, 20}) {
+    std::unique_ptr<FilterStrategy> builder(FilterStrategy::Default(build_bits));
+    std::unique_ptr<FilterStrategy> prober(
+        FilterStrategy::Default(25 - build_bits));
+    ASSERT_STREQ(builder->Name(), prober->Name());
+
+    std::string filter(builder->FilterSize(1000), '\0');
+    Slice bits(&filter[0], filter.size());
+    for (int i = 0; i < 1000; i++) {
+      builder->Put(Key(i), bits);
+    }
+    for (int i = 0; i < 1000; i++) {
+      ASSERT_TRUE(prober->MightContain(Key(i), filter)) << Key(i);
+    }
+  }
+}
@@ -0,0 +1,54 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <string>
+
+#include "Hash.h"
+
+using namespace lessdb;
+
+// The hash is persisted in the tables, it must never change.
+TEST(Hash, KnownValues) {
+  const uint8_t data1[1] = {0x62};
+  const uint8_t data2[2] = {0xc3, 0x97};
+  const uint8_t data3[3] = {0xe2, 0x99, 0xa5};
+  const uint8_t data4[4] = {0xe1, 0x80, 0xb9, 0x32};
+
+  ASSERT_EQ(Hash(nullptr, 0, 0xbc9f1d34), 0xbc9f1d34);
+  ASSERT_EQ(Hash(reinterpret_cast<const char *>(data1), sizeof(data1),
+                 0xbc9f1d34),
+            0xef1345c4);
+  ASSERT_EQ(Hash(reinterpret_cast<const char *>(data2), sizeof(data2),
+                 0xbc9f1d34),
+            0x5b663814);
+  ASSERT_EQ(Hash(reinterpret_cast<const char *>(data3), sizeof(data3),
+                 0xbc9f1d34),
+            0x323c078f);
+  ASSERT_EQ(Hash(reinterpret_cast<const char *>(data4), sizeof(data4),
+                 0xbc9f1d34),
+            0xed21633a);
+
+  // Spans multiple words.
+  std::string fox = "The quick brown fox jumps over the lazy dog";
+  ASSERT_EQ(Hash(fox.data(), fox.size(), 0xbc9f1d34), 0x7e36fe57);
+}
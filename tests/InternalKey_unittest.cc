@@ -63,3 +63,29 @@ TEST(InternalKey, Init) {
   ASSERT_EQ(ikey.sequence, 10);
   ASSERT_EQ(ikey.type, kTypeDeletion);
 }
+
+TEST(InternalKeyComparator, Shortening) {
+  InternalKeyComparator comparator(NewBytewiseComparator());
+
+  InternalKeyBuf start("foo", 100, kTypeValue);
+  InternalKeyBuf limit("hello", 200, kTypeValue);
+  std::string sep = start.Data().ToString();
+  comparator.FindShortestSeparator(&sep, limit.Data());
+  ASSERT_EQ(sep, InternalKeyBuf("g", kMaxSequenceNumber, kValueTypeForSeek)
+                     .Data()
+                     .ToString());
+  ASSERT_LT(comparator.Compare(start.Data(), sep), 0);
+  ASSERT_LT(comparator.Compare(sep, limit.Data()), 0);
+
+  // The same user key can't be shortened.
+  InternalKeyBuf older("foo", 99, kTypeValue);
+  sep = start.Data().ToString();
+  comparator.FindShortestSeparator(&sep, older.Data());
+  ASSERT_EQ(sep, start.Data().ToString());
+
+  std::string key = start.Data().ToString();
+  comparator.FindShortSuccessor(&key);
+  ASSERT_EQ(key, InternalKeyBuf("g", kMaxSequenceNumber, kValueTypeForSeek)
+                     .Data()
+                     .ToString());
+}
@@ -0,0 +1,303 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include "LogFormat.h"
+#include "LogReader.h"
+#include "LogWriter.h"
+#include "utils/FileMocks.h"
+#include "utils/Random.h"
+
+using namespace lessdb;
+using namespace lessdb::log;
+
+namespace {
+
+class CountingReporter : public Reader::Reporter {
+ public:
+  CountingReporter() : dropped(0), reports(0) {}
+
+  void Corruption(size_t bytes, const Status &status) override {
+    dropped += bytes;
+    reports++;
+  }
+
+  size_t dropped;
+  int reports;
+};
+
+// Read all the records of content.
+std::vector<std::string> readAll(const std::string &content,
+                                 int worker_threads,
+                                 CountingReporter *reporter) {
+  test::StringSequentialSource source(content);
+  Reader reader(&source, reporter, true, worker_threads);
+
+  std::vector<std::string> records;
+  std::string scratch;
+  Slice record;
+  while (reader.ReadRecord(&record, &scratch)) {
+    records.push_back(record.ToString());
+  }
+  return records;
+}
+
+std::vector<std::string> randomRecords(int n) {
+  std::vector<std::string> records;
+  for (int i = 0; i < n; i++) {
+    // Mostly small records, with a few spanning multiple blocks.
+    int len = (i % 10 == 0) ? test::RandomIn(kBlockSize, 3 * kBlockSize)
+                            : test::RandomIn(0, 1000);
+    records.push_back(test::RandomString(len));
+  }
+  return records;
+}
+
+}  // anonymous namespace
+
+TEST(Log, Empty) {
+  CountingReporter reporter;
+  ASSERT_TRUE(readAll("", 0, &reporter).empty());
+  ASSERT_EQ(reporter.reports, 0);
+}
+
+TEST(Log, SingleAppendPerCommit) {
+  test::StringSink sink;
+  Writer writer(&sink);
+
+  writer.AddRecord(std::string(2 * kBlockSize, 'a'));
+  writer.AddRecord("b");
+  ASSERT_TRUE(writer.Commit(false));
+  ASSERT_EQ(sink.Appends(), 1);
+
+  ASSERT_TRUE(writer.WriteRecord("c", true));
+  ASSERT_EQ(sink.Appends(), 2);
+
+  CountingReporter reporter;
+  auto records = readAll(sink.Content(), 0, &reporter);
+  ASSERT_EQ(records.size(), 3);
+  ASSERT_EQ(records[0], std::string(2 * kBlockSize, 'a'));
+  ASSERT_EQ(records[1], "b");
+  ASSERT_EQ(records[2], "c");
+}
+
+// A commit of many records, in the recyclable format, is written with one
+// Append and at most one Sync, laid out exactly as if the records were
+// written one by one.
+TEST(Log, MultiRecordCommit) {
+  auto records = randomRecords(60);
+
+  test::StringSink sink, expected;
+  Writer writer(&sink, 7, true), one_by_one(&expected, 7, true);
+  int commits = 0;
+  for (size_t begin = 0; begin < records.size(); begin += 20) {
+    for (size_t i = begin; i < begin + 20; i++) {
+      writer.AddRecord(records[i]);
+      ASSERT_TRUE(one_by_one.WriteRecord(records[i]));
+    }
+    ASSERT_EQ(sink.Appends(), commits);
+
+    bool sync = (commits % 2 == 0);
+    ASSERT_TRUE(writer.Commit(sync));
+    commits++;
+    ASSERT_EQ(sink.Appends(), commits);
+    ASSERT_EQ(sink.Syncs(), (commits + 1) / 2);
+  }
+  ASSERT_EQ(sink.Content(), expected.Content());
+
+  for (int threads : {0, 2}) {
+    CountingReporter reporter;
+    test::StringSequentialSource source(sink.Content());
+    Reader reader(&source, &reporter, true, threads, 7);
+
+    std::vector<std::string> result;
+    std::string scratch;
+    Slice record;
+    while (reader.ReadRecord(&record, &scratch)) {
+      result.push_back(record.ToString());
+    }
+    ASSERT_EQ(result, records);
+    ASSERT_EQ(reporter.reports, 0);
+  }
+}
+
+TEST(Log, ReadWrite) {
+  auto records = randomRecords(500);
+
+  test::StringSink sink;
+  Writer writer(&sink);
+  for (size_t i = 0; i < records.size(); i++) {
+    writer.AddRecord(records[i]);
+    if (i % 3 == 0) {
+      ASSERT_TRUE(writer.Commit(false));
+    }
+  }
+  ASSERT_TRUE(writer.Commit(false));
+
+  for (int threads : {0, 1, 4}) {
+    CountingReporter reporter;
+    ASSERT_EQ(readAll(sink.Content(), threads, &reporter), records);
+    ASSERT_EQ(reporter.reports, 0);
+  }
+}
+
+TEST(Log, ChecksumMismatch) {
+  test::StringSink sink;
+  Writer writer(&sink);
+  ASSERT_TRUE(writer.WriteRecord("foo"));
+  ASSERT_TRUE(writer.WriteRecord("bar"));
+
+  // Corrupt the payload of the first record, the rest of the block is
+  // dropped.
+  (*sink.MutableContent())[kHeaderSize] ^= 1;
+
+  for (int threads : {0, 2}) {
+    CountingReporter reporter;
+    ASSERT_TRUE(readAll(sink.Content(), threads, &reporter).empty());
+    ASSERT_EQ(reporter.reports, 1);
+    ASSERT_EQ(reporter.dropped, sink.Content().size());
+  }
+}
+
+TEST(Log, CorruptionInNextBlock) {
+  test::StringSink sink;
+  Writer writer(&sink);
+  std::string first(kBlockSize - kHeaderSize, 'x');
+  ASSERT_TRUE(writer.WriteRecord(first));
+  ASSERT_TRUE(writer.WriteRecord("second"));
+  ASSERT_TRUE(writer.WriteRecord("third"));
+
+  // Only the block of the corrupted record is dropped.
+  (*sink.MutableContent())[kBlockSize + kHeaderSize] ^= 1;
+
+  CountingReporter reporter;
+  auto records = readAll(sink.Content(), 2, &reporter);
+  ASSERT_EQ(records.size(), 1);
+  ASSERT_EQ(records[0], first);
+  ASSERT_EQ(reporter.reports, 1);
+}
+
+TEST(Log, TruncatedTail) {
+  test::StringSink sink;
+  Writer writer(&sink);
+  ASSERT_TRUE(writer.WriteRecord("foo"));
+  ASSERT_TRUE(writer.WriteRecord(std::string(3 * kBlockSize, 'y')));
+
+  // The writer died in the middle of the second record, which is dropped
+  // without being reported.
+  std::string content = sink.Content();
+  content.resize(content.size() - 10);
+
+  for (int threads : {0, 3}) {
+    CountingReporter reporter;
+    auto records = readAll(content, threads, &reporter);
+    ASSERT_EQ(records.size(), 1);
+    ASSERT_EQ(records[0], "foo");
+    ASSERT_EQ(reporter.reports, 0);
+  }
+}
+
+TEST(Log, TornTailWithZeros) {
+  test::StringSink sink;
+  Writer writer(&sink);
+  ASSERT_TRUE(writer.WriteRecord("foo"));
+  ASSERT_TRUE(writer.WriteRecord(std::string(3 * kBlockSize, 'y')));
+  std::string torn = sink.Content();
+  ASSERT_TRUE(writer.WriteRecord("bar"));
+
+  // The last record was torn by a crash, the part not written reads as
+  // zeros, which is not an error.
+  std::fill(torn.begin() + kBlockSize + 100, torn.end(), '\0');
+  for (int threads : {0, 2}) {
+    CountingReporter reporter;
+    auto records = readAll(torn, threads, &reporter);
+    ASSERT_EQ(records.size(), 1);
+    ASSERT_EQ(records[0], "foo");
+    ASSERT_EQ(reporter.reports, 0);
+  }
+
+  // The same zeros followed by another record are a corruption.
+  std::string corrupted = sink.Content();
+  std::fill(corrupted.begin() + kBlockSize + 100,
+            corrupted.begin() + 2 * kBlockSize, '\0');
+  for (int threads : {0, 2}) {
+    CountingReporter reporter;
+    auto records = readAll(corrupted, threads, &reporter);
+    ASSERT_EQ(records.size(), 2);
+    ASSERT_EQ(records[0], "foo");
+    ASSERT_EQ(records[1], "bar");
+    ASSERT_GT(reporter.reports, 0);
+  }
+}
+
+TEST(Log, PreallocatedTail) {
+  auto records = randomRecords(50);
+
+  test::StringSink sink;
+  Writer writer(&sink);
+  for (const std::string &record : records) {
+    ASSERT_TRUE(writer.WriteRecord(record));
+  }
+
+  // The preallocated space is filled with zeros.
+  std::string content = sink.Content() + std::string(3 * kBlockSize, '\0');
+  for (int threads : {0, 2}) {
+    CountingReporter reporter;
+    ASSERT_EQ(readAll(content, threads, &reporter), records);
+    ASSERT_EQ(reporter.reports, 0);
+  }
+}
+
+TEST(Log, RecycledFile) {
+  auto old_records = randomRecords(100);
+  auto new_records = randomRecords(30);
+
+  test::StringSink old_sink, new_sink;
+  Writer old_writer(&old_sink, 1, true), new_writer(&new_sink, 2, true);
+  for (const std::string &record : old_records) {
+    ASSERT_TRUE(old_writer.WriteRecord(record));
+  }
+  for (const std::string &record : new_records) {
+    ASSERT_TRUE(new_writer.WriteRecord(record));
+  }
+
+  // Log 2 overwrites the file of log 1 from the beginning.
+  std::string content = old_sink.Content();
+  ASSERT_LT(new_sink.Content().size(), content.size());
+  content.replace(0, new_sink.Content().size(), new_sink.Content());
+
+  for (int threads : {0, 2}) {
+    CountingReporter reporter;
+    test::StringSequentialSource source(content);
+    Reader reader(&source, &reporter, true, threads, 2);
+
+    std::vector<std::string> records;
+    std::string scratch;
+    Slice record;
+    while (reader.ReadRecord(&record, &scratch)) {
+      records.push_back(record.ToString());
+    }
+    ASSERT_EQ(records, new_records);
+    ASSERT_EQ(reporter.reports, 0);
+  }
+}
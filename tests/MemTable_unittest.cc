@@ -21,7 +21,10 @@
  */
 
 #include <gtest/gtest.h>
+#include <memory>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 #include "MemTable.h"
 #include "Status.h"
@@ -42,7 +45,8 @@ TEST(Basic, Add) {
   MemTable table(cmp);
   table.Add(1, kTypeValue, "abc", "def");
 
-  Slice key = InternalKeyBuf("abc", 1, kTypeValue).Data();
+  InternalKeyBuf key_buf("abc", 1, kTypeValue);
+  Slice key = key_buf.Data();
   ASSERT_TRUE(table.find(key) != table.end());
 
   auto iter = table.find(key);
@@ -52,6 +56,105 @@ TEST(Basic, Add) {
   ASSERT_EQ(iter->second, Slice("def"));
 }
 
+TEST(Basic, Get) {
+  InternalKeyComparator cmp(NewBytewiseComparator());
+  MemTable table(cmp);
+  table.Add(1, kTypeValue, "abc", "v1");
+  table.Add(2, kTypeDeletion, "abc", "");
+  table.Add(3, kTypeValue, "abc", "v3");
+
+  std::string value;
+  Status s;
+  ASSERT_TRUE(table.Get(LookupKey("abc", 1), &value, &s));
+  ASSERT_TRUE(s);
+  ASSERT_EQ(value, "v1");
+
+  ASSERT_TRUE(table.Get(LookupKey("abc", 2), &value, &s));
+  ASSERT_TRUE(s.IsNotFound());
+
+  s = Status::OK();
+  ASSERT_TRUE(table.Get(LookupKey("abc", kMaxSequenceNumber), &value, &s));
+  ASSERT_TRUE(s);
+  ASSERT_EQ(value, "v3");
+
+  ASSERT_FALSE(table.Get(LookupKey("ab", kMaxSequenceNumber), &value, &s));
+  ASSERT_FALSE(table.Get(LookupKey("abcd", kMaxSequenceNumber), &value, &s));
+
+  // Long keys are encoded on the heap.
+  std::string long_key(1000, 'k');
+  table.Add(4, kTypeValue, long_key, "long");
+  ASSERT_TRUE(table.Get(LookupKey(long_key, 4), &value, &s));
+  ASSERT_EQ(value, "long");
+}
+
+TEST(Basic, AddLongEntry) {
+  InternalKeyComparator cmp(NewBytewiseComparator());
+  MemTable table(cmp);
+
+  // The lengths of key and value go across the boundary of the 1-byte
+  // varint.
+  std::string user_key(200, 'k'), value(300, 'v');
+  table.Add(7, kTypeDeletion, user_key, value);
+
+  InternalKeyBuf key_buf(user_key, 7, kTypeDeletion);
+  auto iter = table.find(key_buf.Data());
+  ASSERT_TRUE(iter != table.end());
+  ASSERT_EQ(iter->first, key_buf.Data());
+  ASSERT_EQ(InternalKey(iter->first).sequence, 7);
+  ASSERT_EQ(InternalKey(iter->first).type, kTypeDeletion);
+  ASSERT_EQ(iter->second, Slice(value));
+}
+
+// Orders user keys in the reverse of bytewise order.
+class ReverseComparator : public Comparator {
+ public:
+  const char *Name() const override {
+    return "ReverseComparator";
+  }
+
+  int Compare(const Slice &lhs, const Slice &rhs) const override {
+    return -NewBytewiseComparator()->Compare(lhs, rhs);
+  }
+
+  void FindShortestSeparator(std::string *start,
+                             const Slice &limit) const override {}
+};
+
+void testOrder(const Comparator *user_comparator) {
+  InternalKeyComparator cmp(user_comparator);
+  MemTable table(cmp);
+
+  SequenceNumber seq = 1;
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < 100; i++) {
+      std::string key = std::to_string(i * 7919 % 100);
+      table.Add(seq++, (i % 3) ? kTypeValue : kTypeDeletion, key, "v");
+    }
+  }
+
+  // Entries are ordered by increasing user key, and decreasing sequence.
+  int count = 0;
+  std::string last;
+  for (auto it = table.begin(); it != table.end(); it++, count++) {
+    std::string cur = it->first.ToString();
+    if (count > 0) {
+      ASSERT_LT(cmp.Compare(last, cur), 0);
+      InternalKey a(last), b(cur);
+      int r = user_comparator->Compare(a.user_key, b.user_key);
+      ASSERT_TRUE(r < 0 || (r == 0 && a.sequence > b.sequence));
+    }
+    last = cur;
+  }
+  ASSERT_EQ(count, 300);
+}
+
+TEST(Basic, Order) {
+  testOrder(NewBytewiseComparator());
+
+  ReverseComparator reverse;
+  testOrder(&reverse);
+}
+
 TEST(Basic, WriteBatchInsert) {
   InternalKeyComparator cmp(NewBytewiseComparator());
   MemTable memtable(cmp);
@@ -71,4 +174,158 @@ TEST(Basic, WriteBatchInsert) {
     std::string key(it1->first.RawData(), it1->first.Len() - 8);
     ASSERT_EQ(table[key], it1->second.ToString());
   }
-}
\ No newline at end of file
+}
+
+TEST(Basic, SortedWriteBatchInsert) {
+  InternalKeyComparator cmp(NewBytewiseComparator());
+  MemTable memtable(cmp);
+
+  // The first batch is sorted, the second one is sorted at first, then
+  // turns out to be unsorted.
+  WriteBatch sorted, unsorted;
+  for (int i = 100; i < 200; i++) {
+    sorted.Put(std::to_string(i), "v1");
+  }
+  for (int i = 300; i < 310; i++) {
+    unsorted.Put(std::to_string(i), "v2");
+  }
+  unsorted.Put("150", "v2");
+  unsorted.Delete("305");
+  ASSERT_TRUE(sorted.InsertInto(&memtable).IsOK());
+  ASSERT_TRUE(unsorted.InsertInto(&memtable).IsOK());
+
+  // The hint left by the previous batches doesn't apply to the next one.
+  WriteBatch interleaved;
+  for (int i = 1000; i < 1010; i++) {
+    interleaved.Put(std::to_string(i), "v3");
+  }
+  ASSERT_TRUE(interleaved.InsertInto(&memtable).IsOK());
+
+  int count = 0;
+  std::string last;
+  for (auto it = memtable.begin(); it != memtable.end(); it++, count++) {
+    std::string cur = it->first.ToString();
+    if (count > 0) {
+      ASSERT_LT(cmp.Compare(last, cur), 0);
+    }
+    last = cur;
+  }
+  ASSERT_EQ(count, 122);
+}
+
+void testRep(const MemTableRepFactory *factory) {
+  InternalKeyComparator cmp(NewBytewiseComparator());
+  MemTable table(cmp, factory);
+
+  SequenceNumber seq = 1;
+  for (int i = 0; i < 500; i++) {
+    std::string key = "key" + std::to_string(i * 7919 % 250);
+    table.Add(seq++, kTypeValue, key, std::to_string(i));
+
+    // Reads in between the writes see the entries added so far.
+    if (i % 50 == 0) {
+      std::string value;
+      Status s;
+      ASSERT_TRUE(table.Get(LookupKey(key, seq), &value, &s));
+      ASSERT_EQ(value, std::to_string(i));
+    }
+  }
+
+  // Lookups.
+  for (int i = 0; i < 500; i++) {
+    std::string key = "key" + std::to_string(i * 7919 % 250);
+    InternalKeyBuf key_buf(key, i + 1, kTypeValue);
+    auto it = table.find(key_buf.Data());
+    ASSERT_TRUE(it != table.end());
+    ASSERT_EQ(it->second, Slice(std::to_string(i)));
+  }
+  InternalKeyBuf missing("key1", 1000, kTypeValue);
+  ASSERT_TRUE(table.find(missing.Data()) == table.end());
+
+  // Point lookups see the newest version at their sequence numbers.
+  std::string value;
+  for (int i = 0; i < 500; i++) {
+    std::string key = "key" + std::to_string(i * 7919 % 250);
+    Status s;
+    ASSERT_TRUE(table.Get(LookupKey(key, i + 1), &value, &s));
+    ASSERT_TRUE(s);
+    ASSERT_EQ(value, std::to_string(i));
+  }
+  Status s;
+  ASSERT_FALSE(table.Get(LookupKey("key1", 0), &value, &s));
+  ASSERT_FALSE(table.Get(LookupKey("key", 1000), &value, &s));
+
+  // Full iteration is in order no matter how the entries are indexed.
+  for (int pass = 0; pass < 2; pass++) {
+    int count = 0;
+    std::string last;
+    for (auto it = table.begin(); it != table.end(); it++, count++) {
+      std::string cur = it->first.ToString();
+      if (count > 0) {
+        ASSERT_LT(cmp.Compare(last, cur), 0);
+      }
+      last = cur;
+    }
+    ASSERT_EQ(count, 500);
+    table.MarkReadOnly();
+  }
+}
+
+TEST(Rep, SkipList) {
+  testRep(NewSkipListRepFactory());
+}
+
+TEST(Rep, HashPrefix) {
+  std::unique_ptr<const MemTableRepFactory> factory(
+      NewHashPrefixRepFactory(4, 16));
+  testRep(factory.get());
+}
+
+// The buckets allocated up front don't make an empty memtable look full.
+TEST(Rep, HashPrefixMemoryUsage) {
+  std::unique_ptr<const MemTableRepFactory> factory(
+      NewHashPrefixRepFactory(4));
+  InternalKeyComparator cmp(NewBytewiseComparator());
+  MemTable table(cmp, factory.get(), 4096);
+  size_t empty = table.BytesUsed();
+  ASSERT_LT(empty, 64 << 10);
+
+  for (int i = 0; i < 100; i++)
+    table.Add(i + 1, kTypeValue, "key" + std::to_string(i), "value");
+  ASSERT_GT(table.BytesUsed(), empty);
+  ASSERT_LT(table.BytesUsed(), 64 << 10);
+}
+
+TEST(Rep, Vector) {
+  std::unique_ptr<const MemTableRepFactory> factory(NewVectorRepFactory());
+  testRep(factory.get());
+}
+
+TEST(Rep, ConcurrentAdd) {
+  std::unique_ptr<const MemTableRepFactory> hash(
+      NewHashPrefixRepFactory(3, 64));
+  std::unique_ptr<const MemTableRepFactory> vector(NewVectorRepFactory());
+  for (const MemTableRepFactory *factory :
+       {NewSkipListRepFactory(), hash.get(), vector.get()}) {
+    InternalKeyComparator cmp(NewBytewiseComparator());
+    MemTable table(cmp, factory);
+
+    const int kThreads = 4, kEntries = 1000;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+      threads.emplace_back([&table, t]() {
+        for (int i = 0; i < kEntries; i++) {
+          SequenceNumber seq = t * kEntries + i + 1;
+          table.Add(seq, kTypeValue, std::to_string(seq % 100), "v", true);
+        }
+      });
+    }
+    for (auto &th : threads)
+      th.join();
+
+    int count = 0;
+    for (auto it = table.begin(); it != table.end(); it++)
+      count++;
+    ASSERT_EQ(count, kThreads * kEntries);
+  }
+}
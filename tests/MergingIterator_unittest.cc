@@ -0,0 +1,190 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Comparator.h"
+#include "MergingIterator.h"
+#include "utils/Random.h"
+
+using namespace lessdb;
+using namespace test;
+
+namespace {
+
+// A child over sorted keys, which fails after fail_after steps if it's not
+// negative, or fails its seeks if fail_seek is set.
+class VectorChild final : public MergingIterator::Child {
+ public:
+  explicit VectorChild(std::vector<std::string> keys, int fail_after = -1,
+                       bool fail_seek = false)
+      : keys_(std::move(keys)),
+        pos_(keys_.size()),
+        steps_(0),
+        fail_after_(fail_after),
+        fail_seek_(fail_seek) {}
+
+  bool Valid() const override {
+    return pos_ < keys_.size();
+  }
+
+  Slice Key() const override {
+    return keys_[pos_];
+  }
+
+  Slice Value() const override {
+    return keys_[pos_];
+  }
+
+  void Next() override {
+    pos_++;
+    if (fail_after_ >= 0 && ++steps_ >= fail_after_) {
+      pos_ = keys_.size();
+      stat_ = Status::IOError("injected next error");
+    }
+  }
+
+  Status Stat() const override {
+    return stat_;
+  }
+
+  Status SeekToFirst() override {
+    return Seek("");
+  }
+
+  Status Seek(const Slice &target) override {
+    if (fail_seek_) {
+      pos_ = keys_.size();
+      return Status::IOError("injected seek error");
+    }
+    pos_ = std::lower_bound(keys_.begin(), keys_.end(), target.ToString()) -
+           keys_.begin();
+    return Status::OK();
+  }
+
+  bool PrefixMayMatch(const Slice &prefix) const override {
+    for (const std::string &key : keys_) {
+      if (key.compare(0, prefix.Len(), prefix.ToString()) == 0)
+        return true;
+    }
+    return false;
+  }
+
+ private:
+  std::vector<std::string> keys_;
+  size_t pos_;
+  int steps_;
+  const int fail_after_;
+  const bool fail_seek_;
+  Status stat_;
+};
+
+std::vector<std::string> collect(MergingIterator *iter) {
+  std::vector<std::string> keys;
+  for (; iter->Valid(); iter->Next()) {
+    keys.push_back(iter->Key().ToString());
+  }
+  return keys;
+}
+
+}  // anonymous namespace
+
+TEST(MergingIterator, Empty) {
+  std::vector<std::unique_ptr<MergingIterator::Child>> children;
+  children.emplace_back(new VectorChild({}));
+  MergingIterator iter(NewBytewiseComparator(), std::move(children));
+  iter.SeekToFirst();
+  ASSERT_FALSE(iter.Valid());
+  ASSERT_TRUE(iter.Stat());
+}
+
+TEST(MergingIterator, Merge) {
+  std::vector<std::string> all;
+  std::vector<std::unique_ptr<MergingIterator::Child>> children;
+  for (int c = 0; c < 7; c++) {
+    std::vector<std::string> keys;
+    for (int i = 0; i < 100; i++) {
+      keys.push_back(RandomString(RandomIn(1, 8)));
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    all.insert(all.end(), keys.begin(), keys.end());
+    children.emplace_back(new VectorChild(keys));
+  }
+  std::sort(all.begin(), all.end());
+  MergingIterator iter(NewBytewiseComparator(), std::move(children));
+
+  iter.SeekToFirst();
+  ASSERT_EQ(collect(&iter), all);
+
+  for (int i = 0; i < 100; i++) {
+    std::string target = RandomString(RandomIn(0, 8));
+    iter.Seek(target);
+    auto expected = std::lower_bound(all.begin(), all.end(), target);
+    ASSERT_EQ(collect(&iter), std::vector<std::string>(expected, all.end()));
+  }
+}
+
+TEST(MergingIterator, SeekPrefix) {
+  std::vector<std::unique_ptr<MergingIterator::Child>> children;
+  children.emplace_back(new VectorChild({"a1", "b1", "c1"}));
+  children.emplace_back(new VectorChild({"a2", "c2"}));
+  children.emplace_back(new VectorChild({"b2", "b3"}));
+  MergingIterator iter(NewBytewiseComparator(), std::move(children));
+
+  // The second child has no key of "b", the scan of the others goes on past
+  // the prefix.
+  iter.SeekPrefix("b", "b");
+  ASSERT_EQ(collect(&iter),
+            std::vector<std::string>({"b1", "b2", "b3", "c1"}));
+}
+
+// The failed children are left out, with their errors kept in Stat().
+TEST(MergingIterator, Errors) {
+  std::vector<std::unique_ptr<MergingIterator::Child>> children;
+  children.emplace_back(new VectorChild({"a", "c", "e"}));
+  children.emplace_back(new VectorChild({"b", "d", "f"}, 1));
+  children.emplace_back(new VectorChild({"g"}));
+  MergingIterator iter(NewBytewiseComparator(), std::move(children));
+
+  iter.SeekToFirst();
+  ASSERT_TRUE(iter.Stat());
+  ASSERT_EQ(collect(&iter),
+            std::vector<std::string>({"a", "b", "c", "e", "g"}));
+  ASSERT_TRUE(iter.Stat().IsIOError());
+
+  std::vector<std::unique_ptr<MergingIterator::Child>> seek_children;
+  seek_children.emplace_back(new VectorChild({"a", "c"}));
+  seek_children.emplace_back(new VectorChild({"b"}, -1, true));
+  MergingIterator seek_iter(NewBytewiseComparator(), std::move(seek_children));
+  seek_iter.Seek("a");
+  ASSERT_TRUE(seek_iter.Stat().IsIOError());
+  ASSERT_EQ(collect(&seek_iter), std::vector<std::string>({"a", "c"}));
+
+  // A new seek starts over.
+  seek_iter.SeekToFirst();
+  ASSERT_TRUE(seek_iter.Stat().IsIOError());
+}
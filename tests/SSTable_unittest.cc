@@ -22,11 +22,15 @@
 
 #include <glog/logging.h>
 #include <gtest/gtest.h>
+#include <thread>
 
 #include "SSTableBuilder.h"
 #include "TestUtils.h"
 #include "SSTable.h"
 #include "Block.h"
+#include "CacheStrategy.h"
+#include "InternalKey.h"
+#include "PrefixExtractor.h"
 // Must include Block.h or compiler will warn that Block is an incomplete type.
 
 using namespace lessdb;
@@ -76,14 +80,15 @@ TEST(Build, Empty) {
   }
   ASSERT_EQ(num_entries, 1);
 
-  // Empty SSTable is a special case that's uninteresting to lessdb.
-  ASSERT_TRUE(table->begin() != table->end());
+  // The empty data block has no entry to iterate over, either way.
+  ASSERT_TRUE(table->begin() == table->end());
+  ASSERT_TRUE(--table->end() == table->end());
 }
 
 TEST(Basic, Random) {
   Options options;
 
-  for (int num_entries = 1; num_entries < 2000;
+  for (int num_entries = 0; num_entries < 2000;
        num_entries += (num_entries < 50) ? 1 : 200) {
     KVMap table;
     StringSink sink;
@@ -115,5 +120,527 @@ TEST(Basic, Random) {
     }
 
     ASSERT_TRUE(sst->end() == it);
+
+    for (auto it2 = table.rbegin(); it2 != table.rend(); it2++) {
+      --it;
+      ASSERT_EQ(it.Key().ToString(), it2->first);
+      ASSERT_EQ(it.Value().ToString(), it2->second);
+    }
+
+    // There's nothing before the end of an empty table.
+    if (table.empty()) {
+      --it;
+      ASSERT_TRUE(sst->end() == it);
+    }
+  }
+}
+
+TEST(Basic, InternalKeys) {
+  InternalKeyComparator comparator(NewBytewiseComparator());
+  Options options;
+  options.comparator = &comparator;
+  options.block_size = 256;
+
+  // Several versions of each user key, sorted by the internal key order.
+  std::vector<std::string> keys;
+  SequenceNumber seq = 1;
+  for (int i = 0; i < 500; i++) {
+    std::string user_key = "key" + std::to_string(i);
+    for (int j = 0; j < 3; j++) {
+      keys.push_back(
+          InternalKeyBuf(user_key, seq++, kTypeValue).Data().ToString());
+    }
+  }
+  std::sort(keys.begin(), keys.end(),
+            [&](const std::string& a, const std::string& b) {
+              return comparator.Compare(a, b) < 0;
+            });
+
+  StringSink sink;
+  SSTableBuilder builder(&options, &sink);
+  for (const auto& key : keys) {
+    ASSERT_TRUE(builder.Add(key, "v"));
+  }
+  ASSERT_TRUE(builder.Finish());
+  ASSERT_EQ(builder.FileSize(), sink.Content().size());
+
+  StringSource source(sink.Content());
+  Status s;
+  std::unique_ptr<SSTable> sst(
+      SSTable::Open(options, &source, sink.Content().size(), s));
+  ASSERT_TRUE(s) << s.ToString();
+
+  auto it = sst->begin();
+  for (const auto& key : keys) {
+    ASSERT_TRUE(it != sst->end());
+    ASSERT_EQ(it.Key().ToString(), key);
+    ++it;
+  }
+  ASSERT_TRUE(it == sst->end());
+
+  // The shortened index keys still lead to the right blocks.
+  for (const auto& key : keys) {
+    auto found = sst->find(key);
+    ASSERT_TRUE(found != sst->end());
+    ASSERT_EQ(found.Key().ToString(), key);
+  }
+
+  // Seeking a lookup key lands at the newest version visible at its
+  // sequence number.
+  for (int i = 0; i < 500; i++) {
+    std::string user_key = "key" + std::to_string(i);
+    SequenceNumber sequence = 3 * i + 2;
+    auto found = sst->end();
+    ASSERT_TRUE(sst->Seek(LookupKey(user_key, sequence).Key(), &found));
+    ASSERT_TRUE(found != sst->end());
+    InternalKey ikey(found.Key());
+    ASSERT_EQ(ikey.user_key.ToString(), user_key);
+    ASSERT_EQ(ikey.sequence, sequence);
+  }
+
+  auto found = sst->end();
+  ASSERT_TRUE(sst->Seek(LookupKey("kez", kMaxSequenceNumber).Key(), &found));
+  ASSERT_TRUE(found == sst->end());
+  // MultiSeek agrees with Seek, with the duplicated keys and the keys beyond
+  // the last block.
+  std::vector<std::string> lookups;
+  for (int i = 0; i < 600; i += 1 + i % 3) {
+    std::string user_key = "key" + std::to_string(i);
+    lookups.push_back(InternalKeyBuf(user_key, 3 * i + 2, kTypeValue)
+                          .Data()
+                          .ToString());
+    if (i % 10 == 0)
+      lookups.push_back(lookups.back());
+  }
+  std::sort(lookups.begin(), lookups.end(),
+            [&](const std::string& a, const std::string& b) {
+              return comparator.Compare(a, b) < 0;
+            });
+  std::vector<Slice> lookup_slices(lookups.begin(), lookups.end());
+  std::vector<SSTable::ConstIterator> iters(lookups.size(), sst->end());
+  ASSERT_TRUE(sst->MultiSeek(lookups.size(), lookup_slices.data(),
+                             iters.data()));
+  for (size_t i = 0; i < lookups.size(); i++) {
+    ASSERT_TRUE(sst->Seek(lookups[i], &found));
+    ASSERT_EQ(iters[i] == sst->end(), found == sst->end());
+    if (found != sst->end())
+      ASSERT_EQ(iters[i].Key().ToString(), found.Key().ToString());
+  }
+}
+
+// Counts the reads into the wrapped file, and records the prefetches.
+class CountingSource final : public RandomAccessFile {
+ public:
+  explicit CountingSource(RandomAccessFile* file) : file_(file), reads_(0) {}
+
+  Status Read(size_t n, uint64_t offset, char* dst, Slice* result) override {
+    reads_++;
+    return file_->Read(n, offset, dst, result);
+  }
+
+  Status Prefetch(uint64_t offset, size_t n) override {
+    prefetches_.emplace_back(offset, n);
+    return Status::OK();
+  }
+
+  int Reads() const {
+    return reads_;
+  }
+
+  const std::vector<std::pair<uint64_t, size_t>>& Prefetches() const {
+    return prefetches_;
+  }
+
+ private:
+  RandomAccessFile* file_;
+  int reads_;
+  std::vector<std::pair<uint64_t, size_t>> prefetches_;
+};
+
+// Fails all the reads once Fail() is called.
+class FailingSource final : public RandomAccessFile {
+ public:
+  explicit FailingSource(RandomAccessFile* file)
+      : file_(file), failing_(false) {}
+
+  Status Read(size_t n, uint64_t offset, char* dst, Slice* result) override {
+    if (failing_)
+      return Status::IOError("injected read error");
+    return file_->Read(n, offset, dst, result);
+  }
+
+  void Fail() {
+    failing_ = true;
+  }
+
+ private:
+  RandomAccessFile* file_;
+  bool failing_;
+};
+
+// A block that fails to be read ends the iteration with the error, which
+// is kept in the iterator.
+TEST(Basic, ReadError) {
+  Options options;
+  options.block_size = 1024;
+  StringSink sink;
+  SSTableBuilder builder(&options, &sink);
+  for (int i = 0; i < 2000; i++) {
+    char key[16];
+    snprintf(key, sizeof(key), "key%06d", i);
+    ASSERT_TRUE(builder.Add(key, RandomString(100)));
+  }
+  ASSERT_TRUE(builder.Finish());
+
+  StringSource source(sink.Content());
+  FailingSource failing(&source);
+  Status s;
+  std::unique_ptr<SSTable> sst(
+      SSTable::Open(options, &failing, sink.Content().size(), s));
+  ASSERT_TRUE(s) << s.ToString();
+
+  auto it = sst->begin();
+  ASSERT_TRUE(it.Stat());
+  failing.Fail();
+  int n = 0;
+  for (; it != sst->end(); ++it) {
+    n++;
+  }
+  ASSERT_GT(n, 0);
+  ASSERT_LT(n, 2000);
+  ASSERT_TRUE(it.Stat().IsIOError()) << it.Stat().ToString();
+
+  ASSERT_TRUE(sst->begin() == sst->end());
+  ASSERT_TRUE(sst->begin().Stat().IsIOError());
+  auto found = sst->find("key001000");
+  ASSERT_TRUE(found == sst->end());
+  ASSERT_TRUE(found.Stat().IsIOError());
+  SSTable::ConstIterator sought = sst->end();
+  ASSERT_TRUE(sst->Seek("key001000", &sought).IsIOError());
+}
+
+TEST(Basic, Filter) {
+  InternalKeyComparator comparator(NewBytewiseComparator());
+  std::unique_ptr<FilterStrategy> bloom(FilterStrategy::Default(10));
+  Options options;
+  options.comparator = &comparator;
+  options.filter_strategy = bloom.get();
+  options.block_size = 256;
+
+  auto user_key_of = [](int i) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "key%06d", i);
+    return std::string(buf);
+  };
+
+  StringSink sink;
+  SSTableBuilder builder(&options, &sink);
+  for (int i = 0; i < 1000; i++) {
+    std::string user_key = user_key_of(i * 2);
+    ASSERT_TRUE(builder.Add(InternalKeyBuf(user_key, i, kTypeValue).Data(),
+                            std::to_string(i)));
+  }
+  ASSERT_TRUE(builder.Finish());
+
+  StringSource source(sink.Content());
+  CountingSource counting(&source);
+  Status s;
+  std::unique_ptr<SSTable> sst(
+      SSTable::Open(options, &counting, sink.Content().size(), s));
+  ASSERT_TRUE(s) << s.ToString();
+
+  // Keys are probed by their user keys, regardless of the sequence numbers.
+  for (int i = 0; i < 1000; i++) {
+    std::string user_key = user_key_of(i * 2);
+    ASSERT_TRUE(sst->KeyMayMatch(LookupKey(user_key, 5000).Key()));
+    auto found = sst->find(InternalKeyBuf(user_key, i, kTypeValue).Data());
+    ASSERT_TRUE(found != sst->end());
+    ASSERT_EQ(found.Value().ToString(), std::to_string(i));
+  }
+
+  // Most of the missing keys are ruled out without reading any block.
+  int reads = counting.Reads();
+  int false_positives = 0;
+  for (int i = 0; i < 1000; i++) {
+    std::string user_key = user_key_of(i * 2 + 1);
+    if (sst->KeyMayMatch(LookupKey(user_key, 5000).Key())) {
+      false_positives++;
+    }
+    ASSERT_TRUE(sst->find(InternalKeyBuf(user_key, i, kTypeValue).Data()) ==
+                sst->end());
+  }
+  ASSERT_LE(false_positives, 30);
+  ASSERT_LE(counting.Reads() - reads, false_positives);
+
+  // Tables are still readable without the filter strategy.
+  options.filter_strategy = nullptr;
+  sst.reset(SSTable::Open(options, &source, sink.Content().size(), s));
+  ASSERT_TRUE(s) << s.ToString();
+  ASSERT_TRUE(sst->KeyMayMatch(LookupKey("key1", 5000).Key()));
+}
+
+TEST(Basic, PrefixFilter) {
+  InternalKeyComparator comparator(NewBytewiseComparator());
+  std::unique_ptr<FilterStrategy> bloom(FilterStrategy::Default(10));
+  std::unique_ptr<PrefixExtractor> prefix_extractor(PrefixExtractor::Fixed(6));
+  Options options;
+  options.comparator = &comparator;
+  options.filter_strategy = bloom.get();
+  options.prefix_extractor = prefix_extractor.get();
+  options.block_size = 256;
+
+  // 10 keys for each of the prefixes "pre%03d" with even numbers.
+  StringSink sink;
+  SSTableBuilder builder(&options, &sink);
+  for (int i = 0; i < 5000; i++) {
+    char user_key[16];
+    snprintf(user_key, sizeof(user_key), "pre%03d%02d", (i / 10) * 2, i % 10);
+    ASSERT_TRUE(builder.Add(InternalKeyBuf(user_key, i, kTypeValue).Data(),
+                            std::to_string(i)));
+  }
+  ASSERT_TRUE(builder.Finish());
+
+  StringSource source(sink.Content());
+  Status s;
+  std::unique_ptr<SSTable> sst(
+      SSTable::Open(options, &source, sink.Content().size(), s));
+  ASSERT_TRUE(s) << s.ToString();
+
+  int false_positives = 0;
+  for (int i = 0; i < 1000; i++) {
+    char prefix[16];
+    snprintf(prefix, sizeof(prefix), "pre%03d", i);
+    if (i % 2 == 0) {
+      ASSERT_TRUE(sst->PrefixMayMatch(prefix)) << prefix;
+    } else if (sst->PrefixMayMatch(prefix)) {
+      false_positives++;
+    }
+  }
+  ASSERT_LE(false_positives, 30);
+
+  // The prefix filter is ignored by a different extractor.
+  std::unique_ptr<PrefixExtractor> other(PrefixExtractor::Fixed(5));
+  options.prefix_extractor = other.get();
+  sst.reset(SSTable::Open(options, &source, sink.Content().size(), s));
+  ASSERT_TRUE(s) << s.ToString();
+  ASSERT_TRUE(sst->PrefixMayMatch("pre001"));
+}
+
+void testReadahead(bool variable_values) {
+  Options options;
+  options.block_size = 1024;
+  options.max_auto_readahead_size = 32 << 10;
+
+  // Blocks of variable sizes tell the start of a block from its end.
+  StringSink sink;
+  SSTableBuilder builder(&options, &sink);
+  for (int i = 0; i < 2000; i++) {
+    char key[16];
+    snprintf(key, sizeof(key), "key%06d", i);
+    int len = variable_values ? RandomIn(0, 300) : 100;
+    ASSERT_TRUE(builder.Add(key, RandomString(len)));
   }
-}
\ No newline at end of file
+  ASSERT_TRUE(builder.Finish());
+
+  StringSource source(sink.Content());
+  CountingSource counting(&source);
+  Status s;
+  std::unique_ptr<SSTable> sst(
+      SSTable::Open(options, &counting, sink.Content().size(), s));
+  ASSERT_TRUE(s) << s.ToString();
+
+  // Point lookups don't prefetch.
+  for (int i = 0; i < 2000; i += 100) {
+    char key[16];
+    snprintf(key, sizeof(key), "key%06d", i);
+    ASSERT_TRUE(sst->find(key) != sst->end());
+  }
+  ASSERT_TRUE(counting.Prefetches().empty());
+
+  // A full scan prefetches ahead of the reads, in windows doubling from 8KB
+  // up to the maximum, each starting where the last one ends.
+  int n = 0;
+  for (auto it = sst->begin(); it != sst->end(); ++it) {
+    n++;
+  }
+  ASSERT_EQ(n, 2000);
+  auto& prefetches = counting.Prefetches();
+  ASSERT_GT(prefetches.size(), 4);
+  size_t expected = 8 << 10;
+  for (size_t i = 0; i < prefetches.size(); i++) {
+    ASSERT_EQ(prefetches[i].second, expected);
+    if (i > 0) {
+      ASSERT_EQ(prefetches[i].first,
+                prefetches[i - 1].first + prefetches[i - 1].second);
+    }
+    expected = std::min<size_t>(expected * 2, options.max_auto_readahead_size);
+  }
+
+  // Disabled.
+  options.max_auto_readahead_size = 0;
+  CountingSource counting2(&source);
+  sst.reset(SSTable::Open(options, &counting2, sink.Content().size(), s));
+  ASSERT_TRUE(s) << s.ToString();
+  for (auto it = sst->begin(); it != sst->end(); ++it) {
+  }
+  ASSERT_TRUE(counting2.Prefetches().empty());
+}
+
+TEST(Basic, Readahead) {
+  testReadahead(false);
+}
+
+TEST(Basic, ReadaheadVariableBlockSizes) {
+  testReadahead(true);
+}
+
+TEST(Basic, PartitionedIndex) {
+  std::unique_ptr<CacheStrategy> cache(CacheStrategy::Default(1000));
+  Options options;
+  options.block_size = 256;
+
+  std::vector<std::string> keys;
+  for (int i = 0; i < 3000; i++) {
+    char key[16];
+    snprintf(key, sizeof(key), "key%06d", i * 2);
+    keys.push_back(key);
+  }
+  auto build = [&](std::string* content) {
+    StringSink sink;
+    SSTableBuilder builder(&options, &sink);
+    for (const auto& key : keys) {
+      ASSERT_TRUE(builder.Add(key, RandomString(20)));
+    }
+    ASSERT_TRUE(builder.Finish());
+    *content = sink.Content();
+  };
+  auto count_entries = [](const Block* block) {
+    int n = 0;
+    for (auto it = block->begin(); it != block->end(); ++it)
+      n++;
+    return n;
+  };
+
+  std::string plain;
+  build(&plain);
+  options.index_partition_size = 256;
+  std::string partitioned;
+  build(&partitioned);
+
+  StringSource plain_source(plain);
+  StringSource source(partitioned);
+  CountingSource counting(&source);
+  Status s;
+  std::unique_ptr<SSTable> plain_sst(
+      SSTable::Open(options, &plain_source, plain.size(), s));
+  ASSERT_TRUE(s) << s.ToString();
+  std::unique_ptr<SSTable> sst(
+      SSTable::Open(options, &counting, partitioned.size(), s));
+  ASSERT_TRUE(s) << s.ToString();
+
+  // Only the top-level index is held by the table.
+  int num_blocks = count_entries(plain_sst->TEST_GetIndexBlock());
+  int num_partitions = count_entries(sst->TEST_GetIndexBlock());
+  ASSERT_GT(num_partitions, 1);
+  ASSERT_LT(num_partitions * 4, num_blocks);
+
+  auto it = sst->begin();
+  for (const auto& key : keys) {
+    ASSERT_TRUE(it != sst->end());
+    ASSERT_EQ(it.Key().ToString(), key);
+    ++it;
+  }
+  ASSERT_TRUE(it == sst->end());
+  for (auto key = keys.rbegin(); key != keys.rend(); ++key) {
+    --it;
+    ASSERT_EQ(it.Key().ToString(), *key);
+  }
+
+  for (int i = 0; i < 6000; i++) {
+    char key[16];
+    snprintf(key, sizeof(key), "key%06d", i);
+    auto found = sst->end();
+    ASSERT_TRUE(sst->Seek(key, &found));
+    auto expected = std::lower_bound(keys.begin(), keys.end(), key);
+    ASSERT_EQ(found == sst->end(), expected == keys.end());
+    if (found != sst->end())
+      ASSERT_EQ(found.Key().ToString(), *expected);
+    ASSERT_EQ(sst->find(key) != sst->end(), i % 2 == 0) << key;
+  }
+
+  std::vector<Slice> lookups(keys.begin(), keys.end());
+  std::vector<SSTable::ConstIterator> iters(lookups.size(), sst->end());
+  ASSERT_TRUE(sst->MultiSeek(lookups.size(), lookups.data(), iters.data()));
+  for (size_t i = 0; i < keys.size(); i++) {
+    ASSERT_TRUE(iters[i] != sst->end());
+    ASSERT_EQ(iters[i].Key().ToString(), keys[i]);
+  }
+
+  // The partitions are read through the block cache, along with the data
+  // blocks.
+  options.block_cache = cache.get();
+  sst.reset(SSTable::Open(options, &counting, partitioned.size(), s));
+  ASSERT_TRUE(s) << s.ToString();
+  for (int pass = 0; pass < 2; pass++) {
+    int reads = counting.Reads();
+    for (const auto& key : keys) {
+      ASSERT_TRUE(sst->find(key) != sst->end());
+    }
+    if (pass == 1)
+      ASSERT_EQ(counting.Reads(), reads);
+  }
+}
+
+// Readers share the index block held by the table, and the blocks in a small
+// block cache that keeps evicting them.
+TEST(Basic, ConcurrentReads) {
+  for (size_t partition_size : {0, 256}) {
+    std::unique_ptr<CacheStrategy> cache(CacheStrategy::Default(8));
+    Options options;
+    options.block_size = 256;
+    options.index_partition_size = partition_size;
+
+    std::vector<std::string> keys;
+    for (int i = 0; i < 2000; i++) {
+      char key[16];
+      snprintf(key, sizeof(key), "key%06d", i * 2);
+      keys.push_back(key);
+    }
+    StringSink sink;
+    SSTableBuilder builder(&options, &sink);
+    for (const auto& key : keys) {
+      ASSERT_TRUE(builder.Add(key, key));
+    }
+    ASSERT_TRUE(builder.Finish());
+
+    options.block_cache = cache.get();
+    StringSource source(sink.Content());
+    Status s;
+    std::unique_ptr<SSTable> sst(
+        SSTable::Open(options, &source, sink.Content().size(), s));
+    ASSERT_TRUE(s) << s.ToString();
+
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; t++) {
+      readers.emplace_back([&, t]() {
+        for (int i = 0; i < 4000; i++) {
+          char key[16];
+          snprintf(key, sizeof(key), "key%06d", (i * 7 + t) % 4000);
+          auto it = sst->find(key);
+          ASSERT_EQ(it != sst->end(), (i * 7 + t) % 2 == 0) << key;
+          if (it != sst->end())
+            ASSERT_EQ(it.Value().ToString(), key);
+        }
+
+        size_t n = 0;
+        for (auto it = sst->begin(); it != sst->end(); ++it, n++) {
+          ASSERT_EQ(it.Key().ToString(), keys[n]);
+        }
+        ASSERT_EQ(n, keys.size());
+      });
+    }
+    for (auto& reader : readers) {
+      reader.join();
+    }
+  }
+}
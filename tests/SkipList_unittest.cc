@@ -26,6 +26,7 @@
 #include <gtest/gtest.h>
 #include <thread>
 
+#include "ConcurrentArena.h"
 #include "SkipList.h"
 
 using namespace lessdb;
@@ -120,6 +121,105 @@ TEST(Random, InsertAndLookUp) {
   verifyEqual(s, l);
 }
 
+// Provides a coarse prefix, so that some of the comparisons are resolved by
+// prefixes, and the others fall back to operator().
+struct IntPrefixComparator : public IntComparator {
+  uint64_t Prefix(const int &a) const {
+    return (static_cast<uint64_t>(a) + (1ull << 31)) >> 4;
+  }
+};
+
+// The prefix is stored in the nodes only if the comparator provides one.
+TEST(Basic, NodeKeyLayout) {
+  using internal::SkipListKeyPrefix;
+  using internal::SkipListNodeKey;
+  typedef SkipListKeyPrefix<IntComparator, int> NoPrefix;
+  typedef SkipListKeyPrefix<IntPrefixComparator, int> IntPrefix;
+  ASSERT_EQ(sizeof(SkipListNodeKey<int, NoPrefix>), sizeof(int));
+  ASSERT_EQ(sizeof(SkipListNodeKey<int, IntPrefix>), 2 * sizeof(uint64_t));
+
+  SkipListNodeKey<int, IntPrefix> key(3, IntPrefix(IntPrefixComparator(), 3));
+  ASSERT_EQ(key.Prefix().prefix, IntPrefixComparator().Prefix(3));
+}
+
+TEST(Random, InsertAndLookUpWithPrefix) {
+  SysArena arena;
+  SkipList<int, IntPrefixComparator> l(&arena);
+  std::set<int> s;
+
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    int key = std::rand() % 4000 - 2000;
+    l.Insert(key);
+    s.insert(key);
+  }
+
+  auto it1 = l.Begin();
+  for (auto it2 = s.begin(); it2 != s.end(); it1++, it2++) {
+    ASSERT_EQ(*it1, *it2);
+    ASSERT_EQ(*l.Find(*it2), *it2);
+    ASSERT_EQ(*l.LowerBound(*it2), *it2);
+  }
+  ASSERT_EQ(it1, l.End());
+
+  for (int key = -2100; key < 2100; key++) {
+    auto it = l.UpperBound(key);
+    auto expected = s.upper_bound(key);
+    if (expected == s.end()) {
+      ASSERT_EQ(it, l.End());
+    } else {
+      ASSERT_EQ(*it, *expected);
+    }
+  }
+}
+
+TEST(Hint, Sequential) {
+  SysArena arena;
+  SkipList<int, IntComparator> l(&arena);
+  SkipList<int, IntComparator>::InsertHint hint;
+
+  const int N = 10000;
+  for (int i = 0; i < N; i++) {
+    ASSERT_EQ(*l.Insert(i, &hint), i);
+  }
+  // duplicates
+  ASSERT_EQ(*l.Insert(N - 1, &hint), N - 1);
+
+  int expected = 0;
+  for (auto it = l.Begin(); it != l.End(); it++, expected++) {
+    ASSERT_EQ(*it, expected);
+  }
+  ASSERT_EQ(expected, N);
+}
+
+TEST(Hint, SortedRuns) {
+  SysArena arena;
+  SkipList<int, IntPrefixComparator> l(&arena);
+  std::set<int> s;
+
+  // Each run is sorted, but the runs are interleaved, so that the hint is
+  // sometimes useless.
+  for (int run = 0; run < 100; run++) {
+    SkipList<int, IntPrefixComparator>::InsertHint hint;
+    int key = std::rand() % 100000;
+    for (int i = 0; i < 100; i++) {
+      key += std::rand() % 10;
+      l.Insert(key, &hint);
+      s.insert(key);
+    }
+    // A key that goes before the hinted position.
+    l.Insert(key - 500, &hint);
+    s.insert(key - 500);
+  }
+
+  auto it1 = l.Begin();
+  for (auto it2 = s.begin(); it2 != s.end(); it1++, it2++) {
+    ASSERT_EQ(*it1, *it2);
+    ASSERT_EQ(*l.Find(*it2), *it2);
+  }
+  ASSERT_EQ(it1, l.End());
+}
+
 void randomAdding(boost::latch *latch, std::mutex *mtx, int ndata,
                   SkipList<int, IntComparator> *l, std::set<int> *s) {
   latch->count_down_and_wait();
@@ -171,6 +271,54 @@ TEST(Concurrent, Add) {
   testConcurrentAdd(50);
 }
 
+typedef SkipList<int, IntComparator, ConcurrentArena> ConcurrentSkipList;
+
+void randomConcurrentAdding(boost::latch *latch, int ndata,
+                            ConcurrentSkipList *l, std::set<int> *s) {
+  latch->count_down_and_wait();
+
+  std::mt19937 gen(std::hash<std::thread::id>()(std::this_thread::get_id()));
+  std::uniform_int_distribution<int> distrib(0, 4999);
+  for (int i = 0; i < ndata; i++) {
+    int val = distrib(gen);
+    ASSERT_EQ(*l->InsertConcurrently(val), val);
+    s->insert(val);
+  }
+}
+
+void testMultiWriterAdd(size_t nthreads, int ndata) {
+  ConcurrentArena arena;
+  ConcurrentSkipList l(&arena);
+  std::vector<std::set<int>> s(nthreads);  // verifier
+  boost::thread_group group;
+  boost::latch latch(nthreads);
+
+  for (int i = 0; i < nthreads; i++) {
+    group.create_thread(
+        std::bind(randomConcurrentAdding, &latch, ndata, &l, &s[i]));
+  }
+  group.join_all();
+
+  std::set<int> all;
+  for (int i = 0; i < nthreads; i++) {
+    all.insert(s[i].begin(), s[i].end());
+  }
+
+  // every key appears exactly once, in order.
+  size_t count = 0;
+  for (auto it = l.Begin(); it != l.End(); it++)
+    count++;
+  ASSERT_EQ(count, all.size());
+  for (auto it = all.begin(); it != all.end(); it++) {
+    ASSERT_EQ(*it, *l.Find(*it));
+  }
+}
+
+TEST(Concurrent, MultiWriterAdd) {
+  testMultiWriterAdd(4, 10000);
+  testMultiWriterAdd(16, 2000);
+}
+
 void randomAccess(boost::latch *latch, SkipList<int, IntComparator> *l,
                   std::set<int> *s) {
   latch->count_down_and_wait();
@@ -42,6 +42,36 @@ TEST(Basic, Corruption) {
   ASSERT_EQ(s.ToString(), "Corruption: test");
 }
 
+TEST(Basic, NotFound) {
+  Status s = Status::NotFound("test");
+  ASSERT_EQ(s.IsNotFound(), true);
+  ASSERT_EQ(s.IsCorruption(), false);
+  ASSERT_EQ(s.ToString(), "NotFound: test");
+  ASSERT_EQ(Status::OK().IsNotFound(), false);
+}
+
+TEST(Basic, NoMessage) {
+  Status s = Status::NotFound();
+  ASSERT_TRUE(s.IsNotFound());
+  ASSERT_EQ(s.ToString(), "NotFound: ");
+
+  // Appending to a copy leaves the others without message.
+  Status s2 = s;
+  s2 << "key";
+  ASSERT_EQ(s2.ToString(), "NotFound: key");
+  ASSERT_EQ(s.ToString(), "NotFound: ");
+  ASSERT_EQ(Status::NotFound().ToString(), "NotFound: ");
+
+  s2 = s;
+  ASSERT_EQ(s2.ToString(), "NotFound: ");
+  s = Status::Corruption("test");
+  s2 = s;
+  ASSERT_EQ(s2.ToString(), "Corruption: test");
+  s = Status::OK();
+  ASSERT_TRUE(s.IsOK());
+  ASSERT_TRUE(s2.IsCorruption());
+}
+
 TEST(Basic, Copy) {
   Status s = Status::Corruption("test");
   ASSERT_EQ(s.IsOK(), false);
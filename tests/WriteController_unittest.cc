@@ -0,0 +1,76 @@
+/**
+ * Copyright (C) 2016, Wu Tao. All rights reserved.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include <gtest/gtest.h>
+
+#include "WriteController.h"
+
+using namespace lessdb;
+
+TEST(WriteController, NotDelayed) {
+  WriteController controller;
+  ASSERT_FALSE(controller.IsDelayed());
+  ASSERT_EQ(controller.GetDelay(1000, 1 << 20), 0);
+}
+
+TEST(WriteController, Rate) {
+  WriteController controller;
+  controller.SetDelayedWriteRate(1000000);  // 1 byte per microsecond
+  ASSERT_TRUE(controller.IsDelayed());
+
+  uint64_t now = 1000000;
+  // No credit at the beginning of the slowdown.
+  ASSERT_EQ(controller.GetDelay(now, 100), 100);
+
+  // The writes issued before the previous delay is over queue up behind it.
+  ASSERT_EQ(controller.GetDelay(now, 100), 200);
+  ASSERT_EQ(controller.GetDelay(now + 200, 50), 50);
+
+  // The credit earned in a pause lets a small burst through.
+  now += 10000;
+  ASSERT_EQ(controller.GetDelay(now, 600), 0);
+  ASSERT_EQ(controller.GetDelay(now, 400), 0);
+  ASSERT_EQ(controller.GetDelay(now, 100), 100);
+
+  // Throughput is bounded by the rate.
+  now += 100000;
+  uint64_t end = now;
+  for (int i = 0; i < 1000; i++) {
+    end = now + controller.GetDelay(now, 1000);
+  }
+  ASSERT_GE(end - now, 998000);
+  ASSERT_LE(end - now, 1000000);
+}
+
+TEST(WriteController, Reset) {
+  WriteController controller;
+  controller.SetDelayedWriteRate(1000000);
+  ASSERT_EQ(controller.GetDelay(1000, 100), 100);
+
+  controller.SetDelayedWriteRate(0);
+  ASSERT_FALSE(controller.IsDelayed());
+  ASSERT_EQ(controller.GetDelay(1000, 100), 0);
+
+  // A new slowdown starts without the debt or the credit of the last one.
+  controller.SetDelayedWriteRate(2000000);
+  ASSERT_EQ(controller.GetDelay(2000000, 100), 50);
+}
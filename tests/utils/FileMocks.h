@@ -22,6 +22,9 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstring>
+#include <map>
 #include <string>
 
 #include "Comparator.h"
@@ -50,9 +53,32 @@ class StringSource final : public RandomAccessFile {
   std::string content_;
 };
 
+class StringSequentialSource final : public SequentialFile {
+ public:
+  explicit StringSequentialSource(const std::string &content)
+      : content_(content), pos_(0) {}
+
+  Status Read(size_t n, char *dst, Slice *result) override {
+    n = std::min(n, content_.length() - pos_);
+    memcpy(dst, content_.data() + pos_, n);
+    pos_ += n;
+    (*result) = Slice(dst, n);
+    return Status::OK();
+  }
+
+  Status Skip(uint64_t n) override {
+    pos_ += std::min<size_t>(n, content_.length() - pos_);
+    return Status::OK();
+  }
+
+ private:
+  std::string content_;
+  size_t pos_;
+};
+
 class StringSink final : public WritableFile {
  public:
-  StringSink() : closed_(false) {}
+  StringSink() : closed_(false), appends_(0), syncs_(0) {}
 
   Status Flush() override {
     assert(!closed_);
@@ -67,12 +93,14 @@ class StringSink final : public WritableFile {
 
   Status Sync() override {
     assert(!closed_);
+    syncs_++;
     return Status::OK();
   }
 
   Status Append(const Slice &data) override {
     assert(!closed_);
     content_.append(data.RawData(), data.Len());
+    appends_++;
     return Status::OK();
   }
 
@@ -80,9 +108,25 @@ class StringSink final : public WritableFile {
     return content_;
   }
 
+  std::string *MutableContent() {
+    return &content_;
+  }
+
+  // The number of calls to Append.
+  int Appends() const {
+    return appends_;
+  }
+
+  // The number of calls to Sync.
+  int Syncs() const {
+    return syncs_;
+  }
+
  private:
   std::string content_;
   bool closed_;
+  int appends_;
+  int syncs_;
 };
 
 // An STL comparator that uses a Comparator